@@ -0,0 +1,22 @@
+--
+-- C-level conversion micro-benchmarks, run by run_bench.sh after setup.sql.
+-- Each row times one converter of pg_conversion.c over synthetic data,
+-- without the executor, the function call handler or the R evaluator.
+--
+\set loops 20
+COPY (
+  SELECT 'array_get_r' AS converter, t::text AS types, d::text AS shape, r.*
+    FROM unnest(ARRAY['int2','int4','int8','float4','float8','numeric','bool','text']::regtype[]) t,
+         unnest(ARRAY['{10}','{10000}','{1000000}','{100,100}','{1000,1000}']::text[]) d,
+         plr_bench.array_get_r(t, d::int4[], CASE WHEN d IN ('{10}','{10000}') THEN 200 ELSE :loops END) r
+  UNION ALL
+  SELECT 'tuple_get_r_frame', c::text, n::text, r.*
+    FROM unnest(ARRAY['{int4}','{float8}','{text}','{int4,float8,text}','{int4,int4,int4,int4,int4,int4,int4,int4,int4,int4}']::text[]) c,
+         unnest(ARRAY[1, 1000, 100000]) n,
+         plr_bench.tuple_get_r_frame(c::regtype[], n, CASE WHEN n < 100000 THEN 200 ELSE :loops END) r
+  UNION ALL
+  SELECT 'frame_tuplestore', c::text, n::text, r.*
+    FROM unnest(ARRAY['{int4}','{float8}','{text}','{int4,float8,text}','{int4,int4,int4,int4,int4,int4,int4,int4,int4,int4}']::text[]) c,
+         unnest(ARRAY[1, 1000, 100000]) n,
+         plr_bench.frame_tuplestore(c::regtype[], n, CASE WHEN n < 100000 THEN 200 ELSE :loops END) r
+) TO STDOUT WITH CSV HEADER;
@@ -0,0 +1,156 @@
+#!/bin/sh
+#
+# PL/R benchmark driver, run by "make bench".
+#
+# Usage: run_bench.sh [dbname]
+#
+# Loads setup.sql into the plr_bench schema of the database (default
+# plr_bench, created if needed) and runs every case below with pgbench.
+# Results go to stdout and to results/bench-<timestamp>.csv, one line per
+# case, with throughput and per transaction latency percentiles in ms.
+# The C-level conversion benchmarks of conversion.sql, selected as the
+# case "conversion", go to results/conversion-<timestamp>.csv.
+#
+# Environment:
+#   BENCH_DURATION  seconds per timed case (default 10)
+#   BENCH_CLIENTS   pgbench clients (default 1)
+#   BENCH_CASES     only run cases whose name matches this grep pattern
+#   PGBENCH, PSQL   programs to use (default from PATH)
+#   PGHOST, PGPORT, PGUSER ... as usual for libpq
+#
+
+set -e
+
+DB="${1:-plr_bench}"
+DURATION="${BENCH_DURATION:-10}"
+CLIENTS="${BENCH_CLIENTS:-1}"
+CASES_FILTER="${BENCH_CASES:-.}"
+PGBENCH="${PGBENCH:-pgbench}"
+PSQL="${PSQL:-psql}"
+
+BENCHDIR=`cd \`dirname "$0"\` && pwd`
+SCRIPTS="$BENCHDIR/scripts"
+RESULTS="$BENCHDIR/results"
+STAMP=`date +%Y%m%d-%H%M%S`
+CSV="$RESULTS/bench-$STAMP.csv"
+LOGDIR=`mktemp -d "${TMPDIR:-/tmp}/plr_bench.XXXXXX"`
+trap 'rm -rf "$LOGDIR"' EXIT
+
+mkdir -p "$RESULTS"
+failed=0
+
+# create the database unless it exists, then load the fixtures
+if ! "$PSQL" -X -q -d "$DB" -c "SELECT 1" >/dev/null 2>&1; then
+	createdb "$DB"
+	"$PSQL" -X -q -d "$DB" -c "CREATE EXTENSION plr"
+fi
+"$PSQL" -X -q -v ON_ERROR_STOP=1 -d "$DB" -f "$BENCHDIR/setup.sql"
+
+echo "case,params,clients,transactions,tps,lat_mean_ms,lat_p50_ms,lat_p90_ms,lat_p99_ms,lat_max_ms" > "$CSV"
+
+#
+# run_case name script limit [var=value ...]
+#
+# limit is either a duration like "T" (BENCH_DURATION seconds) or a fixed
+# transaction count like "t5", for cases too slow to time.
+#
+run_case()
+{
+	name="$1"; script="$2"; limit="$3"
+	shift 3
+
+	echo "$name" | grep -q -e "$CASES_FILTER" || return 0
+
+	params=""
+	defs=""
+	for def in "$@"; do
+		params="$params${params:+ }$def"
+		defs="$defs -D $def"
+	done
+
+	case "$limit" in
+		T)	limitopt="-T $DURATION" ;;
+		t*)	limitopt="-t `echo $limit | cut -c2-`" ;;
+	esac
+
+	rm -f "$LOGDIR"/log*
+	out=`"$PGBENCH" -n -c "$CLIENTS" $limitopt $defs -l \
+		--log-prefix="$LOGDIR/log" -f "$SCRIPTS/$script" "$DB" 2>&1` || {
+		echo "$out" >&2
+		echo "case $name ($params) failed" >&2
+		failed=1
+		return 0
+	}
+	tps=`echo "$out" | sed -n 's/^tps = \([0-9.]*\).*/\1/p' | head -1`
+
+	#
+	# pgbench log lines are "client transaction_no latency_us ...". The
+	# first transaction of each client starts R, so leave it out.
+	#
+	cat "$LOGDIR"/log* | awk '$2 > 0 { print $3 }' | sort -n | awk \
+		-v name="$name" -v params="$params" -v clients="$CLIENTS" -v tps="$tps" '
+		{ lat[NR] = $1; sum += $1 }
+		function pct(p,  i) {
+			i = int(NR * p + 0.999999);
+			if (i < 1) i = 1;
+			return lat[i] / 1000.0;
+		}
+		END {
+			if (NR == 0) exit 1;
+			printf "%s,\"%s\",%d,%d,%s,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+				name, params, clients, NR, tps, sum / NR / 1000.0,
+				pct(0.50), pct(0.90), pct(0.99), lat[NR] / 1000.0;
+		}' | tee -a "$CSV"
+}
+
+# scalar calls: one call per transaction, and one call per row
+run_case scalar_call scalar_call.sql T
+for rows in 1000 100000; do
+	run_case scalar_rows scalar_rows.sql T rows=$rows
+done
+
+# array arguments for each element type, one and two dimensions
+for type in int2 int4 int8 float4 float8 numeric bool text; do
+	for dims in 10 10000 1000000 100,100 1000,1000; do
+		run_case array_arg array_arg.sql T type=$type dims=$dims
+	done
+done
+
+# pg.spi.exec result sizes
+for rows in 1 100 10000; do
+	run_case spi_exec spi_exec.sql T rows=$rows
+done
+run_case spi_exec spi_exec.sql t20 rows=1000000
+run_case spi_exec spi_exec.sql t3 rows=10000000
+
+# set returning functions
+for rows in 1 1000 100000; do
+	run_case srf srf.sql T rows=$rows
+	run_case srf_records srf_records.sql T rows=$rows
+done
+
+# window functions
+for rows in 100 10000; do
+	run_case window window.sql T rows=$rows
+done
+
+# row triggers
+"$PSQL" -X -q -d "$DB" -c "TRUNCATE plr_bench.trig_tab"
+for rows in 1 1000; do
+	run_case trigger trigger.sql T rows=$rows
+done
+
+# C-level conversion micro-benchmarks, no pgbench involved
+if echo conversion | grep -q -e "$CASES_FILTER"; then
+	CONV_CSV="$RESULTS/conversion-$STAMP.csv"
+	"$PSQL" -X -q -v ON_ERROR_STOP=1 -d "$DB" -f "$BENCHDIR/conversion.sql" \
+		> "$CONV_CSV" || {
+		echo "case conversion failed" >&2
+		failed=1
+	}
+	cat "$CONV_CSV"
+	echo "conversion results written to $CONV_CSV"
+fi
+
+echo "results written to $CSV"
+exit $failed
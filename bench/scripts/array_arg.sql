@@ -0,0 +1,2 @@
+-- array argument conversion; -D type=<element type> -D dims=<"n" or "n,m">
+SELECT plr_bench.array_len_:type(array_fill(CAST(1 AS :type), ARRAY[:dims]));
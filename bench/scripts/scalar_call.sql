@@ -0,0 +1,3 @@
+-- one scalar PL/R call per transaction
+\set x random(1, 100000)
+SELECT plr_bench.scalar_float8(:x);
@@ -0,0 +1,2 @@
+-- one scalar PL/R call per row; -D rows=<rows per transaction>
+SELECT sum(plr_bench.scalar_float8(f)) FROM plr_bench.data WHERE id <= :rows;
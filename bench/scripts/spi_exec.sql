@@ -0,0 +1,2 @@
+-- pg.spi.exec returning a data.frame; -D rows=<result rows>
+SELECT plr_bench.spi_rows(:rows);
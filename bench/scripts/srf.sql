@@ -0,0 +1,2 @@
+-- set returning function of scalars; -D rows=<rows returned>
+SELECT count(*) FROM plr_bench.srf_rows(:rows);
@@ -0,0 +1,2 @@
+-- set returning function of records; -D rows=<rows returned>
+SELECT count(*) FROM plr_bench.srf_records(:rows);
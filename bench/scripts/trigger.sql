@@ -0,0 +1,2 @@
+-- BEFORE INSERT row trigger; -D rows=<rows inserted per transaction>
+INSERT INTO plr_bench.trig_tab SELECT g, g / 7.0, 'x' FROM generate_series(1, :rows) g;
@@ -0,0 +1,4 @@
+-- window function over a sliding frame; -D rows=<rows in the partition>
+SELECT count(m) FROM (
+  SELECT plr_bench.win_mean(f) OVER (ORDER BY id ROWS 10 PRECEDING) AS m
+  FROM plr_bench.data WHERE id <= :rows) s;
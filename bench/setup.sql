@@ -0,0 +1,63 @@
+--
+-- PL/R benchmark fixtures, loaded by run_bench.sh into the plr_bench schema.
+-- Expects PL/R to be installed in the target database.
+--
+SET client_min_messages = warning;
+DROP SCHEMA IF EXISTS plr_bench CASCADE;
+CREATE SCHEMA plr_bench;
+
+-- data for the per row, window and trigger cases
+CREATE TABLE plr_bench.data AS
+  SELECT g AS id, g::float8 / 7 AS f, md5(g::text) AS t
+  FROM generate_series(1, 100000) g;
+ALTER TABLE plr_bench.data ADD PRIMARY KEY (id);
+ANALYZE plr_bench.data;
+
+-- scalar calls
+CREATE FUNCTION plr_bench.scalar_int4(int4) RETURNS int4 AS 'arg1 + 1L' LANGUAGE plr;
+CREATE FUNCTION plr_bench.scalar_float8(float8) RETURNS float8 AS 'arg1 * 2' LANGUAGE plr;
+CREATE FUNCTION plr_bench.scalar_text(text) RETURNS int4 AS 'nchar(arg1)' LANGUAGE plr;
+
+-- array argument conversion, one function per element type
+CREATE FUNCTION plr_bench.array_len_int2(int2[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_int4(int4[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_int8(int8[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_float4(float4[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_float8(float8[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_numeric(numeric[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_bool(bool[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+CREATE FUNCTION plr_bench.array_len_text(text[]) RETURNS int4 AS 'length(arg1)' LANGUAGE plr;
+
+-- pg.spi.exec result conversion
+CREATE FUNCTION plr_bench.spi_rows(int4) RETURNS int4 AS '
+  nrow(pg.spi.exec(sprintf("SELECT g, g::float8 AS f FROM generate_series(1, %d) g", arg1)))
+' LANGUAGE plr;
+
+-- set returning functions
+CREATE FUNCTION plr_bench.srf_rows(int4) RETURNS SETOF int4 AS 'seq_len(arg1)' LANGUAGE plr;
+CREATE TYPE plr_bench.srf_rec AS (i int4, f float8, t text);
+CREATE FUNCTION plr_bench.srf_records(int4) RETURNS SETOF plr_bench.srf_rec AS '
+  i <- seq_len(arg1)
+  data.frame(i = i, f = i / 7, t = as.character(i), stringsAsFactors = FALSE)
+' LANGUAGE plr;
+
+-- window functions
+CREATE FUNCTION plr_bench.win_mean(float8) RETURNS float8 AS '
+  mean(farg1)
+' LANGUAGE plr WINDOW;
+
+-- row triggers
+CREATE TABLE plr_bench.trig_tab (id int4, f float8, t text);
+CREATE FUNCTION plr_bench.trig_passthru() RETURNS trigger AS 'return(pg.tg.new)' LANGUAGE plr;
+CREATE TRIGGER trig_passthru BEFORE INSERT ON plr_bench.trig_tab
+  FOR EACH ROW EXECUTE PROCEDURE plr_bench.trig_passthru();
+
+-- C-level conversion micro-benchmarks, see conversion.sql
+CREATE TYPE plr_bench.conv_result AS (loops int4, elements int8, total_ms float8,
+  ns_per_element float8, pg_bytes int8, r_bytes int8);
+CREATE FUNCTION plr_bench.array_get_r(elemtype regtype, dims int4[], loops int4)
+  RETURNS plr_bench.conv_result AS '$libdir/plr','plr_bench_array_get_r' LANGUAGE C STRICT;
+CREATE FUNCTION plr_bench.tuple_get_r_frame(coltypes regtype[], nrows int4, loops int4)
+  RETURNS plr_bench.conv_result AS '$libdir/plr','plr_bench_tuple_get_r_frame' LANGUAGE C STRICT;
+CREATE FUNCTION plr_bench.frame_tuplestore(coltypes regtype[], nrows int4, loops int4)
+  RETURNS plr_bench.conv_result AS '$libdir/plr','plr_bench_frame_tuplestore' LANGUAGE C STRICT;
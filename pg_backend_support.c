@@ -46,6 +46,91 @@ extern HTAB *plr_HashTable;
 /* caller's memory context */
 extern MemoryContext plr_caller_context;
 
+/* maximum number of functions tracked in shared memory */
+#define PLR_STAT_MAX_FUNCS		1000
+
+/* function statistics hash table key and entry */
+typedef struct plr_stat_key
+{
+	Oid				dbid;
+	Oid				funcid;
+}	plr_stat_key;
+
+typedef struct plr_stat_entry
+{
+	plr_stat_key	key;		/* hash key -- must be first */
+	slock_t			mutex;		/* protects stats in shared memory */
+	plr_func_stats	stats;
+}	plr_stat_entry;
+
+typedef struct plr_stat_shared_state
+{
+#if PG_VERSION_NUM >= 90400
+	LWLock		   *lock;		/* protects hash table lookup/modification */
+#else
+	LWLockId		lock;
+#endif
+}	plr_stat_shared_state;
+
+/*
+ * Function statistics live in shared memory when PL/R is listed in
+ * shared_preload_libraries, and in a backend local hash table otherwise
+ */
+bool plr_track_functions = false;
+plr_func_stats plr_backend_stats;
+static plr_stat_shared_state *plr_stat_shared = NULL;
+static HTAB *plr_stat_shared_hash = NULL;
+static HTAB *plr_stat_local_hash = NULL;
+
+/* gc.time() at the end of the last outermost call, while R has not run since */
+static double plr_stat_gc_last = 0;
+static bool plr_stat_gc_last_valid = false;
+#if PG_VERSION_NUM >= 80400
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#endif
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+/*
+ * R profiler samples are kept per backend; R writes them to a temporary
+ * file while a profiled call runs
+ */
+/*
+ * The phases PL/R is in, innermost last. Frames beyond the maximum depth
+ * are counted but neither reported nor passed to the plugin.
+ */
+#define PLR_PHASE_MAX_DEPTH		64
+
+static plr_phase plr_phase_stack[PLR_PHASE_MAX_DEPTH];
+static const char *plr_phase_details[PLR_PHASE_MAX_DEPTH];
+static int plr_phase_depth = 0;
+
+/* the phase depth at the start of each open subtransaction, innermost last */
+typedef struct plr_phase_subxact
+{
+	SubTransactionId subid;
+	int			depth;
+} plr_phase_subxact;
+
+static plr_phase_subxact *plr_phase_subxacts = NULL;
+static int plr_phase_nsubxacts = 0;
+static int plr_phase_maxsubxacts = 0;
+static PLR_plugin **plr_plugin_ptr = NULL;
+#if PG_VERSION_NUM >= 170000
+static const char *const plr_phase_wait_names[PLR_PHASE_COUNT] =
+{
+	NULL, "PLRInit", "PLRModuleLoad", "PLRCompile", "PLRArgs", "PLREval",
+	"PLRSPI", "PLRResult"
+};
+#endif
+
+bool plr_profile_functions = false;
+int plr_profile_interval = 20;
+static HTAB *plr_profile_hash = NULL;
+static char *plr_profile_file = NULL;
+static bool plr_profile_running = false;
+
 /*
  * static declarations
  */
@@ -54,6 +139,21 @@ static char *expand_dynamic_library_name(const char *name);
 static char *substitute_libpath_macro(const char *name);
 static char *find_in_dynamic_libpath(const char *basename);
 static bool file_exists(const char *name);
+#if PG_VERSION_NUM >= 80400
+static void plr_stat_shmem_reserve(void);
+static void plr_stat_shmem_startup(void);
+#endif
+static double plr_stat_gc_time(void);
+static void plr_stat_accum(plr_func_stats *dst, plr_func_stats *src);
+static void plr_phase_report(void);
+static void plr_phase_xact_callback(XactEvent event, void *arg);
+static void plr_phase_subxact_callback(SubXactEvent event,
+									   SubTransactionId mySubid,
+									   SubTransactionId parentSubid,
+									   void *arg);
+static void plr_profile_stop(void);
+static bool plr_profile_read_line(FILE *fp, StringInfo buf);
+static void plr_profile_add_sample(plr_function *function, char *line);
 
 /*
  * Compute the hashkey for a given function invocation
@@ -252,12 +352,21 @@ get_lib_pathstr(Oid funcid)
 	return cooked_path;
 }
 
+/*
+ * The R command loading the PL/R library into R. Without a function, as
+ * when preloading into the postmaster, the library is $libdir/plr.
+ */
 char *
 get_load_self_ref_cmd(Oid funcid)
 {
-	char   *libstr = get_lib_pathstr(funcid);
+	char   *libstr;
 	char   *buf = NULL;
 
+	if (OidIsValid(funcid))
+		libstr = get_lib_pathstr(funcid);
+	else
+		libstr = expand_dynamic_library_name("$libdir/plr");
+
 	if (libstr)
 		buf = (char *) palloc(strlen(libstr) + 12 + 1);
 	else
@@ -456,3 +565,1308 @@ find_in_dynamic_libpath(const char *basename)
 
 	return NULL;
 }
+
+/*
+ * Reserve shared memory for the function statistics. Only possible while
+ * shared_preload_libraries are being loaded; otherwise the statistics stay
+ * local to each backend. From PostgreSQL 15 on the request itself has to
+ * wait for shmem_request_hook.
+ */
+void
+plr_stat_shmem_request(void)
+{
+#if PG_VERSION_NUM >= 80400
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = plr_stat_shmem_reserve;
+#else
+	plr_stat_shmem_reserve();
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = plr_stat_shmem_startup;
+#endif
+}
+
+#if PG_VERSION_NUM >= 80400
+static void
+plr_stat_shmem_reserve(void)
+{
+#if PG_VERSION_NUM >= 150000
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+#endif
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(plr_stat_shared_state)) +
+						   hash_estimate_size(PLR_STAT_MAX_FUNCS,
+											  sizeof(plr_stat_entry)));
+#if PG_VERSION_NUM >= 90600
+	RequestNamedLWLockTranche("plr", 1);
+#else
+	RequestAddinLWLocks(1);
+#endif
+}
+
+static void
+plr_stat_shmem_startup(void)
+{
+	HASHCTL		ctl;
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	plr_stat_shared = ShmemInitStruct("PLR function stats",
+									  sizeof(plr_stat_shared_state),
+									  &found);
+	if (!found)
+	{
+#if PG_VERSION_NUM >= 90600
+		plr_stat_shared->lock = &(GetNamedLWLockTranche("plr"))->lock;
+#else
+		plr_stat_shared->lock = LWLockAssign();
+#endif
+	}
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(plr_stat_key);
+	ctl.entrysize = sizeof(plr_stat_entry);
+	ctl.hash = tag_hash;
+	plr_stat_shared_hash = ShmemInitHash("PLR function stats hash",
+										 PLR_STAT_MAX_FUNCS,
+										 PLR_STAT_MAX_FUNCS,
+										 &ctl,
+										 HASH_ELEM | HASH_FUNCTION);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+#endif
+
+/*
+ * Cumulative time R has spent collecting garbage, in milliseconds.
+ * Asking for it also switches R's GC timing on.
+ */
+static double
+plr_stat_gc_time(void)
+{
+	static SEXP	gc_time_call = NULL;
+	SEXP		ans;
+	int			errorOccurred;
+	double		result = 0;
+
+	if (gc_time_call == NULL)
+	{
+		PROTECT(gc_time_call = lang2(install("gc.time"), ScalarLogical(TRUE)));
+		R_PreserveObject(gc_time_call);
+		UNPROTECT(1);
+	}
+
+	PROTECT(ans = R_tryEval(gc_time_call, R_GlobalEnv, &errorOccurred));
+	if (!errorOccurred && isReal(ans) && length(ans) >= 3)
+		result = REAL(ans)[2] * 1000.0;
+	UNPROTECT(1);
+
+	return result;
+}
+
+static void
+plr_stat_accum(plr_func_stats *dst, plr_func_stats *src)
+{
+	dst->calls += src->calls;
+	dst->total_time += src->total_time;
+	dst->args_time += src->args_time;
+	dst->eval_time += src->eval_time;
+	dst->result_time += src->result_time;
+	dst->rows_in += src->rows_in;
+	dst->rows_out += src->rows_out;
+	dst->bytes_in += src->bytes_in;
+	dst->bytes_out += src->bytes_out;
+	dst->gc_count += src->gc_count;
+	dst->gc_time += src->gc_time;
+	dst->gc_max_time = Max(dst->gc_max_time, src->gc_max_time);
+}
+
+/*
+ * Forget the garbage collection time sampled at the end of the last call,
+ * for when R ran outside of the calls
+ */
+void
+plr_stat_gc_forget(void)
+{
+	plr_stat_gc_last_valid = false;
+}
+
+/*
+ * Start timing a call, if plr.track_functions is on
+ */
+void
+plr_stat_begin(plr_stat_call *call)
+{
+	call->active = plr_track_functions;
+	if (!call->active)
+		return;
+
+	memset(&call->counters, 0, sizeof(plr_func_stats));
+	call->base = plr_backend_stats;
+	if (plr_stat_gc_last_valid)
+		call->gc_start = plr_stat_gc_last;
+	else
+		call->gc_start = plr_stat_gc_time();
+	INSTR_TIME_SET_CURRENT(call->start);
+	call->mark = call->start;
+}
+
+/*
+ * Charge the time since the end of the previous phase to phase_time
+ */
+void
+plr_stat_phase(plr_stat_call *call, double *phase_time)
+{
+	instr_time	now;
+	instr_time	elapsed;
+
+	INSTR_TIME_SET_CURRENT(now);
+	elapsed = now;
+	INSTR_TIME_SUBTRACT(elapsed, call->mark);
+	*phase_time += INSTR_TIME_GET_DOUBLE(elapsed) * 1000.0;
+	call->mark = now;
+}
+
+/*
+ * Finish a call and add its counters to the function's totals
+ */
+void
+plr_stat_end(plr_stat_call *call, plr_function *function)
+{
+	plr_func_stats *counters = &call->counters;
+	instr_time		elapsed;
+	double			gc_time;
+	plr_stat_key	key;
+	plr_stat_entry *entry;
+	bool			found;
+
+	if (!call->active)
+		return;
+
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, call->start);
+
+	counters->calls = 1;
+	counters->total_time = INSTR_TIME_GET_DOUBLE(elapsed) * 1000.0;
+	counters->rows_in = plr_backend_stats.rows_in - call->base.rows_in;
+	counters->rows_out = plr_backend_stats.rows_out - call->base.rows_out;
+	counters->bytes_in = plr_backend_stats.bytes_in - call->base.bytes_in;
+	counters->bytes_out = plr_backend_stats.bytes_out - call->base.bytes_out;
+
+	/*
+	 * The next call starts where this one ended, unless R runs in between:
+	 * the code of an outer call, or anything that enters a phase
+	 */
+	plr_stat_gc_last = plr_stat_gc_time();
+	plr_stat_gc_last_valid = (plr_phase_depth == 0);
+
+	gc_time = plr_stat_gc_last - call->gc_start;
+	if (gc_time > 0)
+	{
+		counters->gc_count = 1;
+		counters->gc_time = gc_time;
+		counters->gc_max_time = gc_time;
+	}
+
+	plr_stat_accum(&function->stats, counters);
+
+	memset(&key, 0, sizeof(key));
+	key.dbid = MyDatabaseId;
+	key.funcid = function->fn_hashkey->funcOid;
+
+	if (plr_stat_shared_hash != NULL)
+	{
+		LWLockAcquire(plr_stat_shared->lock, LW_SHARED);
+		entry = (plr_stat_entry *) hash_search(plr_stat_shared_hash,
+											   (void *) &key,
+											   HASH_FIND,
+											   NULL);
+		if (entry == NULL)
+		{
+			/* need exclusive lock to make a new entry */
+			LWLockRelease(plr_stat_shared->lock);
+			LWLockAcquire(plr_stat_shared->lock, LW_EXCLUSIVE);
+
+			/* a full table silently drops statistics of new functions */
+			entry = (plr_stat_entry *) hash_search(plr_stat_shared_hash,
+												   (void *) &key,
+												   HASH_ENTER_NULL,
+												   &found);
+			if (entry != NULL && !found)
+			{
+				SpinLockInit(&entry->mutex);
+				memset(&entry->stats, 0, sizeof(plr_func_stats));
+			}
+		}
+
+		if (entry != NULL)
+		{
+			volatile plr_stat_entry *e = (volatile plr_stat_entry *) entry;
+
+			SpinLockAcquire(&e->mutex);
+			plr_stat_accum((plr_func_stats *) &e->stats, counters);
+			SpinLockRelease(&e->mutex);
+		}
+
+		LWLockRelease(plr_stat_shared->lock);
+	}
+	else
+	{
+		if (plr_stat_local_hash == NULL)
+		{
+			HASHCTL		ctl;
+
+			memset(&ctl, 0, sizeof(ctl));
+			ctl.keysize = sizeof(plr_stat_key);
+			ctl.entrysize = sizeof(plr_stat_entry);
+			ctl.hash = tag_hash;
+			plr_stat_local_hash = hash_create("PLR function stats",
+											  FUNCS_PER_USER,
+											  &ctl,
+											  HASH_ELEM | HASH_FUNCTION);
+		}
+
+		entry = (plr_stat_entry *) hash_search(plr_stat_local_hash,
+											   (void *) &key,
+											   HASH_ENTER,
+											   &found);
+		if (!found)
+			memset(&entry->stats, 0, sizeof(plr_func_stats));
+
+		plr_stat_accum(&entry->stats, counters);
+	}
+}
+
+/*
+ * Copy out the statistics of the functions of the current database.
+ * Returns the number of functions, with their oids and statistics in
+ * palloc'd arrays.
+ */
+int
+plr_stat_collect(Oid **funcids, plr_func_stats **stats)
+{
+	HTAB			   *hash;
+	HASH_SEQ_STATUS		hash_seq;
+	plr_stat_entry	   *entry;
+	int					n = 0;
+	long				maxn;
+
+	*funcids = NULL;
+	*stats = NULL;
+
+	hash = (plr_stat_shared_hash != NULL) ? plr_stat_shared_hash : plr_stat_local_hash;
+	if (hash == NULL)
+		return 0;
+
+	if (plr_stat_shared_hash != NULL)
+		LWLockAcquire(plr_stat_shared->lock, LW_SHARED);
+
+	maxn = hash_get_num_entries(hash);
+	if (maxn > 0)
+	{
+		*funcids = (Oid *) palloc(maxn * sizeof(Oid));
+		*stats = (plr_func_stats *) palloc(maxn * sizeof(plr_func_stats));
+	}
+
+	hash_seq_init(&hash_seq, hash);
+	while ((entry = (plr_stat_entry *) hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (entry->key.dbid != MyDatabaseId || n >= maxn)
+			continue;
+
+		(*funcids)[n] = entry->key.funcid;
+		if (plr_stat_shared_hash != NULL)
+		{
+			volatile plr_stat_entry *e = (volatile plr_stat_entry *) entry;
+
+			SpinLockAcquire(&e->mutex);
+			(*stats)[n] = e->stats;
+			SpinLockRelease(&e->mutex);
+		}
+		else
+			(*stats)[n] = entry->stats;
+		n++;
+	}
+
+	if (plr_stat_shared_hash != NULL)
+		LWLockRelease(plr_stat_shared->lock);
+
+	return n;
+}
+
+/*
+ * Forget the statistics of the functions of the current database
+ */
+void
+plr_stat_reset_entries(void)
+{
+	HTAB			   *hash;
+	HASH_SEQ_STATUS		hash_seq;
+	plr_stat_entry	   *entry;
+
+	hash = (plr_stat_shared_hash != NULL) ? plr_stat_shared_hash : plr_stat_local_hash;
+	if (hash == NULL)
+		return;
+
+	if (plr_stat_shared_hash != NULL)
+		LWLockAcquire(plr_stat_shared->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&hash_seq, hash);
+	while ((entry = (plr_stat_entry *) hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (entry->key.dbid == MyDatabaseId)
+			hash_search(hash, (void *) &entry->key, HASH_REMOVE, NULL);
+	}
+
+	if (plr_stat_shared_hash != NULL)
+		LWLockRelease(plr_stat_shared->lock);
+}
+
+/*
+ * Look up the plugin rendezvous variable and arrange for the phases to be
+ * forgotten when a transaction aborts
+ */
+void
+plr_phase_init(void)
+{
+	plr_plugin_ptr = (PLR_plugin **) find_rendezvous_variable("PLR_plugin");
+
+	RegisterXactCallback(plr_phase_xact_callback, NULL);
+	RegisterSubXactCallback(plr_phase_subxact_callback, NULL);
+}
+
+/*
+ * Enter a phase. Returns the level to hand to plr_phase_end() when the
+ * phase is over.
+ */
+int
+plr_phase_start(plr_phase phase, const char *detail)
+{
+	int			level = plr_phase_depth++;
+
+	plr_stat_gc_forget();
+
+	if (level >= PLR_PHASE_MAX_DEPTH)
+		return level;
+
+	plr_phase_stack[level] = phase;
+	plr_phase_details[level] = detail;
+
+	PLR_PROBE_PHASE_START(phase, detail);
+	if (plr_plugin_ptr && *plr_plugin_ptr && (*plr_plugin_ptr)->phase_start)
+		((*plr_plugin_ptr)->phase_start) (phase, detail);
+
+	plr_phase_report();
+
+	return level;
+}
+
+/*
+ * Leave all phases entered since plr_phase_start() returned level
+ */
+void
+plr_phase_end(int level)
+{
+	while (plr_phase_depth > level)
+	{
+		plr_phase_depth--;
+		if (plr_phase_depth < PLR_PHASE_MAX_DEPTH)
+		{
+			plr_phase		phase = plr_phase_stack[plr_phase_depth];
+			const char	   *detail = plr_phase_details[plr_phase_depth];
+
+			PLR_PROBE_PHASE_END(phase, detail);
+			if (plr_plugin_ptr && *plr_plugin_ptr && (*plr_plugin_ptr)->phase_end)
+				((*plr_plugin_ptr)->phase_end) (phase, detail);
+		}
+	}
+
+	plr_phase_report();
+}
+
+/*
+ * Leave the innermost phase of the given kind and everything entered
+ * since, for when an error skipped the regular plr_phase_end()
+ */
+void
+plr_phase_unwind(plr_phase phase)
+{
+	int			level = Min(plr_phase_depth, PLR_PHASE_MAX_DEPTH);
+
+	while (--level >= 0)
+	{
+		if (plr_phase_stack[level] == phase)
+		{
+			plr_phase_end(level);
+			return;
+		}
+	}
+}
+
+/*
+ * Show the current phase as the wait event of the backend. Before
+ * PostgreSQL 17 all phases would show up as the generic Extension wait
+ * event, making a backend running R look like one waiting, so they are
+ * not shown at all.
+ */
+static void
+plr_phase_report(void)
+{
+#if PG_VERSION_NUM >= 170000
+	static uint32 wait_events[PLR_PHASE_COUNT];
+	plr_phase	phase = PLR_PHASE_NONE;
+
+	/* no wait events outside of regular backends */
+	if (!IsUnderPostmaster)
+		return;
+
+	if (plr_phase_depth > 0)
+		phase = plr_phase_stack[Min(plr_phase_depth, PLR_PHASE_MAX_DEPTH) - 1];
+
+	if (phase == PLR_PHASE_NONE)
+	{
+		pgstat_report_wait_end();
+		return;
+	}
+
+	if (wait_events[phase] == 0)
+		wait_events[phase] = WaitEventExtensionNew(plr_phase_wait_names[phase]);
+
+	pgstat_report_wait_start(wait_events[phase]);
+#endif
+}
+
+/*
+ * No phase outlives its transaction, whichever way it ends
+ */
+static void
+plr_phase_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			plr_phase_nsubxacts = 0;
+			if (plr_phase_depth > 0)
+				plr_phase_end(0);
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * An error caught by a subtransaction, such as a PL/pgSQL EXCEPTION block,
+ * skips the plr_phase_end() of the PL/R calls it unwinds, so leave the
+ * phases entered since the subtransaction started when it aborts
+ */
+static void
+plr_phase_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+						   SubTransactionId parentSubid, void *arg)
+{
+	switch (event)
+	{
+		case SUBXACT_EVENT_START_SUB:
+			if (plr_phase_nsubxacts >= plr_phase_maxsubxacts)
+			{
+				int			newmax = Max(16, plr_phase_maxsubxacts * 2);
+
+				if (plr_phase_subxacts == NULL)
+					plr_phase_subxacts = (plr_phase_subxact *)
+						MemoryContextAlloc(TopMemoryContext,
+										   newmax * sizeof(plr_phase_subxact));
+				else
+					plr_phase_subxacts = (plr_phase_subxact *)
+						repalloc(plr_phase_subxacts,
+								 newmax * sizeof(plr_phase_subxact));
+				plr_phase_maxsubxacts = newmax;
+			}
+			plr_phase_subxacts[plr_phase_nsubxacts].subid = mySubid;
+			plr_phase_subxacts[plr_phase_nsubxacts].depth = plr_phase_depth;
+			plr_phase_nsubxacts++;
+			break;
+		case SUBXACT_EVENT_COMMIT_SUB:
+		case SUBXACT_EVENT_ABORT_SUB:
+			while (plr_phase_nsubxacts > 0)
+			{
+				plr_phase_subxact *sub = &plr_phase_subxacts[--plr_phase_nsubxacts];
+
+				if (sub->subid != mySubid)
+					continue;
+				if (event == SUBXACT_EVENT_ABORT_SUB &&
+					plr_phase_depth > sub->depth)
+					plr_phase_end(sub->depth);
+				break;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Start R's sampling profiler for a call, if plr.profile_functions is on.
+ * Calls nested in a profiled call are sampled as part of it, since R has
+ * only one profiler.
+ */
+bool
+plr_profile_begin(void)
+{
+	SEXP		call;
+	SEXP		ans;
+	int			errorOccurred;
+
+	if (!plr_profile_functions || plr_profile_running)
+		return false;
+
+	if (plr_profile_file == NULL)
+	{
+		PROTECT(call = lang2(install("tempfile"), mkString("plr_prof")));
+		PROTECT(ans = R_tryEval(call, R_GlobalEnv, &errorOccurred));
+		if (!errorOccurred && isString(ans) && length(ans) == 1)
+			plr_profile_file = MemoryContextStrdup(TopMemoryContext,
+												   CHAR(STRING_ELT(ans, 0)));
+		UNPROTECT(2);
+
+		if (plr_profile_file == NULL)
+			return false;
+	}
+
+	/* Rprof(filename, append = FALSE, interval) */
+	PROTECT(call = lang4(install("Rprof"),
+						 mkString(plr_profile_file),
+						 ScalarLogical(FALSE),
+						 ScalarReal(plr_profile_interval / 1000.0)));
+	R_tryEval(call, R_GlobalEnv, &errorOccurred);
+	UNPROTECT(1);
+
+	if (errorOccurred)
+	{
+		ereport(WARNING,
+				(errmsg("could not start the R profiler")));
+		return false;
+	}
+
+	plr_profile_running = true;
+	return true;
+}
+
+/*
+ * Stop the profiler and add the samples of the call to the profile
+ */
+void
+plr_profile_end(plr_function *function)
+{
+	FILE		   *fp;
+	StringInfoData	line;
+
+	if (!plr_profile_running)
+		return;
+
+	plr_profile_stop();
+
+	fp = AllocateFile(plr_profile_file, "r");
+	if (fp == NULL)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not read R profiler output \"%s\": %m",
+						plr_profile_file)));
+		return;
+	}
+
+	initStringInfo(&line);
+	while (plr_profile_read_line(fp, &line))
+		plr_profile_add_sample(function, line.data);
+
+	FreeFile(fp);
+	pfree(line.data);
+}
+
+/*
+ * Stop the profiler of a call that failed, discarding its samples. Safe
+ * to use while handling an error.
+ */
+void
+plr_profile_abort(void)
+{
+	if (plr_profile_running)
+		plr_profile_stop();
+}
+
+static void
+plr_profile_stop(void)
+{
+	SEXP		call;
+	int			errorOccurred;
+
+	PROTECT(call = lang2(install("Rprof"), R_NilValue));
+	R_tryEval(call, R_GlobalEnv, &errorOccurred);
+	UNPROTECT(1);
+
+	plr_profile_running = false;
+}
+
+static bool
+plr_profile_read_line(FILE *fp, StringInfo buf)
+{
+	int			c;
+
+	buf->len = 0;
+	buf->data[0] = '\0';
+	while ((c = fgetc(fp)) != EOF && c != '\n')
+		appendStringInfoChar(buf, (char) c);
+
+	return (c != EOF || buf->len > 0);
+}
+
+/*
+ * Count one sample line of Rprof output, which lists the double quoted
+ * frames innermost first. Every enclosing stack gets a total sample, the
+ * complete stack a self sample.
+ */
+static void
+plr_profile_add_sample(plr_function *function, char *line)
+{
+	char			  **frames;
+	int					nframes = 0;
+	int					maxframes = 0;
+	char			   *p;
+	plr_profile_key		key;
+	plr_profile_entry  *entry = NULL;
+	bool				found;
+	int					len = 0;
+	int					i;
+
+	/* the sample.interval header and empty samples have no frames */
+	for (p = line; *p; p++)
+		if (*p == '"')
+			maxframes++;
+	maxframes /= 2;
+	if (maxframes == 0)
+		return;
+
+	frames = (char **) palloc(maxframes * sizeof(char *));
+	p = line;
+	while (nframes < maxframes && (p = strchr(p, '"')) != NULL)
+	{
+		char   *end = strchr(p + 1, '"');
+
+		if (end == NULL)
+			break;
+		*end = '\0';
+		frames[nframes++] = p + 1;
+		p = end + 1;
+	}
+
+	if (plr_profile_hash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(plr_profile_key);
+		ctl.entrysize = sizeof(plr_profile_entry);
+		ctl.hash = tag_hash;
+		plr_profile_hash = hash_create("PLR profile",
+									   FUNCS_PER_USER,
+									   &ctl,
+									   HASH_ELEM | HASH_FUNCTION);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.funcid = function->fn_hashkey->funcOid;
+
+	for (i = nframes - 1; i >= 0; i--)
+	{
+		const char *name = frames[i];
+		int			namelen;
+
+		/* the function body itself is called without a name */
+		if (i == nframes - 1 && strcmp(name, "<Anonymous>") == 0)
+			name = function->proname;
+		namelen = strlen(name);
+
+		/* overly deep stacks are cut off, charging the last frame kept */
+		if (len + 4 + namelen >= PLR_PROFILE_STACK_LEN)
+			break;
+		if (len > 0)
+		{
+			memcpy(key.stack + len, " -> ", 4);
+			len += 4;
+		}
+		memcpy(key.stack + len, name, namelen);
+		len += namelen;
+
+		entry = (plr_profile_entry *) hash_search(plr_profile_hash,
+												  (void *) &key,
+												  HASH_ENTER,
+												  &found);
+		if (!found)
+		{
+			entry->self_samples = 0;
+			entry->total_samples = 0;
+		}
+		entry->total_samples++;
+	}
+
+	if (entry != NULL)
+		entry->self_samples++;
+
+	pfree(frames);
+}
+
+/*
+ * Copy out the profiler samples collected by this backend. Returns the
+ * number of entries, in a palloc'd array.
+ */
+int
+plr_profile_collect(plr_profile_entry **entries)
+{
+	HASH_SEQ_STATUS		hash_seq;
+	plr_profile_entry  *entry;
+	int					n = 0;
+	long				maxn;
+
+	*entries = NULL;
+	if (plr_profile_hash == NULL)
+		return 0;
+
+	maxn = hash_get_num_entries(plr_profile_hash);
+	if (maxn > 0)
+		*entries = (plr_profile_entry *) palloc(maxn * sizeof(plr_profile_entry));
+
+	hash_seq_init(&hash_seq, plr_profile_hash);
+	while ((entry = (plr_profile_entry *) hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (n < maxn)
+			(*entries)[n++] = *entry;
+	}
+
+	return n;
+}
+
+/*
+ * Forget the profiler samples collected by this backend
+ */
+void
+plr_profile_reset_entries(void)
+{
+	if (plr_profile_hash != NULL)
+	{
+		hash_destroy(plr_profile_hash);
+		plr_profile_hash = NULL;
+	}
+}
+
+/*
+ * Named R objects shared between backends, stored serialized. With PL/R
+ * in shared_preload_libraries on PostgreSQL 10 or later, the directory is
+ * a hash table in shared memory and the objects live in a dynamic shared
+ * memory area that the first backend to store an object creates. Otherwise
+ * each backend has a store of its own.
+ *
+ * The functions called from R run in a subtransaction, so that an error
+ * raised while holding the lock releases it even when R code catches the
+ * error and goes on. Readers only take the lock in shared mode; the read
+ * counters and the clock are kept under a spinlock of their own.
+ */
+#define PLR_SHARED_MAX_OBJECTS	256
+
+typedef struct plr_shared_entry
+{
+	char			name[NAMEDATALEN];	/* hash key -- must be first */
+	uint64			version;
+	Size			size;
+	int64			reads;
+	uint64			last_used;
+#if PG_VERSION_NUM >= 100000
+	dsa_pointer		dp;			/* data in the shared area */
+#endif
+	char		   *local;		/* data of a backend local store */
+}	plr_shared_entry;
+
+typedef struct plr_shared_state
+{
+#if PG_VERSION_NUM >= 100000
+	LWLock		   *lock;		/* protects everything below */
+	int				tranche_id;
+	bool			area_created;
+	dsa_handle		area;
+#endif
+	uint64			next_version;
+	Size			bytes;		/* size of all objects */
+	slock_t			mutex;		/* protects clock and the read counters */
+	uint64			clock;
+}	plr_shared_state;
+
+int plr_shared_objects_size = 65536;
+static plr_shared_state *plr_shared = NULL;
+static HTAB *plr_shared_hash = NULL;
+static bool plr_shared_in_shmem = false;
+#if PG_VERSION_NUM >= 100000
+static dsa_area *plr_shared_area = NULL;
+static shmem_startup_hook_type prev_shared_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shared_shmem_request_hook = NULL;
+#endif
+
+static void plr_shared_shmem_reserve(void);
+static void plr_shared_shmem_startup(void);
+#endif
+
+/*
+ * Reserve shared memory for the object store directory, like
+ * plr_stat_shmem_request()
+ */
+void
+plr_shared_shmem_request(void)
+{
+#if PG_VERSION_NUM >= 100000
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shared_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = plr_shared_shmem_reserve;
+#else
+	plr_shared_shmem_reserve();
+#endif
+
+	prev_shared_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = plr_shared_shmem_startup;
+#endif
+}
+
+#if PG_VERSION_NUM >= 100000
+static void
+plr_shared_shmem_reserve(void)
+{
+#if PG_VERSION_NUM >= 150000
+	if (prev_shared_shmem_request_hook)
+		prev_shared_shmem_request_hook();
+#endif
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(plr_shared_state)) +
+						   hash_estimate_size(PLR_SHARED_MAX_OBJECTS,
+											  sizeof(plr_shared_entry)));
+	RequestNamedLWLockTranche("plr_shared_objects", 1);
+}
+
+static void
+plr_shared_shmem_startup(void)
+{
+	HASHCTL		ctl;
+	bool		found;
+
+	if (prev_shared_shmem_startup_hook)
+		prev_shared_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	plr_shared = ShmemInitStruct("PLR shared objects",
+								 sizeof(plr_shared_state),
+								 &found);
+	if (!found)
+	{
+		memset(plr_shared, 0, sizeof(plr_shared_state));
+		plr_shared->lock = &(GetNamedLWLockTranche("plr_shared_objects"))->lock;
+		plr_shared->tranche_id = LWLockNewTrancheId();
+		SpinLockInit(&plr_shared->mutex);
+	}
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = NAMEDATALEN;
+	ctl.entrysize = sizeof(plr_shared_entry);
+	ctl.hash = tag_hash;
+	plr_shared_hash = ShmemInitHash("PLR shared objects hash",
+									PLR_SHARED_MAX_OBJECTS,
+									PLR_SHARED_MAX_OBJECTS,
+									&ctl,
+									HASH_ELEM | HASH_FUNCTION);
+	plr_shared_in_shmem = true;
+
+	LWLockRelease(AddinShmemInitLock);
+}
+#endif
+
+/*
+ * Set up the store for this backend and take its lock
+ */
+static void
+plr_shared_lock(bool exclusive)
+{
+	if (plr_shared == NULL)
+	{
+		HASHCTL		ctl;
+
+		plr_shared = (plr_shared_state *) MemoryContextAllocZero(TopMemoryContext,
+																 sizeof(plr_shared_state));
+		SpinLockInit(&plr_shared->mutex);
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = NAMEDATALEN;
+		ctl.entrysize = sizeof(plr_shared_entry);
+		ctl.hash = tag_hash;
+		plr_shared_hash = hash_create("PLR local shared objects",
+									  32,
+									  &ctl,
+									  HASH_ELEM | HASH_FUNCTION);
+	}
+
+#if PG_VERSION_NUM >= 100000
+	if (!plr_shared_in_shmem)
+		return;
+
+	if (plr_shared_area == NULL)
+	{
+		MemoryContext	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+		dsa_area	   *area;
+
+		LWLockRegisterTranche(plr_shared->tranche_id, "plr_shared_objects_area");
+
+		LWLockAcquire(plr_shared->lock, LW_EXCLUSIVE);
+		PG_TRY();
+		{
+			if (!plr_shared->area_created)
+			{
+				area = dsa_create(plr_shared->tranche_id);
+				dsa_pin(area);
+				plr_shared->area = dsa_get_handle(area);
+				plr_shared->area_created = true;
+			}
+			else
+				area = dsa_attach(plr_shared->area);
+		}
+		PG_CATCH();
+		{
+			LWLockRelease(plr_shared->lock);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		LWLockRelease(plr_shared->lock);
+
+		dsa_pin_mapping(area);
+		plr_shared_area = area;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	LWLockAcquire(plr_shared->lock, exclusive ? LW_EXCLUSIVE : LW_SHARED);
+#endif
+}
+
+static void
+plr_shared_unlock(void)
+{
+#if PG_VERSION_NUM >= 100000
+	if (plr_shared_in_shmem)
+		LWLockRelease(plr_shared->lock);
+#endif
+}
+
+static char *
+plr_shared_data(plr_shared_entry *entry)
+{
+#if PG_VERSION_NUM >= 100000
+	if (plr_shared_in_shmem)
+		return (char *) dsa_get_address(plr_shared_area, entry->dp);
+#endif
+	return entry->local;
+}
+
+/*
+ * Allocate size bytes for an object, returning NULL when out of memory
+ */
+static char *
+plr_shared_alloc(plr_shared_entry *entry, Size size)
+{
+#if PG_VERSION_NUM >= 100000
+	if (plr_shared_in_shmem)
+	{
+		entry->dp = dsa_allocate_extended(plr_shared_area, size,
+										  DSA_ALLOC_HUGE | DSA_ALLOC_NO_OOM);
+		if (!DsaPointerIsValid(entry->dp))
+			return NULL;
+		return (char *) dsa_get_address(plr_shared_area, entry->dp);
+	}
+#endif
+#if PG_VERSION_NUM >= 90500
+	entry->local = MemoryContextAllocExtended(TopMemoryContext, size,
+											  MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+#else
+	entry->local = MemoryContextAlloc(TopMemoryContext, size);
+#endif
+	return entry->local;
+}
+
+static void
+plr_shared_free(plr_shared_entry *entry)
+{
+#if PG_VERSION_NUM >= 100000
+	if (plr_shared_in_shmem)
+	{
+		dsa_free(plr_shared_area, entry->dp);
+		return;
+	}
+#endif
+	pfree(entry->local);
+}
+
+static void
+plr_shared_drop(plr_shared_entry *entry)
+{
+	plr_shared_free(entry);
+	plr_shared->bytes -= entry->size;
+	hash_search(plr_shared_hash, (void *) entry->name, HASH_REMOVE, NULL);
+}
+
+/*
+ * Drop the least recently used objects other than keep until those left
+ * take no more than target bytes and leave room for a new entry.
+ */
+static void
+plr_shared_evict(Size target, plr_shared_entry *keep)
+{
+	for (;;)
+	{
+		HASH_SEQ_STATUS		status;
+		plr_shared_entry   *entry;
+		plr_shared_entry   *victim = NULL;
+		long				nentries = hash_get_num_entries(plr_shared_hash);
+
+		if (plr_shared->bytes <= target &&
+			(keep != NULL || nentries < PLR_SHARED_MAX_OBJECTS))
+			break;
+
+		hash_seq_init(&status, plr_shared_hash);
+		while ((entry = (plr_shared_entry *) hash_seq_search(&status)) != NULL)
+		{
+			if (entry != keep &&
+				(victim == NULL || entry->last_used < victim->last_used))
+				victim = entry;
+		}
+		if (victim == NULL)
+			break;
+
+		elog(DEBUG1, "PL/R evicts shared object \"%s\"", victim->name);
+		plr_shared_drop(victim);
+	}
+}
+
+static void
+plr_shared_key(const char *name, char *key)
+{
+	if (strlen(name) >= NAMEDATALEN)
+		ereport(ERROR,
+				(errcode(ERRCODE_NAME_TOO_LONG),
+				 errmsg("shared object name \"%s\" is too long", name),
+				 errdetail("Names are limited to %d bytes.", NAMEDATALEN - 1)));
+	memset(key, 0, NAMEDATALEN);
+	strcpy(key, name);
+}
+
+/*
+ * Store data as the new version of the named object, evicting the least
+ * recently used objects to stay within plr.shared_objects_size, and
+ * return the version.
+ */
+uint64
+plr_shared_store(const char *name, const char *data, Size size)
+{
+	char				key[NAMEDATALEN];
+	Size				budget = (Size) plr_shared_objects_size * 1024;
+	plr_shared_entry   *entry;
+	plr_shared_entry	newent;
+	char			   *dst;
+	uint64				version;
+
+	plr_shared_key(name, key);
+	if (size > budget)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("shared object \"%s\" of %lu bytes exceeds plr.shared_objects_size",
+						name, (unsigned long) size)));
+
+	plr_shared_lock(true);
+
+	entry = (plr_shared_entry *) hash_search(plr_shared_hash, (void *) key,
+											 HASH_FIND, NULL);
+	plr_shared_evict(budget - size + (entry != NULL ? entry->size : 0), entry);
+
+	/* copy the data first, so that a failure keeps the old version */
+	memset(&newent, 0, sizeof(newent));
+	dst = plr_shared_alloc(&newent, size);
+	if (dst == NULL)
+	{
+		plr_shared_unlock();
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of shared memory for PL/R shared objects"),
+				 errdetail("Failed on request of size %lu.", (unsigned long) size)));
+	}
+	memcpy(dst, data, size);
+
+	if (entry == NULL)
+	{
+		/* dynahash only returns NULL for shared tables */
+		entry = (plr_shared_entry *) hash_search(plr_shared_hash, (void *) key,
+												 plr_shared_in_shmem ?
+												 HASH_ENTER_NULL : HASH_ENTER,
+												 NULL);
+		if (entry == NULL)
+		{
+			plr_shared_free(&newent);
+			plr_shared_unlock();
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of shared memory for PL/R shared objects")));
+		}
+		entry->reads = 0;
+	}
+	else
+	{
+		plr_shared_free(entry);
+		plr_shared->bytes -= entry->size;
+	}
+
+#if PG_VERSION_NUM >= 100000
+	entry->dp = newent.dp;
+#endif
+	entry->local = newent.local;
+	version = ++plr_shared->next_version;
+	entry->version = version;
+	entry->size = size;
+	entry->last_used = ++plr_shared->clock;
+	plr_shared->bytes += size;
+
+	plr_shared_unlock();
+
+	return version;
+}
+
+/*
+ * Look up the named object. When it exists and is not the version the
+ * caller already has, return a palloc'd copy of its data in *data.
+ */
+bool
+plr_shared_fetch(const char *name, uint64 have_version, uint64 *version,
+				 char **data, Size *size)
+{
+	char				key[NAMEDATALEN];
+	plr_shared_entry   *entry;
+	bool				found = false;
+
+	plr_shared_key(name, key);
+	*data = NULL;
+	*size = 0;
+	*version = 0;
+
+	/*
+	 * Other readers may copy the object at the same time; only the read
+	 * counter needs the spinlock.
+	 */
+	plr_shared_lock(false);
+
+	entry = (plr_shared_entry *) hash_search(plr_shared_hash, (void *) key,
+											 HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		found = true;
+		SpinLockAcquire(&plr_shared->mutex);
+		entry->reads++;
+		entry->last_used = ++plr_shared->clock;
+		SpinLockRelease(&plr_shared->mutex);
+		*version = entry->version;
+		*size = entry->size;
+		if (entry->version != have_version)
+		{
+#if PG_VERSION_NUM >= 90500
+			*data = MemoryContextAllocExtended(CurrentMemoryContext, entry->size,
+											   MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+#else
+			*data = palloc(entry->size);
+#endif
+			if (*data != NULL)
+				memcpy(*data, plr_shared_data(entry), entry->size);
+		}
+	}
+
+	plr_shared_unlock();
+
+	if (found && *version != have_version && *data == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed on request of size %lu.", (unsigned long) *size)));
+
+	return found;
+}
+
+/*
+ * Remove the named object, returning whether there was one
+ */
+bool
+plr_shared_remove(const char *name)
+{
+	char				key[NAMEDATALEN];
+	plr_shared_entry   *entry;
+
+	plr_shared_key(name, key);
+	plr_shared_lock(true);
+
+	entry = (plr_shared_entry *) hash_search(plr_shared_hash, (void *) key,
+											 HASH_FIND, NULL);
+	if (entry != NULL)
+		plr_shared_drop(entry);
+
+	plr_shared_unlock();
+
+	return entry != NULL;
+}
+
+/*
+ * Copy the directory of the store into a palloc'd array, returning the
+ * number of objects
+ */
+int
+plr_shared_collect(plr_shared_info **objects)
+{
+	HASH_SEQ_STATUS		status;
+	plr_shared_entry   *entry;
+	int					n = 0;
+	long				maxn;
+
+	plr_shared_lock(false);
+
+	maxn = hash_get_num_entries(plr_shared_hash);
+	*objects = (plr_shared_info *) palloc(Max(maxn, 1) * sizeof(plr_shared_info));
+
+	hash_seq_init(&status, plr_shared_hash);
+	while ((entry = (plr_shared_entry *) hash_seq_search(&status)) != NULL)
+	{
+		if (n < maxn)
+		{
+			plr_shared_info *info = &(*objects)[n++];
+
+			strlcpy(info->name, entry->name, NAMEDATALEN);
+			info->version = entry->version;
+			info->size = entry->size;
+			SpinLockAcquire(&plr_shared->mutex);
+			info->reads = entry->reads;
+			SpinLockRelease(&plr_shared->mutex);
+		}
+	}
+
+	plr_shared_unlock();
+
+	return n;
+}
@@ -34,9 +34,68 @@
  */
 #include "plr.h"
 
+/*
+ * Output information for array element types, cached for the life of the
+ * backend so that converting array columns of a query result does not
+ * repeat the catalog lookups for every query or cursor batch.
+ */
+typedef struct plr_elem_io_hashent
+{
+	Oid			typelem;		/* hash key -- must be first */
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	FmgrInfo	outputproc;
+} plr_elem_io_hashent;
+
+static HTAB *plr_elem_io_HashTable = NULL;
+
+/*
+ * How the values of an R vector convert to a pg type from their binary
+ * form, bypassing coerce_to_char() and the type's input function
+ */
+typedef enum r_pg_conv_kind
+{
+	R_PG_CONV_NONE = 0,			/* through the character form */
+	R_PG_CONV_DATE,				/* Date to date */
+	R_PG_CONV_TIMESTAMP,		/* POSIXct to timestamp or timestamptz */
+	R_PG_CONV_INTERVAL,			/* difftime to interval */
+	R_PG_CONV_NUMERIC,			/* numeric or integer to numeric */
+	R_PG_CONV_INT64				/* integer64 to int8 and its casts */
+} r_pg_conv_kind;
+
+typedef struct r_pg_conv
+{
+	r_pg_conv_kind kind;
+	Oid			typid;
+	int32		typmod;
+	double		scale;			/* seconds per unit of a difftime */
+	Datum		zone;			/* text time zone of a POSIXct, or 0 */
+} r_pg_conv;
+
+/*
+ * bit64's integer64 vectors are R doubles holding the bits of an int64,
+ * the smallest int64 standing for NA
+ */
+#define PLR_INT64_DATA(obj)		((int64 *) NUMERIC_DATA(obj))
+#define PLR_NA_INTEGER64		(-INT64CONST(0x7FFFFFFFFFFFFFFF) - 1)
+#define PLR_IS_INTEGER64(rval_) \
+	(TYPEOF(rval_) == REALSXP && inherits(rval_, "integer64"))
+
 static void pg_get_one_r(char *value, Oid arg_out_fn_oid, SEXP *obj,
 																int elnum);
 static SEXP get_r_vector(Oid typtype, int numels);
+static bool pg_native_r_type(Oid typtype);
+static void set_r_native_class(SEXP obj, Oid typtype);
+static void pg_datum_get_one_r(Datum value, bool isnull, Oid typtype, SEXP obj,
+							   int elnum);
+static SEXP pg_bytea_get_r(Datum dvalue);
+static SEXPTYPE get_r_vector_type(Oid typtype);
+static void pg_tuple_fill_r_column(int ntuples, HeapTuple *tuples,
+								   TupleDesc tupdesc, int j, SEXP fldvec);
+static SEXP pg_array_column_get_r_matrix(int ntuples, HeapTuple *tuples,
+										 TupleDesc tupdesc, int j);
+static plr_elem_io_hashent *get_array_elem_io(Oid typelem);
 static Datum get_trigger_tuple(SEXP rval, plr_function *function,
 									FunctionCallInfo fcinfo, bool *isnull);
 static Datum get_tuplestore(SEXP rval, plr_function *function,
@@ -49,11 +108,6 @@ static Datum get_md_array_datum(SEXP rval, int ndims, plr_function *function, in
 																bool *isnull);
 static Datum get_generic_array_datum(SEXP rval, plr_function *function, int col,
 																bool *isnull);
-static Tuplestorestate *get_frame_tuplestore(SEXP rval,
-											 plr_function *function,
-											 AttInMetadata *attinmeta,
-											 MemoryContext per_query_ctx,
-											 bool retset);
 static Tuplestorestate *get_matrix_tuplestore(SEXP rval,
 											 plr_function *function,
 											 AttInMetadata *attinmeta,
@@ -65,6 +119,28 @@ static Tuplestorestate *get_generic_tuplestore(SEXP rval,
 											 MemoryContext per_query_ctx,
 											 bool retset);
 static SEXP coerce_to_char(SEXP rval);
+static bool get_r_pg_conv(SEXP rval, Oid typid, int32 typmod, r_pg_conv *conv);
+static void r_pg_conv_value(r_pg_conv *conv, SEXP rval, int i, Datum *dvalue,
+							bool *isnull);
+static HeapTuple build_tuple_from_r_values(AttInMetadata *attinmeta, char **values,
+										   Datum *dvalues, bool *nulls,
+										   r_pg_conv *convs);
+static bool native_r_pg_datum(SEXP rval, Oid typid, Datum *dvalue,
+							  bool *isnull);
+static bool native_int2_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_int4_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_oid_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_int8_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_float4_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static double float4_get_r_value(float4 value);
+static bool native_float8_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_bool_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_text_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_date_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_timestamp_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_timestamptz_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_interval_datum(SEXP rval, Datum *dvalue, bool *isnull);
+static bool native_numeric_datum(SEXP rval, Datum *dvalue, bool *isnull);
 
 extern char *last_R_error_msg;
 
@@ -77,7 +153,13 @@ pg_scalar_get_r(Datum dvalue, Oid arg_typid, FmgrInfo arg_out_func)
 	SEXP		result;
 
 	/* add our value to it */
-	if (arg_typid != BYTEAOID)
+	if (pg_native_r_type(arg_typid))
+	{
+		PROTECT(result = get_r_vector(arg_typid, 1));
+		pg_datum_get_one_r(dvalue, false, arg_typid, result, 0);
+		UNPROTECT(1);
+	}
+	else if (arg_typid != BYTEAOID)
 	{
 		char	   *value;
 
@@ -92,54 +174,643 @@ pg_scalar_get_r(Datum dvalue, Oid arg_typid, FmgrInfo arg_out_func)
 		UNPROTECT(1);
 	}
 	else
+		result = pg_bytea_get_r(dvalue);
+
+	return result;
+}
+
+
+/*
+ * R serialization straight to and from memory, without going through an R
+ * raw vector. The output buffer is the bytea result itself, its header
+ * included.
+ */
+typedef struct plr_serial_buf
+{
+	char	   *data;
+	Size		len;			/* bytes written, or the size of the input */
+	Size		maxlen;			/* allocated size of an output buffer */
+	Size		pos;			/* read position in an input buffer */
+} plr_serial_buf;
+
+typedef struct plr_serial_call
+{
+	SEXP		obj;			/* object to write, or the object read */
+	plr_serial_buf *buf;
+	R_pstream_format_t type;
+	int			version;
+} plr_serial_call;
+
+static const char *const plr_compress_names[] = {"none", "pglz", "lz4", "zstd"};
+
+/*
+ * Make room for needed more bytes. This runs inside R, so a Postgres error
+ * must not longjmp past R's frames; turn it into an R error instead, which
+ * R_ToplevelExec catches.
+ */
+static void
+plr_serial_reserve(plr_serial_buf *buf, Size needed)
+{
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	volatile bool	failed = false;
+	Size			newlen;
+
+	if (buf->len + needed <= buf->maxlen)
+		return;
+
+	newlen = buf->maxlen;
+	while (newlen < buf->len + needed)
+		newlen *= 2;
+	if (newlen > MaxAllocSize)
+		newlen = MaxAllocSize;
+	if (buf->len + needed > newlen)
+		error("%s", "serialized object exceeds the maximum size of a bytea");
+
+	PG_TRY();
 	{
-		SEXP 	s, t, obj;
-		int		status;
-		Datum	dt_dvalue =  PointerGetDatum(PG_DETOAST_DATUM(dvalue));
-		int		bsize = VARSIZE((bytea *) dt_dvalue);
+		buf->data = repalloc(buf->data, newlen);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		FlushErrorState();
+		failed = true;
+	}
+	PG_END_TRY();
 
-		PROTECT(obj = get_r_vector(arg_typid, bsize));
-		memcpy((char *) RAW(obj),
-			   VARDATA((bytea *) dt_dvalue),
-			   bsize);
+	if (failed)
+		error("%s", "out of memory while serializing object");
+	buf->maxlen = newlen;
+}
 
-		/*
-		 * Need to construct a call to
-		 * unserialize(rval)
-		 */
-		PROTECT(t = s = allocList(2));
-		SET_TYPEOF(s, LANGSXP);
-		SETCAR(t, install("unserialize"));
-		t = CDR(t);
-		SETCAR(t, obj);
-
-		PROTECT(result = R_tryEval(s, R_GlobalEnv, &status));
-		if(status != 0)
-		{
-			if (last_R_error_msg)
-				ereport(ERROR,
-						(errcode(ERRCODE_DATA_EXCEPTION),
-						 errmsg("R interpreter expression evaluation error"),
-						 errdetail("%s", last_R_error_msg)));
-			else
+static void
+plr_serial_out_char(R_outpstream_t stream, int c)
+{
+	plr_serial_buf *buf = (plr_serial_buf *) stream->data;
+
+	plr_serial_reserve(buf, 1);
+	buf->data[buf->len++] = (char) c;
+}
+
+static void
+plr_serial_out_bytes(R_outpstream_t stream, void *data, int length)
+{
+	plr_serial_buf *buf = (plr_serial_buf *) stream->data;
+
+	plr_serial_reserve(buf, length);
+	memcpy(buf->data + buf->len, data, length);
+	buf->len += length;
+}
+
+static int
+plr_serial_in_char(R_inpstream_t stream)
+{
+	plr_serial_buf *buf = (plr_serial_buf *) stream->data;
+
+	if (buf->pos >= buf->len)
+		error("%s", "serialized object is truncated");
+	return (unsigned char) buf->data[buf->pos++];
+}
+
+static void
+plr_serial_in_bytes(R_inpstream_t stream, void *data, int length)
+{
+	plr_serial_buf *buf = (plr_serial_buf *) stream->data;
+
+	if (buf->pos + length > buf->len)
+		error("%s", "serialized object is truncated");
+	memcpy(data, buf->data + buf->pos, length);
+	buf->pos += length;
+}
+
+static void
+plr_serialize_body(void *arg)
+{
+	plr_serial_call *call = (plr_serial_call *) arg;
+	struct R_outpstream_st out;
+
+	R_InitOutPStream(&out, (R_pstream_data_t) call->buf, call->type,
+					 call->version, plr_serial_out_char, plr_serial_out_bytes,
+					 NULL, R_NilValue);
+	R_Serialize(call->obj, &out);
+}
+
+static void
+plr_unserialize_body(void *arg)
+{
+	plr_serial_call *call = (plr_serial_call *) arg;
+	struct R_inpstream_st in;
+
+	/* R reads the format from the stream */
+	R_InitInPStream(&in, (R_pstream_data_t) call->buf, R_pstream_any_format,
+					plr_serial_in_char, plr_serial_in_bytes,
+					NULL, R_NilValue);
+	call->obj = R_Unserialize(&in);
+}
+
+static void
+plr_serial_error(const char *fn)
+{
+	if (last_R_error_msg)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("R interpreter expression evaluation error"),
+				 errdetail("%s", last_R_error_msg)));
+	else
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("R interpreter expression evaluation error"),
+				 errdetail("R expression evaluation error caught in \"%s\".", fn)));
+}
+
+/*
+ * Compress a serialization with the method of plr.serialize_compression.
+ * Returns NULL when that does not make it smaller.
+ */
+static bytea *
+plr_serial_compress(const char *src, Size len)
+{
+	int			method = plr_serialize_compression;
+	Size		bound;
+	bytea	   *result;
+	char	   *hdr;
+	char	   *dst;
+	int			clen = -1;
+
+	switch (method)
+	{
+#if PG_VERSION_NUM >= 90500
+		case PLR_COMPRESS_PGLZ:
+			bound = PGLZ_MAX_OUTPUT(len);
+			break;
+#endif
+#ifdef USE_LZ4
+		case PLR_COMPRESS_LZ4:
+			bound = LZ4_compressBound(len);
+			break;
+#endif
+#ifdef USE_ZSTD
+		case PLR_COMPRESS_ZSTD:
+			bound = ZSTD_compressBound(len);
+			break;
+#endif
+		default:
+			return NULL;
+	}
+
+	result = (bytea *) palloc(VARHDRSZ + PLR_SERIAL_HDRSZ + bound);
+	hdr = VARDATA(result);
+	dst = hdr + PLR_SERIAL_HDRSZ;
+
+	switch (method)
+	{
+#if PG_VERSION_NUM >= 90500
+		case PLR_COMPRESS_PGLZ:
+			clen = pglz_compress(src, len, dst, PGLZ_strategy_always);
+			break;
+#endif
+#ifdef USE_LZ4
+		case PLR_COMPRESS_LZ4:
+			clen = LZ4_compress_default(src, dst, len, bound);
+			if (clen <= 0)
+				clen = -1;
+			break;
+#endif
+#ifdef USE_ZSTD
+		case PLR_COMPRESS_ZSTD:
+			{
+				size_t	zlen = ZSTD_compress(dst, bound, src, len,
+											 ZSTD_CLEVEL_DEFAULT);
+
+				clen = ZSTD_isError(zlen) ? -1 : (int) zlen;
+			}
+			break;
+#endif
+		default:
+			break;
+	}
+
+	if (clen < 0 || PLR_SERIAL_HDRSZ + clen >= len)
+	{
+		pfree(result);
+		return NULL;
+	}
+
+	memcpy(hdr, PLR_SERIAL_MAGIC, 3);
+	hdr[3] = (char) method;
+	hdr[4] = (char) (len & 0xff);
+	hdr[5] = (char) ((len >> 8) & 0xff);
+	hdr[6] = (char) ((len >> 16) & 0xff);
+	hdr[7] = (char) ((len >> 24) & 0xff);
+	SET_VARSIZE(result, VARHDRSZ + PLR_SERIAL_HDRSZ + clen);
+
+	return result;
+}
+
+/*
+ * Decompress a serialization that starts with PLR_SERIAL_MAGIC into a
+ * palloc'd buffer of *rawlen bytes.
+ */
+static char *
+plr_serial_decompress(const char *src, Size len, Size *rawlen)
+{
+	const unsigned char *hdr = (const unsigned char *) src;
+	int			method = hdr[3];
+	Size		rawsize;
+	char	   *dst;
+	int			dlen = -1;
+
+	rawsize = (Size) hdr[4] | ((Size) hdr[5] << 8) |
+		((Size) hdr[6] << 16) | ((Size) hdr[7] << 24);
+	if (rawsize == 0 || rawsize > MaxAllocSize)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("invalid compressed R object")));
+
+	src += PLR_SERIAL_HDRSZ;
+	len -= PLR_SERIAL_HDRSZ;
+	dst = palloc(rawsize);
+
+	switch (method)
+	{
+#if PG_VERSION_NUM >= 120000
+		case PLR_COMPRESS_PGLZ:
+			dlen = pglz_decompress(src, len, dst, rawsize, true);
+			break;
+#elif PG_VERSION_NUM >= 90500
+		case PLR_COMPRESS_PGLZ:
+			dlen = pglz_decompress(src, len, dst, rawsize);
+			break;
+#endif
+#ifdef USE_LZ4
+		case PLR_COMPRESS_LZ4:
+			dlen = LZ4_decompress_safe(src, dst, len, rawsize);
+			break;
+#endif
+#ifdef USE_ZSTD
+		case PLR_COMPRESS_ZSTD:
+			{
+				size_t	zlen = ZSTD_decompress(dst, rawsize, src, len);
+
+				dlen = ZSTD_isError(zlen) ? -1 : (int) zlen;
+			}
+			break;
+#endif
+		default:
+			if (method > PLR_COMPRESS_NONE && method <= PLR_COMPRESS_ZSTD)
 				ereport(ERROR,
-						(errcode(ERRCODE_DATA_EXCEPTION),
-						 errmsg("R interpreter expression evaluation error"),
-						 errdetail("R expression evaluation error caught in \"unserialize\".")));
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("R object is compressed with %s, which this server does not support",
+								plr_compress_names[method])));
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("invalid compressed R object")));
+	}
+
+	if (dlen < 0 || (Size) dlen != rawsize)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("compressed R object is corrupt")));
+
+	*rawlen = rawsize;
+	return dst;
+}
+
+/*
+ * Serialize an R object into a new bytea, in the format and version set by
+ * plr.serialize_format and plr.serialize_version, compressed when
+ * plr.serialize_compression says so.
+ */
+bytea *
+plr_serialize(SEXP obj)
+{
+	plr_serial_buf	buf;
+	plr_serial_call	call;
+	bytea		   *result;
+	bytea		   *compressed;
+
+	buf.maxlen = 1024;
+	buf.data = palloc(buf.maxlen);
+	buf.len = VARHDRSZ;
+	buf.pos = 0;
+
+	call.obj = obj;
+	call.buf = &buf;
+	call.type = plr_serialize_format == PLR_SERIALIZE_BINARY ?
+		R_pstream_binary_format : R_pstream_xdr_format;
+	call.version = plr_serialize_version;
+
+	if (!R_ToplevelExec(plr_serialize_body, &call))
+		plr_serial_error("serialize");
+
+	result = (bytea *) buf.data;
+	SET_VARSIZE(result, buf.len);
+
+	if (plr_serialize_compression != PLR_COMPRESS_NONE &&
+		buf.len - VARHDRSZ >= PLR_COMPRESS_MIN_SIZE)
+	{
+		compressed = plr_serial_compress(VARDATA(result), buf.len - VARHDRSZ);
+		if (compressed != NULL)
+		{
+			pfree(result);
+			result = compressed;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Unserialize an R object from len bytes of data, as written by
+ * plr_serialize() or R's serialize(). The result is not protected.
+ */
+SEXP
+plr_unserialize(const char *data, Size len)
+{
+	plr_serial_buf	buf;
+	plr_serial_call	call;
+	char		   *raw = NULL;
+
+	if (len >= PLR_SERIAL_HDRSZ &&
+		memcmp(data, PLR_SERIAL_MAGIC, 3) == 0)
+		data = raw = plr_serial_decompress(data, len, &len);
+
+	buf.data = (char *) data;
+	buf.len = len;
+	buf.maxlen = len;
+	buf.pos = 0;
+
+	call.obj = R_NilValue;
+	call.buf = &buf;
+
+	if (!R_ToplevelExec(plr_unserialize_body, &call))
+		plr_serial_error("unserialize");
+
+	if (raw != NULL)
+		pfree(raw);
+
+	return call.obj;
+}
+
+/*
+ * Cache of R objects unserialized from bytea arguments, see
+ * plr.object_cache_size. Values stored out of line are known by their
+ * TOAST pointer, so a hit needs no detoasting within a transaction; as
+ * the OID of a TOAST value may be reused once the value is gone, the
+ * first hit of a transaction is confirmed against a hash of the contents.
+ * Other values are known by that hash, confirmed against a copy of the
+ * contents kept with the entry. Both keys include the serialized size.
+ */
+typedef struct plr_object_cache_key
+{
+	Oid			toastrelid;		/* InvalidOid when keyed by contents */
+	Oid			valueid;
+	uint64		hash;
+	Size		size;
+} plr_object_cache_key;
+
+typedef struct plr_object_cache_ent
+{
+	plr_object_cache_key key;	/* hash key -- must be first */
+	SEXP		obj;			/* preserved from R's garbage collector */
+	char	   *data;			/* contents when keyed by them, else NULL */
+	uint64		hash;			/* of the contents */
+	uint32		checked_xact;	/* transaction a TOAST key was last confirmed */
+	Size		bytes;			/* counted against plr.object_cache_size */
+	uint64		last_used;
+} plr_object_cache_ent;
+
+static HTAB *plr_object_HashTable = NULL;
+static uint64 plr_object_cache_clock = 0;
+static uint32 plr_object_cache_xact = 1;
+static plr_object_cache_stats plr_object_stats;
+
+/*
+ * Hash of the contents of a cached value
+ */
+static uint64
+plr_object_cache_hash(const char *data, Size size)
+{
+#if PG_VERSION_NUM >= 110000
+	return DatumGetUInt64(hash_any_extended((const unsigned char *) data,
+											size, 0));
+#else
+	return DatumGetUInt32(hash_any((const unsigned char *) data, size));
+#endif
+}
+
+/*
+ * Counts transactions, after which TOAST keyed entries need confirming
+ */
+static void
+plr_object_cache_xact_callback(XactEvent event, void *arg)
+{
+	if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT ||
+		event == XACT_EVENT_PREPARE)
+		plr_object_cache_xact++;
+}
+
+/*
+ * Drop one entry from the cache
+ */
+static void
+plr_object_cache_remove(plr_object_cache_ent *hentry)
+{
+	R_ReleaseObject(hentry->obj);
+	if (hentry->data != NULL)
+		pfree(hentry->data);
+	plr_object_stats.bytes -= hentry->bytes;
+	plr_object_stats.entries--;
+	hash_search(plr_object_HashTable, (void *) &hentry->key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Drop the least recently used objects until the cache holds no more than
+ * target bytes. The cache is small, so a scan finds the victim.
+ */
+static void
+plr_object_cache_evict(Size target)
+{
+	while (plr_object_stats.bytes > target)
+	{
+		HASH_SEQ_STATUS			status;
+		plr_object_cache_ent   *hentry;
+		plr_object_cache_ent   *victim = NULL;
+
+		hash_seq_init(&status, plr_object_HashTable);
+		while ((hentry = (plr_object_cache_ent *) hash_seq_search(&status)) != NULL)
+		{
+			if (victim == NULL || hentry->last_used < victim->last_used)
+				victim = hentry;
+		}
+		if (victim == NULL)
+			break;
+
+		plr_object_cache_remove(victim);
+		plr_object_stats.evictions++;
+	}
+}
+
+/*
+ * Unserialize a bytea argument, through the object cache when it is
+ * enabled. Cached objects are marked not mutable, so a function that
+ * modifies its argument modifies a copy.
+ */
+static SEXP
+pg_bytea_get_r(Datum dvalue)
+{
+	struct varlena		   *attr = (struct varlena *) DatumGetPointer(dvalue);
+	Size					budget = (Size) plr_object_cache_size * 1024;
+	plr_object_cache_key	key;
+	plr_object_cache_ent   *hentry;
+	bytea				   *bvalue = NULL;
+	Size					bytes;
+	bool					found;
+	SEXP					result;
+
+	if (plr_object_HashTable != NULL && plr_object_stats.bytes > budget)
+		plr_object_cache_evict(budget);
+
+	memset(&key, 0, sizeof(key));
+#if PG_VERSION_NUM >= 90400
+	if (budget > 0 && VARATT_IS_EXTERNAL_ONDISK(attr))
+#else
+	if (budget > 0 && VARATT_IS_EXTERNAL(attr))
+#endif
+	{
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+		key.toastrelid = toast_pointer.va_toastrelid;
+		key.valueid = toast_pointer.va_valueid;
+		key.size = toast_pointer.va_rawsize - VARHDRSZ;
+	}
+	else
+	{
+		bvalue = DatumGetByteaP(dvalue);
+		key.size = VARSIZE(bvalue) - VARHDRSZ;
+	}
+
+	/* values keyed by their contents keep a copy of them */
+	bytes = bvalue != NULL ? 2 * key.size : key.size;
+
+	/* too small to be worth it, or too big to fit */
+	if (key.size < PLR_OBJECT_CACHE_MIN_SIZE || bytes > budget)
+	{
+		if (bvalue == NULL)
+			bvalue = DatumGetByteaP(dvalue);
+		return plr_unserialize(VARDATA(bvalue), key.size);
+	}
+
+	if (bvalue != NULL)
+		key.hash = plr_object_cache_hash(VARDATA(bvalue), key.size);
+
+	if (plr_object_HashTable == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(plr_object_cache_key);
+		ctl.entrysize = sizeof(plr_object_cache_ent);
+		ctl.hash = tag_hash;
+		plr_object_HashTable = hash_create("PLR object cache",
+										   32,
+										   &ctl,
+										   HASH_ELEM | HASH_FUNCTION);
+		RegisterXactCallback(plr_object_cache_xact_callback, NULL);
+	}
+
+	hentry = (plr_object_cache_ent *) hash_search(plr_object_HashTable,
+												  (void *) &key,
+												  HASH_FIND,
+												  NULL);
+	if (hentry != NULL)
+	{
+		bool		valid;
+
+		/* a hash collision is a miss, the new value replaces the entry */
+		if (hentry->data != NULL)
+			valid = (memcmp(hentry->data, VARDATA(bvalue), key.size) == 0);
+		else if (hentry->checked_xact == plr_object_cache_xact)
+			valid = true;
+		else
+		{
+			/* so is a reused TOAST value OID */
+			bvalue = DatumGetByteaP(dvalue);
+			valid = (plr_object_cache_hash(VARDATA(bvalue), key.size) ==
+					 hentry->hash);
+			hentry->checked_xact = plr_object_cache_xact;
+		}
+
+		if (valid)
+		{
+			hentry->last_used = ++plr_object_cache_clock;
+			plr_object_stats.hits++;
+			return hentry->obj;
 		}
+		plr_object_cache_remove(hentry);
+	}
 
-		UNPROTECT(3);
+	plr_object_stats.misses++;
+	if (bvalue == NULL)
+		bvalue = DatumGetByteaP(dvalue);
+	PROTECT(result = plr_unserialize(VARDATA(bvalue), key.size));
+#ifdef MARK_NOT_MUTABLE
+	MARK_NOT_MUTABLE(result);
+#else
+	SET_NAMED(result, 2);
+#endif
+
+	plr_object_cache_evict(budget - bytes);
+
+	hentry = (plr_object_cache_ent *) hash_search(plr_object_HashTable,
+												  (void *) &key,
+												  HASH_ENTER,
+												  &found);
+	hentry->obj = result;
+	hentry->data = NULL;
+	hentry->bytes = bytes;
+	hentry->last_used = ++plr_object_cache_clock;
+	R_PreserveObject(result);
+	if (key.toastrelid == InvalidOid)
+	{
+		hentry->data = MemoryContextAlloc(TopMemoryContext, key.size);
+		memcpy(hentry->data, VARDATA(bvalue), key.size);
+		hentry->hash = key.hash;
 	}
+	else
+		hentry->hash = plr_object_cache_hash(VARDATA(bvalue), key.size);
+	hentry->checked_xact = plr_object_cache_xact;
+	plr_object_stats.bytes += bytes;
+	plr_object_stats.entries++;
+
+	UNPROTECT(1);
 
 	return result;
 }
 
+void
+plr_object_cache_get_stats(plr_object_cache_stats *stats)
+{
+	*stats = plr_object_stats;
+}
+
+/*
+ * Drop all cached objects and zero the counters
+ */
+void
+plr_object_cache_clear(void)
+{
+	if (plr_object_HashTable != NULL)
+		plr_object_cache_evict(0);
+	memset(&plr_object_stats, 0, sizeof(plr_object_stats));
+}
 
 /*
  * Given an array pg value, convert to a multi-row R vector.
  */
 SEXP
-pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char typalign)
+pg_array_get_r(Datum dvalue, FmgrInfo *out_func, int typlen, bool typbyval, char typalign)
 {
 	/*
 	 * Loop through and convert each scalar value.
@@ -159,6 +830,7 @@ pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char
 	Datum	   *elem_values;
 	bool	   *elem_nulls;
 	bool		fast_track_type;
+	bool		native_type;
 
 	/* short-circuit for NULL datums */
 	if (dvalue == (Datum) NULL)
@@ -176,6 +848,10 @@ pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char
 		case FLOAT8OID:
 			fast_track_type = true;
 			break;
+		case INT8OID:
+			/* integer64 vectors hold the very same int64 values */
+			fast_track_type = (plr_int8_conversion == PLR_INT8_INTEGER64);
+			break;
 		default:
 			fast_track_type = false;
 	}
@@ -209,6 +885,9 @@ pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char
 				Assert(sizeof(double) == 8);
 				memcpy(NUMERIC_DATA(result), p, nitems * sizeof(double));
 				break;
+			case INT8OID:
+				memcpy(PLR_INT64_DATA(result), p, nitems * sizeof(int64));
+				break;
 			default:
 				/* Everything else is error */
 				ereport(ERROR,
@@ -266,6 +945,7 @@ pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char
 
 		/* get new vector of the appropriate type and length */
 		PROTECT(result = get_r_vector(element_type, nitems));
+		native_type = pg_native_r_type(element_type);
 
 		/* Convert all values to their R form and build the vector */
 		for (i = 0; i < nr; i++)
@@ -282,9 +962,16 @@ pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char
 					isnull = elem_nulls[elem_idx];
 					itemvalue = elem_values[elem_idx++];
 
+					if (native_type)
+					{
+						pg_datum_get_one_r(itemvalue, isnull, element_type,
+										   result, idx);
+						continue;
+					}
+
 					if (!isnull)
 					{
-						value = DatumGetCString(FunctionCall3(&out_func,
+						value = DatumGetCString(FunctionCall3(out_func,
 															  itemvalue,
 															  (Datum) 0,
 															  Int32GetDatum(-1)));
@@ -338,6 +1025,7 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
 	SEXP		result;
 	int			i;
 	bool		fast_track_type;
+	bool		native_type;
 
 	switch (element_type)
 	{
@@ -345,6 +1033,10 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
 		case FLOAT8OID:
 			fast_track_type = true;
 			break;
+		case INT8OID:
+			/* integer64 vectors hold the very same int64 values */
+			fast_track_type = (plr_int8_conversion == PLR_INT8_INTEGER64);
+			break;
 		default:
 			fast_track_type = false;
 	}
@@ -377,6 +1069,10 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
 				Assert(sizeof(double) == 8);
 				memcpy(NUMERIC_DATA(result), elem_values, numels * sizeof(double));
 				break;
+			case INT8OID:
+				Assert(sizeof(Datum) == sizeof(int64));
+				memcpy(PLR_INT64_DATA(result), elem_values, numels * sizeof(int64));
+				break;
 			default:
 				/* Everything else is error */
 				ereport(ERROR,
@@ -407,6 +1103,7 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
 
 		/* get new vector of the appropriate type and length */
 		PROTECT(result = get_r_vector(element_type, numels));
+		native_type = pg_native_r_type(element_type);
 
 		/* Convert all values to their R form and build the vector */
 		for (i = 0; i < numels; i++)
@@ -418,6 +1115,12 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
 			isnull = elem_nulls[i];
 			itemvalue = elem_values[i];
 
+			if (native_type)
+			{
+				pg_datum_get_one_r(itemvalue, isnull, element_type, result, i);
+				continue;
+			}
+
 			if (!isnull)
 			{
 				value = DatumGetCString(FunctionCall3(&out_func,
@@ -454,20 +1157,274 @@ pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_
  * the created object is not quite actually a data.frame
  */
 SEXP
-pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc)
+pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+					 bool array_matrix)
 {
 	int			nr = ntuples;
-	int			nc = tupdesc->natts;
-	int			nc_non_dropped = 0;
-	int			df_colnum = 0;
 	int			i = 0;
-	int			j = 0;
-	Oid			element_type;
-	Oid			typelem;
-	SEXP		names;
 	SEXP		row_names;
 	char		buf[256];
 	SEXP		result;
+
+	if (tuples == NULL || ntuples < 1)
+		return R_NilValue;
+
+	PROTECT(result = pg_tuple_get_r_list(ntuples, tuples, tupdesc, array_matrix));
+
+	/* attach row names - basically just the row number, zero based */
+	PROTECT(row_names = allocVector(STRSXP, nr));
+	for (i=0; i<nr; i++)
+	{
+		sprintf(buf, "%d", i+1);
+		SET_STRING_ELT(row_names, i, COPY_TO_USER_STRING(buf));
+	}
+	setAttrib(result, R_RowNamesSymbol, row_names);
+
+	/* finally, tell R we are a data.frame */
+	setAttrib(result, R_ClassSymbol, mkString("data.frame"));
+
+	UNPROTECT(2);
+	return result;
+}
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Given a tuplestore of tuples of tupdesc, such as a trigger transition
+ * table, convert its contents to an R data.frame. The tuplestore is read
+ * through a read pointer of its own, so other readers are not disturbed.
+ */
+SEXP
+pg_tuplestore_get_r_frame(Tuplestorestate *tupstore, TupleDesc tupdesc)
+{
+	int64			ntuples = tuplestore_tuple_count(tupstore);
+	HeapTuple	   *tuples;
+	TupleTableSlot *slot;
+	int				readptr;
+	int				i = 0;
+	SEXP			result;
+
+	if (ntuples < 1)
+		return R_NilValue;
+	if (ntuples > INT_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("too many rows to convert to an R data.frame")));
+
+	tuples = (HeapTuple *) palloc(ntuples * sizeof(HeapTuple));
+#if PG_VERSION_NUM >= 120000
+	slot = MakeSingleTupleTableSlot(tupdesc, &TTSOpsMinimalTuple);
+#else
+	slot = MakeSingleTupleTableSlot(tupdesc);
+#endif
+
+	readptr = tuplestore_alloc_read_pointer(tupstore, EXEC_FLAG_REWIND);
+	tuplestore_select_read_pointer(tupstore, readptr);
+	tuplestore_rescan(tupstore);
+	while (i < ntuples && tuplestore_gettupleslot(tupstore, true, false, slot))
+	{
+#if PG_VERSION_NUM >= 120000
+		tuples[i++] = ExecCopySlotHeapTuple(slot);
+#else
+		tuples[i++] = ExecCopySlotTuple(slot);
+#endif
+	}
+	tuplestore_select_read_pointer(tupstore, 0);
+	ExecDropSingleTupleTableSlot(slot);
+
+	PROTECT(result = pg_tuple_get_r_frame(i, tuples, tupdesc, false));
+
+	for (ntuples = 0; ntuples < i; ntuples++)
+		heap_freetuple(tuples[ntuples]);
+	pfree(tuples);
+
+	UNPROTECT(1);
+	return result;
+}
+#endif
+
+/*
+ * A float4 as the R double its text output would read back as, so that
+ * 0.1::float4 becomes 0.1 rather than 0.100000001490116 whichever way the
+ * value is converted
+ */
+static double
+float4_get_r_value(float4 value)
+{
+	char		buf[32];
+	int			ndig;
+
+	if (isnan(value) || isinf(value))
+		return (double) value;
+
+#if PG_VERSION_NUM >= 120000
+	if (extra_float_digits > 0)
+	{
+		float_to_shortest_decimal_buf(value, buf);
+		return strtod(buf, NULL);
+	}
+#endif
+
+	/* like float4out() */
+	ndig = FLT_DIG + extra_float_digits;
+	if (ndig < 1)
+		ndig = 1;
+	snprintf(buf, sizeof(buf), "%.*g", ndig, value);
+
+	return strtod(buf, NULL);
+}
+
+/*
+ * Given a single heap tuple of tupdesc, such as a trigger's NEW or OLD,
+ * convert it to a one row R data.frame. The tuple is deformed once and
+ * the common scalar types are converted from their binary values; the
+ * rest go through their output functions like pg_tuple_get_r_frame().
+ */
+SEXP
+pg_heap_tuple_get_r_frame(HeapTuple tuple, TupleDesc tupdesc)
+{
+	int			nc = tupdesc->natts;
+	int			nc_non_dropped = 0;
+	int			df_colnum = 0;
+	int			j;
+	Datum	   *values;
+	bool	   *nulls;
+	SEXP		names;
+	SEXP		result;
+	SEXP		fldvec;
+
+	for (j = 0; j < nc; j++)
+	{
+		if (!tupdesc->attrs[j]->attisdropped)
+			nc_non_dropped++;
+	}
+
+	values = (Datum *) palloc(nc * sizeof(Datum));
+	nulls = (bool *) palloc(nc * sizeof(bool));
+	heap_deform_tuple(tuple, tupdesc, values, nulls);
+
+	PROTECT(result = NEW_LIST(nc_non_dropped));
+	PROTECT(names = NEW_CHARACTER(nc_non_dropped));
+
+	for (j = 0; j < nc; j++)
+	{
+		Oid			element_type;
+		Oid			typelem;
+
+		if (tupdesc->attrs[j]->attisdropped)
+			continue;
+
+		SET_COLUMN_NAMES;
+
+		element_type = tupdesc->attrs[j]->atttypid;
+		typelem = get_element_type(element_type);
+
+		if (typelem != InvalidOid)
+		{
+			/* array columns are a list of one vector */
+			plr_elem_io_hashent *elem_io = get_array_elem_io(typelem);
+
+			PROTECT(fldvec = NEW_LIST(1));
+			if (!nulls[j])
+				SET_VECTOR_ELT(fldvec, 0, pg_array_get_r(PointerGetDatum(PG_DETOAST_DATUM(values[j])),
+														 &elem_io->outputproc,
+														 elem_io->typlen,
+														 elem_io->typbyval,
+														 elem_io->typalign));
+		}
+		else
+		{
+			PROTECT(fldvec = get_r_vector(element_type, 1));
+			if (pg_native_r_type(element_type))
+				pg_datum_get_one_r(values[j], nulls[j], element_type, fldvec, 0);
+			else if (nulls[j])
+				pg_get_one_r(NULL, element_type, &fldvec, 0);
+			else
+			{
+				switch (element_type)
+				{
+					case INT2OID:
+						INTEGER_DATA(fldvec)[0] = DatumGetInt16(values[j]);
+						break;
+					case INT4OID:
+						INTEGER_DATA(fldvec)[0] = DatumGetInt32(values[j]);
+						break;
+					case OIDOID:
+						INTEGER_DATA(fldvec)[0] = (int) DatumGetObjectId(values[j]);
+						break;
+					case INT8OID:
+						NUMERIC_DATA(fldvec)[0] = (double) DatumGetInt64(values[j]);
+						break;
+					case FLOAT4OID:
+						NUMERIC_DATA(fldvec)[0] = float4_get_r_value(DatumGetFloat4(values[j]));
+						break;
+					case FLOAT8OID:
+						NUMERIC_DATA(fldvec)[0] = DatumGetFloat8(values[j]);
+						break;
+					case BOOLOID:
+						LOGICAL_DATA(fldvec)[0] = DatumGetBool(values[j]) ? 1 : 0;
+						break;
+					case TEXTOID:
+					case VARCHAROID:
+						{
+							char   *value = PG_TEXT_GET_STR(DatumGetPointer(values[j]));
+
+							SET_STRING_ELT(fldvec, 0, COPY_TO_USER_STRING(value));
+							pfree(value);
+						}
+						break;
+					default:
+						{
+							Oid		typoutput;
+							bool	typisvarlena;
+							char   *value;
+
+							getTypeOutputInfo(element_type, &typoutput, &typisvarlena);
+							value = OidOutputFunctionCall(typoutput, values[j]);
+							pg_get_one_r(value, element_type, &fldvec, 0);
+							pfree(value);
+						}
+						break;
+				}
+			}
+		}
+
+		SET_VECTOR_ELT(result, df_colnum, fldvec);
+		UNPROTECT(1);
+		df_colnum++;
+	}
+
+	setAttrib(result, R_NamesSymbol, names);
+	setAttrib(result, R_RowNamesSymbol, mkString("1"));
+	setAttrib(result, R_ClassSymbol, mkString("data.frame"));
+
+	pfree(values);
+	pfree(nulls);
+
+	UNPROTECT(2);
+	return result;
+}
+
+/*
+ * Given an array of pg tuples, convert to a named R list of column
+ * vectors, without the row names and class that make up a data.frame.
+ *
+ * If array_matrix is true, array columns whose values all are non-null
+ * one dimensional numeric arrays of the same length, without null elements,
+ * are returned as a single ntuples x length R matrix rather than as a list
+ * of per row vectors.
+ */
+SEXP
+pg_tuple_get_r_list(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+					bool array_matrix)
+{
+	int			nr = ntuples;
+	int			nc = tupdesc->natts;
+	int			nc_non_dropped = 0;
+	int			df_colnum = 0;
+	int			j = 0;
+	Oid			element_type;
+	SEXP		names;
+	SEXP		result;
 	SEXP		fldvec;
 
 	if (tuples == NULL || ntuples < 1)
@@ -492,14 +1449,6 @@ pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc)
 	 */
 	for (j = 0; j < nc; j++)		
 	{
-		int16		typlen;
-		bool		typbyval;
-		char		typdelim;
-		Oid			typoutput,
-					typioparam;
-		FmgrInfo	outputproc;
-		char		typalign;
-
 		/* ignore dropped attributes */
 		if (tupdesc->attrs[j]->attisdropped)
 			continue;
@@ -511,52 +1460,23 @@ pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc)
 		element_type = SPI_gettypeid(tupdesc, j + 1);
 
 		/*
-		 * Check to see if it is an array type. get_element_type will return
-		 * InvalidOid instead of actual element type if the type is not a
-		 * varlena array.
+		 * Get new vector of the appropriate type and length. Array
+		 * columns become a list of per row vectors.
 		 */
-		typelem = get_element_type(element_type);
-
-		/* get new vector of the appropriate type and length */
-		if (typelem == InvalidOid)
+		if (get_element_type(element_type) == InvalidOid)
 			PROTECT(fldvec = get_r_vector(element_type, nr));
-		else
+		else if (array_matrix &&
+				 (fldvec = pg_array_column_get_r_matrix(ntuples, tuples,
+														tupdesc, j)) != R_NilValue)
 		{
-			PROTECT(fldvec = NEW_LIST(nr));
-			get_type_io_data(typelem, IOFunc_output, &typlen, &typbyval,
-							 &typalign, &typdelim, &typioparam, &typoutput);
-
-			fmgr_info(typoutput, &outputproc);
+			SET_VECTOR_ELT(result, df_colnum, fldvec);
+			df_colnum++;
+			continue;
 		}
+		else
+			PROTECT(fldvec = NEW_LIST(nr));
 
-		/* loop rows for this column */
-		for (i = 0; i < nr; i++)
-		{
-			if (typelem == InvalidOid)
-			{
-				/* not an array type */
-				char	   *value;
-
-				value = SPI_getvalue(tuples[i], tupdesc, j + 1);
-				pg_get_one_r(value, element_type, &fldvec, i);
-			}
-			else
-			{
-				/* array type */
-				Datum		dvalue;
-				bool		isnull;
-				SEXP		fldvec_elem;
-
-				dvalue = SPI_getbinval(tuples[i], tupdesc, j + 1, &isnull);
-				if (!isnull)
-					PROTECT(fldvec_elem = pg_array_get_r(dvalue, outputproc, typlen, typbyval, typalign));
-				else
-					PROTECT(fldvec_elem = R_NilValue);
-
-				SET_VECTOR_ELT(fldvec, i, fldvec_elem);
-				UNPROTECT(1);
-			}
-		}
+		pg_tuple_fill_r_column(ntuples, tuples, tupdesc, j, fldvec);
 
 		SET_VECTOR_ELT(result, df_colnum, fldvec);
 		UNPROTECT(1);
@@ -566,90 +1486,401 @@ pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc)
 	/* attach the column names */
 	setAttrib(result, R_NamesSymbol, names);
 
-	/* attach row names - basically just the row number, zero based */
-	PROTECT(row_names = allocVector(STRSXP, nr));
-	for (i=0; i<nr; i++)
+	UNPROTECT(2);
+	return result;
+}
+
+/*
+ * Check that an existing R list has the right shape to be refilled by
+ * pg_tuple_fill_r_frame(): one column per non-dropped attribute, each of
+ * the R storage type pg_tuple_get_r_frame() would have created for it,
+ * and each able to hold at least nr rows.
+ */
+bool
+pg_tuple_r_frame_matches(TupleDesc tupdesc, SEXP frame, int nr)
+{
+	int			nc = tupdesc->natts;
+	int			df_colnum = 0;
+	int			j;
+
+	if (TYPEOF(frame) != VECSXP)
+		return false;
+
+	for (j = 0; j < nc; j++)
 	{
-		sprintf(buf, "%d", i+1);
-		SET_STRING_ELT(row_names, i, COPY_TO_USER_STRING(buf));
-	}
-	setAttrib(result, R_RowNamesSymbol, row_names);
+		Oid			element_type;
+		SEXP		fldvec;
+		SEXPTYPE	expected;
 
-	/* finally, tell R we are a data.frame */
-	setAttrib(result, R_ClassSymbol, mkString("data.frame"));
+		if (tupdesc->attrs[j]->attisdropped)
+			continue;
 
-	UNPROTECT(3);
-	return result;
+		if (df_colnum >= length(frame))
+			return false;
+
+		fldvec = VECTOR_ELT(frame, df_colnum++);
+		element_type = SPI_gettypeid(tupdesc, j + 1);
+
+		if (get_element_type(element_type) == InvalidOid)
+			expected = get_r_vector_type(element_type);
+		else
+			expected = VECSXP;
+
+		if (TYPEOF(fldvec) != expected || isFactor(fldvec) ||
+			length(fldvec) < nr)
+			return false;
+
+		/* int8 columns are R doubles both as integer64 and not */
+		if (element_type == INT8OID &&
+			PLR_IS_INTEGER64(fldvec) != pg_native_r_type(INT8OID))
+			return false;
+	}
+
+	return df_colnum == length(frame);
 }
 
 /*
- * create an R vector of a given type and size based on pg output function oid
+ * Given an array of pg tuples, overwrite the first ntuples rows of an
+ * existing R list of column vectors in place. Columns shared with other
+ * R objects are copied first. The caller must have verified the shape of
+ * the list with pg_tuple_r_frame_matches().
  */
-static SEXP
-get_r_vector(Oid typtype, int numels)
+void
+pg_tuple_fill_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc, SEXP frame)
 {
-	SEXP	result;
+	int			nc = tupdesc->natts;
+	int			df_colnum = 0;
+	int			j;
+	SEXP		fldvec;
 
-	switch (typtype)
+	for (j = 0; j < nc; j++)
 	{
-		case OIDOID:
-		case INT2OID:
-		case INT4OID:
-			/* 2 and 4 byte integer pgsql datatype => use R INTEGER */
-			PROTECT(result = NEW_INTEGER(numels));
-			break;
-		case INT8OID:
-		case FLOAT4OID:
-		case FLOAT8OID:
-		case CASHOID:
-		case NUMERICOID:
-			/*
-			 * Other numeric types => use R REAL
-			 * Note pgsql int8 is mapped to R REAL
-			 * because R INTEGER is only 4 byte
-			 */
-			PROTECT(result = NEW_NUMERIC(numels));
-			break;
-		case BOOLOID:
-			PROTECT(result = NEW_LOGICAL(numels));
-			break;
-		case BYTEAOID:
-			PROTECT(result = NEW_RAW(numels));
-			break;
-		default:
-			/* Everything else is defaulted to string */
-			PROTECT(result = NEW_CHARACTER(numels));
-	}
-	UNPROTECT(1);
+		if (tupdesc->attrs[j]->attisdropped)
+			continue;
 
-	return result;
+		fldvec = VECTOR_ELT(frame, df_colnum);
+
+		/* a column also bound elsewhere, e.g. buf$a, gets a copy of its own */
+#ifdef MAYBE_SHARED
+		if (MAYBE_SHARED(fldvec))
+#else
+		if (NAMED(fldvec) > 1)
+#endif
+		{
+			fldvec = duplicate(fldvec);
+			SET_VECTOR_ELT(frame, df_colnum, fldvec);
+		}
+
+		pg_tuple_fill_r_column(ntuples, tuples, tupdesc, j, fldvec);
+		df_colnum++;
+	}
 }
 
 /*
- * given a single non-array pg value, convert to its R value representation
+ * Convert attribute j of each of the given tuples into rows 0 .. ntuples - 1
+ * of the already allocated R vector fldvec
  */
 static void
-pg_get_one_r(char *value, Oid typtype, SEXP *obj, int elnum)
+pg_tuple_fill_r_column(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+					   int j, SEXP fldvec)
 {
-	switch (typtype)
+	int			i;
+	Oid			element_type;
+	Oid			typelem;
+	bool		native_type;
+	plr_elem_io_hashent *elem_io = NULL;
+
+	/* get column datatype oid */
+	element_type = SPI_gettypeid(tupdesc, j + 1);
+	native_type = pg_native_r_type(element_type);
+
+	/*
+	 * Check to see if it is an array type. get_element_type will return
+	 * InvalidOid instead of actual element type if the type is not a
+	 * varlena array.
+	 */
+	typelem = get_element_type(element_type);
+
+	if (typelem != InvalidOid)
+		elem_io = get_array_elem_io(typelem);
+
+	/* loop rows for this column */
+	for (i = 0; i < ntuples; i++)
 	{
-		case OIDOID:
-		case INT2OID:
-		case INT4OID:
-			/* 2 and 4 byte integer pgsql datatype => use R INTEGER */
-			if (value)
-				INTEGER_DATA(*obj)[elnum] = atoi(value);
-			else
-				INTEGER_DATA(*obj)[elnum] = NA_INTEGER;
-			break;
-		case INT8OID:
-		case FLOAT4OID:
-		case FLOAT8OID:
-		case CASHOID:
-		case NUMERICOID:
-			/*
-			 * Other numeric types => use R REAL
-			 * Note pgsql int8 is mapped to R REAL
+		if (native_type)
+		{
+			/* converted from the binary value */
+			Datum		dvalue;
+			bool		isnull;
+
+			dvalue = SPI_getbinval(tuples[i], tupdesc, j + 1, &isnull);
+			pg_datum_get_one_r(dvalue, isnull, element_type, fldvec, i);
+		}
+		else if (typelem == InvalidOid)
+		{
+			/* not an array type */
+			char	   *value;
+
+			value = SPI_getvalue(tuples[i], tupdesc, j + 1);
+			pg_get_one_r(value, element_type, &fldvec, i);
+		}
+		else
+		{
+			/* array type */
+			Datum		dvalue;
+			bool		isnull;
+			SEXP		fldvec_elem;
+
+			dvalue = SPI_getbinval(tuples[i], tupdesc, j + 1, &isnull);
+			if (!isnull)
+				PROTECT(fldvec_elem = pg_array_get_r(dvalue, &elem_io->outputproc,
+													 elem_io->typlen,
+													 elem_io->typbyval,
+													 elem_io->typalign));
+			else
+				PROTECT(fldvec_elem = R_NilValue);
+
+			SET_VECTOR_ELT(fldvec, i, fldvec_elem);
+			UNPROTECT(1);
+		}
+	}
+}
+
+/*
+ * Look up, and cache on first use, the output information of an array
+ * element type
+ */
+static plr_elem_io_hashent *
+get_array_elem_io(Oid typelem)
+{
+	plr_elem_io_hashent *hentry;
+	bool		found;
+
+	if (plr_elem_io_HashTable == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(plr_elem_io_hashent);
+		ctl.hash = tag_hash;
+		plr_elem_io_HashTable = hash_create("PLR array element I/O cache",
+											32,
+											&ctl,
+											HASH_ELEM | HASH_FUNCTION);
+	}
+
+	hentry = (plr_elem_io_hashent *) hash_search(plr_elem_io_HashTable,
+												 (void *) &typelem,
+												 HASH_FIND,
+												 NULL);
+	if (hentry == NULL)
+	{
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+		char		typdelim;
+		Oid			typoutput,
+					typioparam;
+		FmgrInfo	outputproc;
+
+		/* do the lookups before creating the entry, they may error out */
+		get_type_io_data(typelem, IOFunc_output, &typlen, &typbyval,
+						 &typalign, &typdelim, &typioparam, &typoutput);
+		fmgr_info_cxt(typoutput, &outputproc, TopMemoryContext);
+
+		hentry = (plr_elem_io_hashent *) hash_search(plr_elem_io_HashTable,
+													 (void *) &typelem,
+													 HASH_ENTER,
+													 &found);
+		hentry->typlen = typlen;
+		hentry->typbyval = typbyval;
+		hentry->typalign = typalign;
+		hentry->outputproc = outputproc;
+	}
+
+	return hentry;
+}
+
+/*
+ * Convert array attribute j of each of the given tuples into one R matrix
+ * with a row per tuple, provided every value is a non-null one dimensional
+ * int2, int4, float4 or float8 array of the same non-zero length without
+ * null elements, and the matrix has at most INT_MAX elements. Returns
+ * R_NilValue if the column does not qualify.
+ */
+static SEXP
+pg_array_column_get_r_matrix(int ntuples, HeapTuple *tuples,
+							 TupleDesc tupdesc, int j)
+{
+	Oid			typelem;
+	ArrayType **arrays;
+	int			ncols = 0;
+	int			i, k;
+	SEXP		result;
+	SEXP		matrix_dims;
+
+	typelem = get_element_type(SPI_gettypeid(tupdesc, j + 1));
+	switch (typelem)
+	{
+		case INT2OID:
+		case INT4OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+			break;
+		default:
+			return R_NilValue;
+	}
+
+	/* detoast and check every value before allocating anything in R */
+	arrays = (ArrayType **) palloc(ntuples * sizeof(ArrayType *));
+	for (i = 0; i < ntuples; i++)
+	{
+		Datum		dvalue;
+		bool		isnull;
+		ArrayType  *v;
+
+		dvalue = SPI_getbinval(tuples[i], tupdesc, j + 1, &isnull);
+		if (isnull)
+			break;
+
+		v = DatumGetArrayTypeP(dvalue);
+		if (ARR_NDIM(v) != 1 || ARR_HASNULL(v) ||
+			ARR_DIMS(v)[0] < 1 || (i > 0 && ARR_DIMS(v)[0] != ncols))
+			break;
+
+		ncols = ARR_DIMS(v)[0];
+		arrays[i] = v;
+	}
+
+	/* the elements are counted, and indexed below, in an int */
+	if (i < ntuples || (int64) ntuples * ncols > INT_MAX)
+	{
+		pfree(arrays);
+		return R_NilValue;
+	}
+
+	/* R matrices are column major, so element k of row i goes to i + k * nr */
+	PROTECT(result = get_r_vector(typelem, ntuples * ncols));
+	for (i = 0; i < ntuples; i++)
+	{
+		char	   *p = ARR_DATA_PTR(arrays[i]);
+
+		switch (typelem)
+		{
+			case INT2OID:
+				for (k = 0; k < ncols; k++)
+					INTEGER_DATA(result)[i + k * ntuples] = ((int16 *) p)[k];
+				break;
+			case INT4OID:
+				for (k = 0; k < ncols; k++)
+					INTEGER_DATA(result)[i + k * ntuples] = ((int32 *) p)[k];
+				break;
+			case FLOAT4OID:
+				for (k = 0; k < ncols; k++)
+					NUMERIC_DATA(result)[i + k * ntuples] =
+						float4_get_r_value(((float4 *) p)[k]);
+				break;
+			case FLOAT8OID:
+				for (k = 0; k < ncols; k++)
+					NUMERIC_DATA(result)[i + k * ntuples] = ((float8 *) p)[k];
+				break;
+		}
+	}
+	pfree(arrays);
+
+	/* attach dimensions */
+	PROTECT(matrix_dims = allocVector(INTSXP, 2));
+	INTEGER_DATA(matrix_dims)[0] = ntuples;
+	INTEGER_DATA(matrix_dims)[1] = ncols;
+	setAttrib(result, R_DimSymbol, matrix_dims);
+
+	UNPROTECT(2);
+	return result;
+}
+
+/*
+ * create an R vector of a given type and size based on pg output function oid
+ */
+static SEXP
+get_r_vector(Oid typtype, int numels)
+{
+	SEXP	result;
+
+	PROTECT(result = allocVector(get_r_vector_type(typtype), numels));
+	if (pg_native_r_type(typtype))
+		set_r_native_class(result, typtype);
+	UNPROTECT(1);
+
+	return result;
+}
+
+/*
+ * R storage type used for a given non-array pg type
+ */
+static SEXPTYPE
+get_r_vector_type(Oid typtype)
+{
+	switch (typtype)
+	{
+		case OIDOID:
+		case INT2OID:
+		case INT4OID:
+			/* 2 and 4 byte integer pgsql datatype => use R INTEGER */
+			return INTSXP;
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case CASHOID:
+			/*
+			 * Other numeric types => use R REAL
+			 * Note pgsql int8 is mapped to R REAL
+			 * because R INTEGER is only 4 byte,
+			 * or to integer64 which is stored as REAL
+			 */
+			return REALSXP;
+		case NUMERICOID:
+			if (plr_numeric_conversion == PLR_NUMERIC_CHARACTER)
+				return STRSXP;
+			return REALSXP;
+		case BOOLOID:
+			return LGLSXP;
+		case BYTEAOID:
+			return RAWSXP;
+		default:
+			/* Everything else is defaulted to string, or see below */
+			break;
+	}
+
+	if (pg_native_r_type(typtype))
+		return REALSXP;
+	return STRSXP;
+}
+
+/*
+ * given a single non-array pg value, convert to its R value representation
+ */
+static void
+pg_get_one_r(char *value, Oid typtype, SEXP *obj, int elnum)
+{
+	switch (typtype)
+	{
+		case OIDOID:
+		case INT2OID:
+		case INT4OID:
+			/* 2 and 4 byte integer pgsql datatype => use R INTEGER */
+			if (value)
+				INTEGER_DATA(*obj)[elnum] = atoi(value);
+			else
+				INTEGER_DATA(*obj)[elnum] = NA_INTEGER;
+			break;
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case CASHOID:
+			/*
+			 * Other numeric types => use R REAL
+			 * Note pgsql int8 is mapped to R REAL
 			 * because R INTEGER is only 4 byte
 			 */
 			if (value)
@@ -657,6 +1888,13 @@ pg_get_one_r(char *value, Oid typtype, SEXP *obj, int elnum)
 			else
 				NUMERIC_DATA(*obj)[elnum] = NA_REAL;
 			break;
+		case NUMERICOID:
+			/* only as character, otherwise see pg_datum_get_one_r() */
+			if (value)
+				SET_STRING_ELT(*obj, elnum, COPY_TO_USER_STRING(value));
+			else
+				SET_STRING_ELT(*obj, elnum, NA_STRING);
+			break;
 		case BOOLOID:
 			if (value)
 				LOGICAL_DATA(*obj)[elnum] = ((*value == 't') ? 1 : 0);
@@ -672,74 +1910,1122 @@ pg_get_one_r(char *value, Oid typtype, SEXP *obj, int elnum)
 	}
 }
 
-/*
- * given an R value, convert to its pg representation
- */
-Datum
-r_get_pg(SEXP rval, plr_function *function, FunctionCallInfo fcinfo)
+/*
+ * R's Date and POSIXct count days and seconds from 1970-01-01, pg's date
+ * and timestamp types from 2000-01-01
+ */
+#define PLR_EPOCH_DAYS		10957
+#define PLR_EPOCH_SECS		((int64) PLR_EPOCH_DAYS * SECS_PER_DAY)
+
+/*
+ * true if values of typtype are converted to R from their binary form,
+ * by pg_datum_get_one_r(), rather than from their text form
+ */
+static bool
+pg_native_r_type(Oid typtype)
+{
+	switch (typtype)
+	{
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case INTERVALOID:
+			return plr_native_datetime;
+		case NUMERICOID:
+			return plr_numeric_conversion == PLR_NUMERIC_DOUBLE;
+		case INT8OID:
+			return plr_int8_conversion == PLR_INT8_INTEGER64;
+		default:
+			return false;
+	}
+}
+
+/*
+ * attach the R class, and its attributes, of the values of typtype to an
+ * R vector of them
+ */
+static void
+set_r_native_class(SEXP obj, Oid typtype)
+{
+	SEXP		cls;
+	SEXP		attr;
+
+	switch (typtype)
+	{
+		case DATEOID:
+			setAttrib(obj, R_ClassSymbol, mkString("Date"));
+			break;
+		case INT8OID:
+			setAttrib(obj, R_ClassSymbol, mkString("integer64"));
+			break;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			{
+				const char *tzname = NULL;
+
+				PROTECT(cls = allocVector(STRSXP, 2));
+				SET_STRING_ELT(cls, 0, mkChar("POSIXct"));
+				SET_STRING_ELT(cls, 1, mkChar("POSIXt"));
+				setAttrib(obj, R_ClassSymbol, cls);
+				UNPROTECT(1);
+
+				/*
+				 * timestamp values are given as their UTC time, timestamptz
+				 * values are displayed in the session's time zone
+				 */
+				if (typtype == TIMESTAMPOID)
+					tzname = "UTC";
+#if PG_VERSION_NUM >= 90200
+				else
+					tzname = pg_get_timezone_name(session_timezone);
+#endif
+				PROTECT(attr = mkString(tzname ? tzname : ""));
+				setAttrib(obj, install("tzone"), attr);
+				UNPROTECT(1);
+			}
+			break;
+		case INTERVALOID:
+			setAttrib(obj, R_ClassSymbol, mkString("difftime"));
+			PROTECT(attr = mkString("secs"));
+			setAttrib(obj, install("units"), attr);
+			UNPROTECT(1);
+			break;
+		default:
+			break;
+	}
+}
+
+static double
+date_get_r(DateADT date)
+{
+#ifdef DATE_NOT_FINITE
+	if (DATE_IS_NOBEGIN(date))
+		return R_NegInf;
+	if (DATE_IS_NOEND(date))
+		return R_PosInf;
+#endif
+	return (double) date + PLR_EPOCH_DAYS;
+}
+
+static double
+timestamp_get_r(Timestamp ts)
+{
+	if (TIMESTAMP_IS_NOBEGIN(ts))
+		return R_NegInf;
+	if (TIMESTAMP_IS_NOEND(ts))
+		return R_PosInf;
+#ifdef PLR_INT64_TIMESTAMP
+	/* whole seconds apart, a double cannot hold every int64 microsecond */
+	return (double) (ts / USECS_PER_SEC + PLR_EPOCH_SECS) +
+		(double) (ts % USECS_PER_SEC) / USECS_PER_SEC;
+#else
+	return ts + PLR_EPOCH_SECS;
+#endif
+}
+
+static double
+interval_get_r(Interval *span)
+{
+	double		result;
+
+#ifdef INTERVAL_NOT_FINITE
+	if (INTERVAL_IS_NOBEGIN(span))
+		return R_NegInf;
+	if (INTERVAL_IS_NOEND(span))
+		return R_PosInf;
+#endif
+
+	/* months and days count as they do in extract(epoch from interval) */
+	result = ((double) DAYS_PER_YEAR * SECS_PER_DAY) * (span->month / MONTHS_PER_YEAR) +
+		((double) DAYS_PER_MONTH * SECS_PER_DAY) * (span->month % MONTHS_PER_YEAR) +
+		((double) SECS_PER_DAY) * span->day;
+#ifdef PLR_INT64_TIMESTAMP
+	result += (double) (span->time / USECS_PER_SEC) +
+		(double) (span->time % USECS_PER_SEC) / USECS_PER_SEC;
+#else
+	result += span->time;
+#endif
+
+	return result;
+}
+
+#if PG_VERSION_NUM >= 90100
+/*
+ * The layout of numeric values is private to numeric.c, but it is also
+ * their on-disk format, which pg_upgrade keeps as it is, so it does not
+ * change. After the varlena header comes a uint16 header word; in the
+ * long format, an int16 weight follows. Then come the base 10000 digits,
+ * most significant first, of which the first has weight "weight".
+ */
+#define PLR_NUMERIC_SIGN_MASK		0xC000
+#define PLR_NUMERIC_NEG				0x4000
+#define PLR_NUMERIC_SHORT			0x8000
+#define PLR_NUMERIC_SPECIAL			0xC000
+#define PLR_NUMERIC_PINF			0xD000
+#define PLR_NUMERIC_NINF			0xF000
+#define PLR_NUMERIC_SHORT_SIGN_MASK			0x2000
+#define PLR_NUMERIC_SHORT_WEIGHT_SIGN_MASK	0x0040
+#define PLR_NUMERIC_SHORT_WEIGHT_MASK		0x003F
+#define PLR_NUMERIC_NBASE			10000
+#define PLR_NUMERIC_DEC_DIGITS		4
+
+/* the powers of ten that are exact as doubles */
+static const double plr_exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define PLR_MAX_EXACT_POW10		22
+#endif
+
+/*
+ * Convert a numeric value to the nearest double, as atof() of its text
+ * would. Values of up to 16 significant digits whose decimal exponent is
+ * within 22 are read from the digit array: the digits form an integer of
+ * at most 2^53, and one multiplication or division by an exact power of
+ * ten rounds it correctly. Anything else is formatted and parsed.
+ */
+static double
+numeric_get_r(Datum value)
+{
+	char	   *str;
+	double		result;
+#if PG_VERSION_NUM >= 90100
+	Numeric		num = DatumGetNumeric(value);
+	const char *data = VARDATA(num);
+	int			len = VARSIZE(num) - VARHDRSZ;
+	uint16		header;
+	int16		weight = 0;
+	bool		neg = false;
+	const int16 *digits = NULL;
+	int			ndigits;
+	bool		done = false;
+
+	memcpy(&header, data, sizeof(uint16));
+	switch (header & PLR_NUMERIC_SIGN_MASK)
+	{
+		case PLR_NUMERIC_SPECIAL:
+			if (header == PLR_NUMERIC_PINF)
+				result = R_PosInf;
+			else if (header == PLR_NUMERIC_NINF)
+				result = R_NegInf;
+			else
+				result = R_NaN;
+			done = true;
+			ndigits = 0;
+			break;
+		case PLR_NUMERIC_SHORT:
+			neg = (header & PLR_NUMERIC_SHORT_SIGN_MASK) != 0;
+			weight = (int16) ((header & PLR_NUMERIC_SHORT_WEIGHT_SIGN_MASK ?
+							   ~PLR_NUMERIC_SHORT_WEIGHT_MASK : 0) |
+							  (header & PLR_NUMERIC_SHORT_WEIGHT_MASK));
+			digits = (const int16 *) (data + sizeof(uint16));
+			ndigits = (len - sizeof(uint16)) / sizeof(int16);
+			break;
+		default:
+			neg = (header & PLR_NUMERIC_SIGN_MASK) == PLR_NUMERIC_NEG;
+			memcpy(&weight, data + sizeof(uint16), sizeof(int16));
+			digits = (const int16 *) (data + sizeof(uint16) + sizeof(int16));
+			ndigits = (len - sizeof(uint16) - sizeof(int16)) / sizeof(int16);
+			break;
+	}
+
+	if (!done && ndigits == 0)
+	{
+		result = 0;
+		done = true;
+	}
+
+	if (!done && ndigits <= 4)
+	{
+		uint64		mantissa = 0;
+		int			exp10;
+		int			i;
+
+		for (i = 0; i < ndigits; i++)
+			mantissa = mantissa * PLR_NUMERIC_NBASE + digits[i];
+		exp10 = (weight - ndigits + 1) * PLR_NUMERIC_DEC_DIGITS;
+
+		if (mantissa <= (UINT64CONST(1) << 53) &&
+			exp10 >= -PLR_MAX_EXACT_POW10 && exp10 <= PLR_MAX_EXACT_POW10)
+		{
+			if (exp10 < 0)
+				result = (double) mantissa / plr_exact_pow10[-exp10];
+			else
+				result = (double) mantissa * plr_exact_pow10[exp10];
+			if (neg)
+				result = -result;
+			done = true;
+		}
+	}
+
+	/* short varlena headers are expanded into a copy */
+	if (num != (Numeric) DatumGetPointer(value))
+		pfree(num);
+	if (done)
+		return result;
+#endif
+
+	str = DatumGetCString(DirectFunctionCall1(numeric_out, value));
+	result = strtod(str, NULL);
+	pfree(str);
+
+	return result;
+}
+
+/*
+ * given a single non-array pg value of a type for which pg_native_r_type()
+ * is true, convert it from its binary form into element elnum of obj, a
+ * vector made by get_r_vector()
+ */
+static void
+pg_datum_get_one_r(Datum value, bool isnull, Oid typtype, SEXP obj, int elnum)
+{
+	if (isnull)
+	{
+		if (typtype == INT8OID)
+			PLR_INT64_DATA(obj)[elnum] = PLR_NA_INTEGER64;
+		else
+			NUMERIC_DATA(obj)[elnum] = NA_REAL;
+		return;
+	}
+
+	switch (typtype)
+	{
+		case INT8OID:
+			PLR_INT64_DATA(obj)[elnum] = DatumGetInt64(value);
+			break;
+		case DATEOID:
+			NUMERIC_DATA(obj)[elnum] = date_get_r(DatumGetDateADT(value));
+			break;
+		case TIMESTAMPOID:
+			NUMERIC_DATA(obj)[elnum] = timestamp_get_r(DatumGetTimestamp(value));
+			break;
+		case TIMESTAMPTZOID:
+			NUMERIC_DATA(obj)[elnum] = timestamp_get_r(DatumGetTimestampTz(value));
+			break;
+		case INTERVALOID:
+			NUMERIC_DATA(obj)[elnum] = interval_get_r(DatumGetIntervalP(value));
+			break;
+		case NUMERICOID:
+			NUMERIC_DATA(obj)[elnum] = numeric_get_r(value);
+			break;
+		default:
+			elog(ERROR, "no binary conversion to R for type %u", typtype);
+	}
+}
+
+/*
+ * given an R value, convert to its pg representation
+ */
+Datum
+r_get_pg(SEXP rval, plr_function *function, FunctionCallInfo fcinfo)
+{
+	bool	isnull = false;
+	Datum	result;
+
+	if (function->result_typid != BYTEAOID &&
+		(TYPEOF(rval) == CLOSXP ||
+		 TYPEOF(rval) == PROMSXP ||
+		 TYPEOF(rval) == LANGSXP ||
+		 TYPEOF(rval) == ENVSXP))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("incorrect function return type"),
+				 errdetail("R return value type cannot be mapped to PostgreSQL return type."),
+				 errhint("Try BYTEA as the PostgreSQL return type.")));
+
+	if (CALLED_AS_TRIGGER(fcinfo))
+		result = get_trigger_tuple(rval, function, fcinfo, &isnull);
+	else if (function->result_istuple || fcinfo->flinfo->fn_retset)
+		result = get_tuplestore(rval, function, fcinfo, &isnull);
+	else
+	{
+		/* short circuit if return value is Null */
+		if (rval == R_NilValue || isNull(rval))	/* probably redundant */
+		{
+			fcinfo->isnull = true;
+			return (Datum) 0;
+		}
+
+		if (function->result_elem == 0)
+			result = get_scalar_datum(rval, function->result_typid, function->result_in_func, &isnull);
+		else
+			result = get_array_datum(rval, function, 0, &isnull);
+
+	}
+
+	if (isnull)
+		fcinfo->isnull = true;
+
+	return result;
+}
+
+/*
+ * Similar to r_get_pg, given an R value, convert to its pg representation
+ * Other than scalar, currently only prepared to be used with simple 1D vector
+ */
+Datum
+get_datum(SEXP rval, Oid typid, Oid typelem, FmgrInfo in_func, bool *isnull)
+{
+	Datum	result;
+
+	/* short circuit if return value is Null */
+	if (rval == R_NilValue || isNull(rval))	/* probably redundant */
+	{
+		*isnull = true;
+		return (Datum) 0;
+	}
+
+	if (typelem == InvalidOid)
+		result = get_scalar_datum(rval, typid, in_func, isnull);
+	else
+		result = get_simple_array_datum(rval, typelem, isnull);
+
+	return result;
+}
+
+/*
+ * seconds per unit of a difftime, or 0 if its units are unknown
+ */
+static double
+difftime_scale(SEXP rval)
+{
+	SEXP		units = getAttrib(rval, install("units"));
+	const char *u;
+
+	if (TYPEOF(units) != STRSXP || length(units) != 1)
+		return 0;
+
+	u = CHAR(STRING_ELT(units, 0));
+	if (strcmp(u, "secs") == 0)
+		return 1;
+	else if (strcmp(u, "mins") == 0)
+		return SECS_PER_MINUTE;
+	else if (strcmp(u, "hours") == 0)
+		return SECS_PER_HOUR;
+	else if (strcmp(u, "days") == 0)
+		return SECS_PER_DAY;
+	else if (strcmp(u, "weeks") == 0)
+		return 7 * SECS_PER_DAY;
+
+	return 0;
+}
+
+/*
+ * the time zone a POSIXct is displayed in, as a text datum, or 0 if it has
+ * none and so is displayed in local time
+ */
+static Datum
+posixct_zone(SEXP rval)
+{
+	SEXP		tzone = getAttrib(rval, install("tzone"));
+	const char *tzname;
+
+	if (TYPEOF(tzone) != STRSXP || length(tzone) < 1 ||
+		STRING_ELT(tzone, 0) == NA_STRING)
+		return (Datum) 0;
+
+	tzname = CHAR(STRING_ELT(tzone, 0));
+	if (*tzname == '\0')
+		return (Datum) 0;
+
+	return DirectFunctionCall1(textin, CStringGetDatum(tzname));
+}
+
+/*
+ * Decide whether the values of the non-empty R vector rval convert to pg
+ * type typid from their binary form, and if so how, in conv. R values of
+ * classes with an unambiguous pg counterpart qualify: if plr.native_datetime
+ * is on, Date for date, POSIXct for timestamp and timestamptz, and difftime
+ * for interval; and numeric and integer vectors, other than factors, for
+ * numeric.
+ * bit64 integer64 vectors, whose character form is meaningless, convert
+ * to int8 and the integer, floating point, numeric and text types.
+ */
+static bool
+get_r_pg_conv(SEXP rval, Oid typid, int32 typmod, r_pg_conv *conv)
+{
+	conv->kind = R_PG_CONV_NONE;
+	conv->typid = typid;
+	conv->typmod = typmod;
+	conv->scale = 1;
+	conv->zone = (Datum) 0;
+
+	if ((TYPEOF(rval) != REALSXP && TYPEOF(rval) != INTSXP) ||
+		length(rval) < 1)
+		return false;
+
+	if (PLR_IS_INTEGER64(rval))
+	{
+		switch (typid)
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case FLOAT4OID:
+			case FLOAT8OID:
+			case NUMERICOID:
+			case TEXTOID:
+				conv->kind = R_PG_CONV_INT64;
+				break;
+			default:
+				break;
+		}
+		return conv->kind != R_PG_CONV_NONE;
+	}
+
+	switch (typid)
+	{
+		case DATEOID:
+			if (plr_native_datetime && inherits(rval, "Date"))
+				conv->kind = R_PG_CONV_DATE;
+			break;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			if (plr_native_datetime && inherits(rval, "POSIXct"))
+			{
+				conv->kind = R_PG_CONV_TIMESTAMP;
+				if (typid == TIMESTAMPOID)
+					conv->zone = posixct_zone(rval);
+			}
+			break;
+		case INTERVALOID:
+			if (plr_native_datetime && inherits(rval, "difftime") &&
+				(conv->scale = difftime_scale(rval)) > 0)
+				conv->kind = R_PG_CONV_INTERVAL;
+			break;
+		case NUMERICOID:
+			if (!isFactor(rval))
+				conv->kind = R_PG_CONV_NUMERIC;
+			break;
+		default:
+			break;
+	}
+
+	return conv->kind != R_PG_CONV_NONE;
+}
+
+static DateADT
+r_get_date(double value)
+{
+	DateADT		result;
+	double		days;
+
+#ifdef DATE_NOT_FINITE
+	if (!R_FINITE(value))
+	{
+		if (value < 0)
+			DATE_NOBEGIN(result);
+		else
+			DATE_NOEND(result);
+		return result;
+	}
+#endif
+
+	days = floor(value) - PLR_EPOCH_DAYS;
+	if (!R_FINITE(days) || days < INT_MIN || days > INT_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("date out of range")));
+
+	result = (DateADT) days;
+#ifdef IS_VALID_DATE
+	if (!IS_VALID_DATE(result))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("date out of range")));
+#endif
+
+	return result;
+}
+
+/*
+ * POSIXct values count UTC seconds, so this is a timestamptz; see
+ * r_pg_conv_value() for timestamp without time zone
+ */
+static Timestamp
+r_get_timestamp(double value)
+{
+	Timestamp	result;
+#ifdef PLR_INT64_TIMESTAMP
+	double		secs;
+#endif
+
+	if (!R_FINITE(value))
+	{
+		if (value < 0)
+			TIMESTAMP_NOBEGIN(result);
+		else
+			TIMESTAMP_NOEND(result);
+		return result;
+	}
+
+#ifdef PLR_INT64_TIMESTAMP
+	/* about the largest number of seconds int64 microseconds can hold */
+	secs = floor(value);
+	if (secs < -9.2e12 || secs > 9.2e12)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("timestamp out of range")));
+
+	result = ((int64) secs - PLR_EPOCH_SECS) * USECS_PER_SEC +
+		(int64) rint((value - secs) * USECS_PER_SEC);
+#else
+	result = value - PLR_EPOCH_SECS;
+#endif
+
+#ifdef IS_VALID_TIMESTAMP
+	if (!IS_VALID_TIMESTAMP(result))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("timestamp out of range")));
+#endif
+
+	return result;
+}
+
+/*
+ * difftime values become intervals of seconds only, without days or months
+ */
+static Interval *
+r_get_interval(double value)
+{
+	Interval   *result = (Interval *) palloc(sizeof(Interval));
+#ifdef PLR_INT64_TIMESTAMP
+	double		secs;
+#endif
+
+	result->month = 0;
+	result->day = 0;
+
+	if (!R_FINITE(value))
+	{
+#ifdef INTERVAL_NOT_FINITE
+		if (value < 0)
+			INTERVAL_NOBEGIN(result);
+		else
+			INTERVAL_NOEND(result);
+		return result;
+#else
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("interval out of range")));
+#endif
+	}
+
+#ifdef PLR_INT64_TIMESTAMP
+	secs = floor(value);
+	if (secs < -9.2e12 || secs > 9.2e12)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("interval out of range")));
+
+	result->time = (int64) secs * USECS_PER_SEC +
+		(int64) rint((value - secs) * USECS_PER_SEC);
+#else
+	result->time = value;
+#endif
+
+	return result;
+}
+
+/*
+ * Integral values below 2^53 convert exactly. Other values keep 15
+ * significant digits, as as.character() would have given them.
+ */
+static Datum
+r_get_numeric(double value)
+{
+	if (value == floor(value) && fabs(value) < 9007199254740992.0)
+		return DirectFunctionCall1(int8_numeric, Int64GetDatum((int64) value));
+
+	return DirectFunctionCall1(float8_numeric, Float8GetDatum(value));
+}
+
+/*
+ * integer64 values are cast from int8 as SQL casts would, so that values
+ * out of range of int2 and int4 raise the same errors
+ */
+static Datum
+r_get_int64(r_pg_conv *conv, int64 value)
+{
+	Datum		result = Int64GetDatum(value);
+
+	switch (conv->typid)
+	{
+		case INT2OID:
+			return DirectFunctionCall1(int82, result);
+		case INT4OID:
+			return DirectFunctionCall1(int84, result);
+		case FLOAT4OID:
+			return DirectFunctionCall1(i8tof, result);
+		case FLOAT8OID:
+			return DirectFunctionCall1(i8tod, result);
+		case NUMERICOID:
+			result = DirectFunctionCall1(int8_numeric, result);
+			if (conv->typmod >= 0)
+				result = DirectFunctionCall2(numeric, result,
+											 Int32GetDatum(conv->typmod));
+			return result;
+		case TEXTOID:
+			return DirectFunctionCall1(textin,
+									   DirectFunctionCall1(int8out, result));
+		default:
+			return result;
+	}
+}
+
+/*
+ * Convert element i of rval, as decided by get_r_pg_conv()
+ */
+static void
+r_pg_conv_value(r_pg_conv *conv, SEXP rval, int i, Datum *dvalue, bool *isnull)
+{
+	double		value;
+
+	if (conv->kind == R_PG_CONV_INT64)
+	{
+		int64		ivalue = PLR_INT64_DATA(rval)[i];
+
+		*isnull = (ivalue == PLR_NA_INTEGER64);
+		*dvalue = *isnull ? (Datum) 0 : r_get_int64(conv, ivalue);
+		return;
+	}
+
+	if (TYPEOF(rval) == INTSXP)
+		value = (INTEGER(rval)[i] == NA_INTEGER) ? NA_REAL : INTEGER(rval)[i];
+	else
+		value = REAL(rval)[i];
+
+	/* NA and, but for numeric which has its own, NaN alike */
+	if (conv->kind == R_PG_CONV_NUMERIC ? ISNA(value) : ISNAN(value))
+	{
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return;
+	}
+
+	*isnull = false;
+	switch (conv->kind)
+	{
+		case R_PG_CONV_DATE:
+			*dvalue = DateADTGetDatum(r_get_date(value));
+			break;
+		case R_PG_CONV_TIMESTAMP:
+			*dvalue = TimestampGetDatum(r_get_timestamp(value));
+
+			/*
+			 * timestamp without time zone takes the wall clock time the
+			 * POSIXct displays, as its character form would: in its tzone,
+			 * or in the session's time zone if it has none
+			 */
+			if (conv->typid == TIMESTAMPOID)
+			{
+				if (conv->zone != (Datum) 0)
+					*dvalue = DirectFunctionCall2(timestamptz_zone,
+												  conv->zone, *dvalue);
+				else
+					*dvalue = DirectFunctionCall1(timestamptz_timestamp,
+												  *dvalue);
+			}
+			if (conv->typmod >= 0)
+				*dvalue = DirectFunctionCall2(conv->typid == TIMESTAMPOID ?
+											  timestamp_scale : timestamptz_scale,
+											  *dvalue,
+											  Int32GetDatum(conv->typmod));
+			break;
+		case R_PG_CONV_INTERVAL:
+			*dvalue = IntervalPGetDatum(r_get_interval(value * conv->scale));
+			if (conv->typmod >= 0)
+				*dvalue = DirectFunctionCall2(interval_scale, *dvalue,
+											  Int32GetDatum(conv->typmod));
+			break;
+		case R_PG_CONV_NUMERIC:
+			*dvalue = r_get_numeric(value);
+			if (conv->typmod >= 0)
+				*dvalue = DirectFunctionCall2(numeric, *dvalue,
+											  Int32GetDatum(conv->typmod));
+			break;
+		default:
+			elog(ERROR, "unrecognized R conversion: %d", (int) conv->kind);
+	}
+}
+
+/*
+ * BuildTupleFromCStrings() for a tuple of which the columns with a
+ * conversion in convs already are in dvalues and nulls
+ */
+static HeapTuple
+build_tuple_from_r_values(AttInMetadata *attinmeta, char **values,
+						  Datum *dvalues, bool *nulls, r_pg_conv *convs)
+{
+	TupleDesc	tupdesc = attinmeta->tupdesc;
+	int			i;
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		if (convs[i].kind != R_PG_CONV_NONE)
+			continue;
+
+		if (tupdesc->attrs[i]->attisdropped)
+		{
+			dvalues[i] = (Datum) 0;
+			nulls[i] = true;
+			continue;
+		}
+
+		dvalues[i] = InputFunctionCall(&attinmeta->attinfuncs[i],
+									   values[i],
+									   attinmeta->attioparams[i],
+									   attinmeta->atttypmods[i]);
+		nulls[i] = (values[i] == NULL);
+	}
+
+	return heap_form_tuple(tupdesc, dvalues, nulls);
+}
+
+/*
+ * Pick a native converter for binding R values to parameters of type typid,
+ * or NULL if values of that type must go through the type's input function.
+ * Intended to be called once, e.g. when a plan is prepared, with the result
+ * cached alongside the parameter type.
+ */
+plr_native_conv
+get_native_datum_conv(Oid typid)
+{
+	switch (typid)
+	{
+		case INT2OID:
+			return native_int2_datum;
+		case INT4OID:
+			return native_int4_datum;
+		case OIDOID:
+			return native_oid_datum;
+		case INT8OID:
+			return native_int8_datum;
+		case FLOAT4OID:
+			return native_float4_datum;
+		case FLOAT8OID:
+			return native_float8_datum;
+		case BOOLOID:
+			return native_bool_datum;
+		case TEXTOID:
+			return native_text_datum;
+		case DATEOID:
+			return native_date_datum;
+		case TIMESTAMPOID:
+			return native_timestamp_datum;
+		case TIMESTAMPTZOID:
+			return native_timestamptz_datum;
+		case INTERVALOID:
+			return native_interval_datum;
+		case NUMERICOID:
+			return native_numeric_datum;
+		default:
+			/* everything else, including BYTEA, uses get_datum() */
+			return NULL;
+	}
+}
+
+/*
+ * The native converters only deal with plain, non-empty atomic vectors
+ * whose R storage type maps exactly onto the target pg type. Anything else
+ * (factors, NULL, lists, lossy numeric conversions) is handed back to the
+ * generic text based path so that error behavior is unchanged.
+ */
+#define NATIVE_CONV_OK(rval_) \
+	((rval_) != R_NilValue && length(rval_) > 0 && !isFactor(rval_))
+
+static bool
+native_int2_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	int		value;
+
+	/* integer64 values, see get_r_pg_conv() */
+	if (PLR_IS_INTEGER64(rval))
+		return native_r_pg_datum(rval, INT2OID, dvalue, isnull);
+
+	if (!NATIVE_CONV_OK(rval) ||
+		(TYPEOF(rval) != INTSXP && TYPEOF(rval) != LGLSXP))
+		return false;
+
+	value = INTEGER(rval)[0];
+	if (value == NA_INTEGER)
+	{
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return true;
+	}
+
+	/* let int2in complain about out of range values */
+	if (value < SHRT_MIN || value > SHRT_MAX)
+		return false;
+
+	*isnull = false;
+	*dvalue = Int16GetDatum((int16) value);
+	return true;
+}
+
+static bool
+native_int4_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	int		value;
+
+	/* integer64 values, see get_r_pg_conv() */
+	if (PLR_IS_INTEGER64(rval))
+		return native_r_pg_datum(rval, INT4OID, dvalue, isnull);
+
+	if (!NATIVE_CONV_OK(rval) ||
+		(TYPEOF(rval) != INTSXP && TYPEOF(rval) != LGLSXP))
+		return false;
+
+	value = INTEGER(rval)[0];
+	if (value == NA_INTEGER)
+	{
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return true;
+	}
+
+	*isnull = false;
+	*dvalue = Int32GetDatum((int32) value);
+	return true;
+}
+
+static bool
+native_oid_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	int		value;
+
+	if (!NATIVE_CONV_OK(rval) || TYPEOF(rval) != INTSXP)
+		return false;
+
+	value = INTEGER(rval)[0];
+	if (value == NA_INTEGER)
+	{
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return true;
+	}
+
+	/* negative values would be rejected by oidin */
+	if (value < 0)
+		return false;
+
+	*isnull = false;
+	*dvalue = ObjectIdGetDatum((Oid) value);
+	return true;
+}
+
+static bool
+native_int8_datum(SEXP rval, Datum *dvalue, bool *isnull)
 {
-	bool	isnull = false;
-	Datum	result;
+	int		value;
 
-	if (function->result_typid != BYTEAOID &&
-		(TYPEOF(rval) == CLOSXP ||
-		 TYPEOF(rval) == PROMSXP ||
-		 TYPEOF(rval) == LANGSXP ||
-		 TYPEOF(rval) == ENVSXP))
-		ereport(ERROR,
-				(errcode(ERRCODE_DATA_EXCEPTION),
-				 errmsg("incorrect function return type"),
-				 errdetail("R return value type cannot be mapped to PostgreSQL return type."),
-				 errhint("Try BYTEA as the PostgreSQL return type.")));
+	/* integer64 values, see get_r_pg_conv() */
+	if (PLR_IS_INTEGER64(rval))
+		return native_r_pg_datum(rval, INT8OID, dvalue, isnull);
 
-	if (CALLED_AS_TRIGGER(fcinfo))
-		result = get_trigger_tuple(rval, function, fcinfo, &isnull);
-	else if (function->result_istuple || fcinfo->flinfo->fn_retset)
-		result = get_tuplestore(rval, function, fcinfo, &isnull);
-	else
+	if (!NATIVE_CONV_OK(rval) ||
+		(TYPEOF(rval) != INTSXP && TYPEOF(rval) != LGLSXP))
+		return false;
+
+	value = INTEGER(rval)[0];
+	if (value == NA_INTEGER)
 	{
-		/* short circuit if return value is Null */
-		if (rval == R_NilValue || isNull(rval))	/* probably redundant */
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return true;
+	}
+
+	*isnull = false;
+	*dvalue = Int64GetDatum((int64) value);
+	return true;
+}
+
+static bool
+native_float4_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	double	value;
+
+	/* integer64 values, see get_r_pg_conv() */
+	if (PLR_IS_INTEGER64(rval))
+		return native_r_pg_datum(rval, FLOAT4OID, dvalue, isnull);
+
+	if (!NATIVE_CONV_OK(rval))
+		return false;
+
+	if (TYPEOF(rval) == REALSXP)
+	{
+		value = REAL(rval)[0];
+		if (ISNA(value))
 		{
-			fcinfo->isnull = true;
-			return (Datum) 0;
+			*isnull = true;
+			*dvalue = (Datum) 0;
+			return true;
 		}
+	}
+	else if (TYPEOF(rval) == INTSXP)
+	{
+		if (INTEGER(rval)[0] == NA_INTEGER)
+		{
+			*isnull = true;
+			*dvalue = (Datum) 0;
+			return true;
+		}
+		value = (double) INTEGER(rval)[0];
+	}
+	else
+		return false;
 
-		if (function->result_elem == 0)
-			result = get_scalar_datum(rval, function->result_typid, function->result_in_func, &isnull);
-		else
-			result = get_array_datum(rval, function, 0, &isnull);
+	/* like float4in(), reject values a float4 cannot hold */
+	if (isinf((float4) value) && !isinf(value))
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("value out of range: overflow")));
+	if ((float4) value == 0 && value != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("value out of range: underflow")));
+
+	*isnull = false;
+	*dvalue = Float4GetDatum((float4) value);
+	return true;
+}
+
+static bool
+native_float8_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	double	value;
+
+	/* integer64 values, see get_r_pg_conv() */
+	if (PLR_IS_INTEGER64(rval))
+		return native_r_pg_datum(rval, FLOAT8OID, dvalue, isnull);
 
+	if (!NATIVE_CONV_OK(rval))
+		return false;
+
+	if (TYPEOF(rval) == REALSXP)
+	{
+		value = REAL(rval)[0];
+		if (ISNA(value))
+		{
+			*isnull = true;
+			*dvalue = (Datum) 0;
+			return true;
+		}
+	}
+	else if (TYPEOF(rval) == INTSXP)
+	{
+		if (INTEGER(rval)[0] == NA_INTEGER)
+		{
+			*isnull = true;
+			*dvalue = (Datum) 0;
+			return true;
+		}
+		value = (double) INTEGER(rval)[0];
 	}
+	else
+		return false;
 
-	if (isnull)
-		fcinfo->isnull = true;
+	*isnull = false;
+	*dvalue = Float8GetDatum(value);
+	return true;
+}
 
-	return result;
+static bool
+native_bool_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	int		value;
+
+	if (!NATIVE_CONV_OK(rval) || TYPEOF(rval) != LGLSXP)
+		return false;
+
+	value = LOGICAL(rval)[0];
+	if (value == NA_LOGICAL)
+	{
+		*isnull = true;
+		*dvalue = (Datum) 0;
+		return true;
+	}
+
+	*isnull = false;
+	*dvalue = BoolGetDatum(value ? true : false);
+	return true;
 }
 
-/*
- * Similar to r_get_pg, given an R value, convert to its pg representation
- * Other than scalar, currently only prepared to be used with simple 1D vector
- */
-Datum
-get_datum(SEXP rval, Oid typid, Oid typelem, FmgrInfo in_func, bool *isnull)
+static bool
+native_text_datum(SEXP rval, Datum *dvalue, bool *isnull)
 {
-	Datum	result;
+	SEXP		el;
+	const char *value;
+	int			len;
+	text	   *result;
 
-	/* short circuit if return value is Null */
-	if (rval == R_NilValue || isNull(rval))	/* probably redundant */
+	if (!NATIVE_CONV_OK(rval) || TYPEOF(rval) != STRSXP)
+		return false;
+
+	el = STRING_ELT(rval, 0);
+	if (el == NA_STRING)
 	{
 		*isnull = true;
-		return (Datum) 0;
+		*dvalue = (Datum) 0;
+		return true;
 	}
 
-	if (typelem == InvalidOid)
-		result = get_scalar_datum(rval, typid, in_func, isnull);
-	else
-		result = get_simple_array_datum(rval, typelem, isnull);
+	/* build the text datum directly from the CHARSXP bytes */
+	value = CHAR(el);
+	len = strlen(value);
+	result = (text *) palloc(len + VARHDRSZ);
+	SET_VARSIZE(result, len + VARHDRSZ);
+	memcpy(VARDATA(result), value, len);
 
-	return result;
+	*isnull = false;
+	*dvalue = PointerGetDatum(result);
+	return true;
+}
+
+/* Date, POSIXct, difftime, numeric and integer64 values, see get_r_pg_conv() */
+static bool
+native_r_pg_datum(SEXP rval, Oid typid, Datum *dvalue, bool *isnull)
+{
+	r_pg_conv	conv;
+
+	if (!NATIVE_CONV_OK(rval) || !get_r_pg_conv(rval, typid, -1, &conv))
+		return false;
+
+	r_pg_conv_value(&conv, rval, 0, dvalue, isnull);
+	return true;
+}
+
+static bool
+native_date_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	return native_r_pg_datum(rval, DATEOID, dvalue, isnull);
+}
+
+static bool
+native_timestamp_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	return native_r_pg_datum(rval, TIMESTAMPOID, dvalue, isnull);
+}
+
+static bool
+native_timestamptz_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	return native_r_pg_datum(rval, TIMESTAMPTZOID, dvalue, isnull);
+}
+
+static bool
+native_interval_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	return native_r_pg_datum(rval, INTERVALOID, dvalue, isnull);
+}
+
+static bool
+native_numeric_datum(SEXP rval, Datum *dvalue, bool *isnull)
+{
+	return native_r_pg_datum(rval, NUMERICOID, dvalue, isnull);
 }
 
 static Datum
@@ -923,6 +3209,128 @@ get_trigger_tuple(SEXP rval, plr_function *function, FunctionCallInfo fcinfo, bo
 	}
 }
 
+/*
+ * Given the value returned by a row trigger and the data.frame it got as
+ * pg.tg.new for newtuple, build the tuple to return by replacing only the
+ * columns the R code changed. R copies on modify, so an unchanged column,
+ * or an unchanged frame, is still the very same object. Returns false if
+ * rval does not look like a modified pg.tg.new, leaving it to
+ * get_trigger_tuple().
+ */
+bool
+get_trigger_modified_tuple(SEXP rval, SEXP newframe, HeapTuple newtuple,
+						   TupleDesc tupdesc, HeapTuple *result)
+{
+	int			natts = tupdesc->natts;
+	Datum	   *repl_values;
+	bool	   *repl_nulls;
+	bool	   *do_replace;
+	bool		changed = false;
+	int			df_colnum = 0;
+	int			j;
+
+	/* NEW returned untouched */
+	if (rval == newframe)
+	{
+		*result = newtuple;
+		return true;
+	}
+
+	if (newframe == R_NilValue || !isFrame(rval) ||
+		length(rval) != length(newframe))
+		return false;
+
+	repl_values = (Datum *) palloc(natts * sizeof(Datum));
+	repl_nulls = (bool *) palloc(natts * sizeof(bool));
+	do_replace = (bool *) palloc0(natts * sizeof(bool));
+
+	for (j = 0; j < natts; j++)
+	{
+		Oid				atttypid;
+		SEXP			dfcol;
+		plr_native_conv	conv;
+
+		if (tupdesc->attrs[j]->attisdropped)
+			continue;
+
+		dfcol = VECTOR_ELT(rval, df_colnum);
+		if (dfcol == VECTOR_ELT(newframe, df_colnum++))
+			continue;
+
+		/* a changed column must still hold exactly one value */
+		if (length(dfcol) != 1)
+			break;
+
+		atttypid = tupdesc->attrs[j]->atttypid;
+		if (get_element_type(atttypid) != InvalidOid)
+			break;
+
+		/*
+		 * the native converters know nothing of typmods, so columns that
+		 * have one go through the input function
+		 */
+		conv = NULL;
+		if (tupdesc->attrs[j]->atttypmod < 0)
+			conv = get_native_datum_conv(atttypid);
+		if (conv == NULL ||
+			!conv(dfcol, &repl_values[j], &repl_nulls[j]))
+		{
+			/* through the input function, as get_trigger_tuple() would */
+			Oid			typinput;
+			Oid			typioparam;
+			FmgrInfo	in_func;
+			const char *value = NULL;
+
+			if (isFactor(dfcol))
+			{
+				int		idx = INTEGER(dfcol)[0];
+				SEXP	levels = getAttrib(dfcol, R_LevelsSymbol);
+
+				if (idx != NA_INTEGER)
+					value = pstrdup(CHAR(STRING_ELT(levels, idx - 1)));
+			}
+			else
+			{
+				SEXP	obj;
+
+				PROTECT(obj = coerce_to_char(dfcol));
+				if (STRING_ELT(obj, 0) != NA_STRING)
+					value = pstrdup(CHAR(STRING_ELT(obj, 0)));
+				UNPROTECT(1);
+			}
+
+			getTypeInputInfo(atttypid, &typinput, &typioparam);
+			fmgr_info(typinput, &in_func);
+			repl_values[j] = InputFunctionCall(&in_func, (char *) value,
+											   typioparam,
+											   tupdesc->attrs[j]->atttypmod);
+			repl_nulls[j] = (value == NULL);
+		}
+		do_replace[j] = true;
+		changed = true;
+	}
+
+	if (j < natts)
+	{
+		pfree(repl_values);
+		pfree(repl_nulls);
+		pfree(do_replace);
+		return false;
+	}
+
+	if (!changed)
+		*result = newtuple;
+	else
+		*result = heap_modify_tuple(newtuple, tupdesc,
+									repl_values, repl_nulls, do_replace);
+
+	pfree(repl_values);
+	pfree(repl_nulls);
+	pfree(do_replace);
+
+	return true;
+}
+
 static Datum
 get_tuplestore(SEXP rval, plr_function *function, FunctionCallInfo fcinfo, bool *isnull)
 {
@@ -1004,15 +3412,19 @@ get_scalar_datum(SEXP rval, Oid result_typid, FmgrInfo result_in_func, bool *isn
 	Datum		dvalue;
 	SEXP		obj;
 	const char *value;
+	r_pg_conv	conv;
 
 	/*
 	 * Element type is zero, we don't have an array, so coerce to string
 	 * and take the first element as a scalar
 	 *
-	 * Exception: if result type is BYTEA, we want to return the whole
-	 * object in serialized form
+	 * Exceptions: if result type is BYTEA, we want to return the whole
+	 * object in serialized form, and R classes such as Date convert
+	 * without their character form
 	 */
-	if (result_typid != BYTEAOID)
+	if (get_r_pg_conv(rval, result_typid, -1, &conv))
+		r_pg_conv_value(&conv, rval, 0, &dvalue, isnull);
+	else if (result_typid != BYTEAOID)
 	{
 		PROTECT(obj = coerce_to_char(rval));
 		if (STRING_ELT(obj, 0) == NA_STRING)
@@ -1039,48 +3451,7 @@ get_scalar_datum(SEXP rval, Oid result_typid, FmgrInfo result_in_func, bool *isn
 		}
 	}
 	else
-	{
-		SEXP 	s, t;
-		int		len, rsize, status;
-		bytea  *result;
-		char   *rptr;
-
-		/*
-		 * Need to construct a call to
-		 * serialize(rval, NULL)
-		 */
-		PROTECT(t = s = allocList(3));
-		SET_TYPEOF(s, LANGSXP);
-		SETCAR(t, install("serialize")); t = CDR(t);
-		SETCAR(t, rval); t = CDR(t);
-		SETCAR(t, R_NilValue);
-
-		PROTECT(obj = R_tryEval(s, R_GlobalEnv, &status));
-		if(status != 0)
-		{
-			if (last_R_error_msg)
-				ereport(ERROR,
-						(errcode(ERRCODE_DATA_EXCEPTION),
-						 errmsg("R interpreter expression evaluation error"),
-						 errdetail("%s", last_R_error_msg)));
-			else
-				ereport(ERROR,
-						(errcode(ERRCODE_DATA_EXCEPTION),
-						 errmsg("R interpreter expression evaluation error"),
-						 errdetail("R expression evaluation error caught in \"serialize\".")));
-		}
-		len = LENGTH(obj);
-
-		rsize = VARHDRSZ + len;
-		result = (bytea *) palloc(rsize);
-		SET_VARSIZE(result, rsize);
-		rptr = VARDATA(result);
-		memcpy(rptr, (char *) RAW(obj), rsize - VARHDRSZ);
-
-		UNPROTECT(2);
-
-		dvalue = PointerGetDatum(result);
-	}
+		dvalue = PointerGetDatum(plr_serialize(rval));
 
 	return dvalue;
 }
@@ -1260,6 +3631,7 @@ get_simple_array_datum(SEXP rval, Oid typelem, bool *isnull)
 	bool	   *nulls;
 	bool		have_nulls = FALSE;
 	int			ndims = 1;
+	r_pg_conv	conv;
 
 	dims = palloc(ndims * sizeof(int));
 	lbs = palloc(ndims * sizeof(int));
@@ -1292,27 +3664,40 @@ get_simple_array_datum(SEXP rval, Oid typelem, bool *isnull)
 
 	dvalues = (Datum *) palloc(nitems * sizeof(Datum));
 	nulls = (bool *) palloc(nitems * sizeof(bool));
-	PROTECT(obj =  coerce_to_char(rval));
 
-	for (i = 0; i < nitems; i++)
+	if (get_r_pg_conv(rval, typelem, -1, &conv))
 	{
-		value = CHAR(STRING_ELT(obj, i));
-
-		if (STRING_ELT(obj, i) == NA_STRING || value == NULL)
+		for (i = 0; i < nitems; i++)
 		{
-			nulls[i] = TRUE;
-			have_nulls = TRUE;
+			r_pg_conv_value(&conv, rval, i, &dvalues[i], &nulls[i]);
+			if (nulls[i])
+				have_nulls = TRUE;
 		}
-		else
+	}
+	else
+	{
+		PROTECT(obj =  coerce_to_char(rval));
+
+		for (i = 0; i < nitems; i++)
 		{
-			nulls[i] = FALSE;
-			dvalues[i] = FunctionCall3(&in_func,
-										CStringGetDatum(value),
-										(Datum) 0,
-										Int32GetDatum(-1));
+			value = CHAR(STRING_ELT(obj, i));
+
+			if (STRING_ELT(obj, i) == NA_STRING || value == NULL)
+			{
+				nulls[i] = TRUE;
+				have_nulls = TRUE;
+			}
+			else
+			{
+				nulls[i] = FALSE;
+				dvalues[i] = FunctionCall3(&in_func,
+											CStringGetDatum(value),
+											(Datum) 0,
+											Int32GetDatum(-1));
+			}
 		}
+		UNPROTECT(1);
 	}
-	UNPROTECT(1);
 
 	if (!have_nulls)
 		array = construct_md_array(dvalues, NULL, ndims, dims, lbs,
@@ -1351,6 +3736,8 @@ get_md_array_datum(SEXP rval, int ndims, plr_function *function, int col, bool *
 	int			cntr = 0;
 	bool	   *nulls;
 	bool		have_nulls = FALSE;
+	bool		native;
+	r_pg_conv	conv;
 
 	if (ndims > 0)
 	{
@@ -1411,7 +3798,8 @@ get_md_array_datum(SEXP rval, int ndims, plr_function *function, int col, bool *
 	nitems = nr * nc * nz;
 	dvalues = (Datum *) palloc(nitems * sizeof(Datum));
 	nulls = (bool *) palloc(nitems * sizeof(bool));
-	PROTECT(obj =  coerce_to_char(rval));
+	native = get_r_pg_conv(rval, result_elem, -1, &conv);
+	PROTECT(obj = native ? rval : coerce_to_char(rval));
 
 	for (i = 0; i < nr; i++)
 	{
@@ -1422,6 +3810,15 @@ get_md_array_datum(SEXP rval, int ndims, plr_function *function, int col, bool *
 				int		arridx = cntr++;
 
 				idx = (k * nr * nc) + (j * nr) + i;
+				if (native)
+				{
+					r_pg_conv_value(&conv, rval, idx, &dvalues[arridx],
+									&nulls[arridx]);
+					if (nulls[arridx])
+						have_nulls = TRUE;
+					continue;
+				}
+
 				value = CHAR(STRING_ELT(obj, idx));
 
 				if (STRING_ELT(obj, idx) == NA_STRING || value == NULL)
@@ -1478,6 +3875,8 @@ get_generic_array_datum(SEXP rval, plr_function *function, int col, bool *isnull
 	bool		have_nulls = FALSE;
 	bool		fast_track_type;
 	bool		has_na = false;
+	bool		native;
+	r_pg_conv	conv;
 
 	if (function->result_istuple)
 	{
@@ -1521,6 +3920,25 @@ get_generic_array_datum(SEXP rval, plr_function *function, int col, bool *isnull
 			}
 			break;
 		case REALSXP:
+			/* integer64 vectors hold int64 values, see PLR_INT64_DATA */
+			if (inherits(rval, "integer64"))
+			{
+				if (result_elem == INT8OID)
+					fast_track_type = true;
+				else
+					fast_track_type = false;
+
+				for (i = 0; i < objlen; i++)
+				{
+					if (PLR_INT64_DATA(rval)[i] == PLR_NA_INTEGER64)
+					{
+						has_na = true;
+						break;
+					}
+				}
+				break;
+			}
+
 			if (result_elem == FLOAT8OID)
 				fast_track_type = true;
 			else
@@ -1586,11 +4004,20 @@ get_generic_array_datum(SEXP rval, plr_function *function, int col, bool *isnull
 		/* original code */
 		dvalues = (Datum *) palloc(objlen * sizeof(Datum));
 		nulls = (bool *) palloc(objlen * sizeof(bool));
-		PROTECT(obj =  coerce_to_char(rval));
+		native = get_r_pg_conv(rval, result_elem, -1, &conv);
+		PROTECT(obj = native ? rval : coerce_to_char(rval));
 
 		/* Loop is needed here as result value might be of length > 1 */
 		for(i = 0; i < objlen; i++)
 		{
+			if (native)
+			{
+				r_pg_conv_value(&conv, rval, i, &dvalues[i], &nulls[i]);
+				if (nulls[i])
+					have_nulls = TRUE;
+				continue;
+			}
+
 			value = CHAR(STRING_ELT(obj, i));
 
 			if (STRING_ELT(obj, i) == NA_STRING || value == NULL)
@@ -1625,7 +4052,7 @@ get_generic_array_datum(SEXP rval, plr_function *function, int col, bool *isnull
 	return dvalue;
 }
 
-static Tuplestorestate *
+Tuplestorestate *
 get_frame_tuplestore(SEXP rval,
 					 plr_function *function,
 					 AttInMetadata *attinmeta,
@@ -1644,6 +4071,10 @@ get_frame_tuplestore(SEXP rval,
 	int					nc = length(rval);
 	SEXP				dfcol;
 	SEXP				result;
+	r_pg_conv		   *convs;
+	Datum			   *dvalues = NULL;
+	bool			   *nulls = NULL;
+	bool				have_convs = false;
 
 	if (nc != tupdesc_nc)
 		ereport(ERROR,
@@ -1678,12 +4109,23 @@ get_frame_tuplestore(SEXP rval,
 	else
 		nr = 1;
 
-	/* coerce columns to character in advance */
+	/*
+	 * coerce columns to character in advance, except for those converted
+	 * from their binary form
+	 */
+	convs = (r_pg_conv *) palloc0(nc * sizeof(r_pg_conv));
 	PROTECT(result = NEW_LIST(nc));
 	for (j = 0; j < nc; j++)
 	{
 		PROTECT(dfcol = VECTOR_ELT(rval, j));
-		if((!isFactor(dfcol)) &&
+		if (attrs[j]->attndims == 0 && !isFactor(dfcol) &&
+			get_r_pg_conv(dfcol, attrs[j]->atttypid, attrs[j]->atttypmod,
+						  &convs[j]))
+		{
+			SET_VECTOR_ELT(result, j, dfcol);
+			have_convs = true;
+		}
+		else if((!isFactor(dfcol)) &&
 		   ((attrs[j]->attndims == 0) ||
 			(TYPEOF(dfcol) != VECSXP)))
 		{
@@ -1732,6 +4174,11 @@ get_frame_tuplestore(SEXP rval,
 	}
 
 	values = (char **) palloc(nc * sizeof(char *));
+	if (have_convs)
+	{
+		dvalues = (Datum *) palloc(nc * sizeof(Datum));
+		nulls = (bool *) palloc(nc * sizeof(bool));
+	}
 
 	for(i = 0; i < nr; i++)
 	{
@@ -1739,7 +4186,12 @@ get_frame_tuplestore(SEXP rval,
 		{
 			PROTECT(dfcol = VECTOR_ELT(result, j));
 
-			if(isFactor(dfcol))
+			if (convs[j].kind != R_PG_CONV_NONE)
+			{
+				r_pg_conv_value(&convs[j], dfcol, i, &dvalues[j], &nulls[j]);
+				values[j] = NULL;
+			}
+			else if(isFactor(dfcol))
 			{
 				SEXP t;
 
@@ -1821,13 +4273,19 @@ get_frame_tuplestore(SEXP rval,
 		}
 
 		/* construct the tuple */
-		tuple = BuildTupleFromCStrings(attinmeta, values);
+		if (have_convs)
+			tuple = build_tuple_from_r_values(attinmeta, values, dvalues,
+											  nulls, convs);
+		else
+			tuple = BuildTupleFromCStrings(attinmeta, values);
 
 		/* switch to appropriate context while storing the tuple */
 		oldcontext = MemoryContextSwitchTo(per_query_ctx);
 
 		/* now store it */
 		tuplestore_puttuple(tupstore, tuple);
+		PLR_STAT_ADD(rows_out, 1);
+		PLR_STAT_ADD(bytes_out, tuple->t_len);
 
 		/* now reset the context */
 		MemoryContextSwitchTo(oldcontext);
@@ -1899,6 +4357,8 @@ get_matrix_tuplestore(SEXP rval,
 
 		/* now store it */
 		tuplestore_puttuple(tupstore, tuple);
+		PLR_STAT_ADD(rows_out, 1);
+		PLR_STAT_ADD(bytes_out, tuple->t_len);
 
 		/* now reset the context */
 		MemoryContextSwitchTo(oldcontext);
@@ -1927,6 +4387,9 @@ get_generic_tuplestore(SEXP rval,
 	int					nc = 1;
 	SEXP				obj;
 	int					i;
+	Form_pg_attribute	attr = attinmeta->tupdesc->attrs[0];
+	r_pg_conv			conv;
+	bool				native;
 
 	/* switch to appropriate context to create the tuple store */
 	oldcontext = MemoryContextSwitchTo(per_query_ctx);
@@ -1946,23 +4409,37 @@ get_generic_tuplestore(SEXP rval,
 	MemoryContextSwitchTo(oldcontext);
 
 	values = (char **) palloc(nc * sizeof(char *));
-	PROTECT(obj = coerce_to_char(rval));
+	native = get_r_pg_conv(rval, attr->atttypid, attr->atttypmod, &conv);
+	PROTECT(obj = native ? rval : coerce_to_char(rval));
 
 	for(i = 0; i < nr; i++)
 	{
-		if (STRING_ELT(obj, i) != NA_STRING)
-			values[0] = (char *) CHAR(STRING_ELT(obj, i));
+		/* construct the tuple */
+		if (native)
+		{
+			Datum	dvalue;
+			bool	isnull;
+
+			r_pg_conv_value(&conv, rval, i, &dvalue, &isnull);
+			tuple = heap_form_tuple(attinmeta->tupdesc, &dvalue, &isnull);
+		}
 		else
-			values[0] = (char *) NULL;
+		{
+			if (STRING_ELT(obj, i) != NA_STRING)
+				values[0] = (char *) CHAR(STRING_ELT(obj, i));
+			else
+				values[0] = (char *) NULL;
 
-		/* construct the tuple */
-		tuple = BuildTupleFromCStrings(attinmeta, values);
+			tuple = BuildTupleFromCStrings(attinmeta, values);
+		}
 
 		/* switch to appropriate context while storing the tuple */
 		oldcontext = MemoryContextSwitchTo(per_query_ctx);
 
 		/* now store it */
 		tuplestore_puttuple(tupstore, tuple);
+		PLR_STAT_ADD(rows_out, 1);
+		PLR_STAT_ADD(bytes_out, tuple->t_len);
 
 		/* now reset the context */
 		MemoryContextSwitchTo(oldcontext);
@@ -35,7 +35,14 @@
 extern MemoryContext plr_SPI_context;
 extern char *last_R_error_msg;
 
-static SEXP rpgsql_get_results(int ntuples, SPITupleTable *tuptable);
+/* rows fetched per cursor round trip while sampling */
+#define PLR_SAMPLE_FETCH_SIZE	1000
+
+static SEXP rpgsql_get_results(int ntuples, SPITupleTable *tuptable,
+							   bool array_matrix);
+static void get_limit_args(SEXP rlimit, SEXP rsample, int *count, bool *sample);
+static SEXP rpgsql_sample_results(const char *sql, void *plan, Datum *argvalues,
+								  char *nulls, int limit, bool array_matrix);
 static void rsupport_error_callback(void *arg);
 
 /* The information we cache prepared plans */
@@ -46,6 +53,7 @@ typedef struct saved_plan_desc
 	Oid		   *typeids;
 	Oid		   *typelems;
 	FmgrInfo   *typinfuncs;
+	plr_native_conv *typconvs;	/* per parameter native binding, or NULL */
 }	saved_plan_desc;
 
 /*
@@ -125,12 +133,14 @@ plr_quote_ident(SEXP rval)
  * plr_SPI_exec - The builtin SPI_exec command for the R interpreter
  */
 SEXP
-plr_SPI_exec(SEXP rsql)
+plr_SPI_exec(SEXP rsql, SEXP rlimit, SEXP rsample, SEXP rarray_matrix)
 {
 	int				spi_rc = 0;
 	char			buf[64];
 	const char	   *sql;
 	int				count = 0;
+	bool			sample = false;
+	bool			array_matrix;
 	int				ntuples;
 	SEXP			result = NULL;
 	MemoryContext	oldcontext;
@@ -145,6 +155,15 @@ plr_SPI_exec(SEXP rsql)
 	if (sql == NULL)
 		error("%s", "cannot exec empty query");
 
+	get_limit_args(rlimit, rsample, &count, &sample);
+	array_matrix = (asLogical(rarray_matrix) == TRUE);
+	if (sample)
+	{
+		result = rpgsql_sample_results(sql, NULL, NULL, NULL, count, array_matrix);
+		POP_PLERRCONTEXT;
+		return result;
+	}
+
 	/* switch to SPI memory context */
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 
@@ -154,8 +173,12 @@ plr_SPI_exec(SEXP rsql)
 	 */
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.exec");
+
 		/* Execute the query and handle return codes */
 		spi_rc = SPI_exec(sql, count);
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -190,7 +213,7 @@ plr_SPI_exec(SEXP rsql)
 			ntuples = SPI_processed;
 			if (ntuples > 0)
 			{
-				result = rpgsql_get_results(ntuples, SPI_tuptable);
+				result = rpgsql_get_results(ntuples, SPI_tuptable, array_matrix);
 				SPI_freetuptable(SPI_tuptable);
 			}
 			else
@@ -231,7 +254,7 @@ plr_SPI_exec(SEXP rsql)
 }
 
 static SEXP
-rpgsql_get_results(int ntuples, SPITupleTable *tuptable)
+rpgsql_get_results(int ntuples, SPITupleTable *tuptable, bool array_matrix)
 {
 	SEXP	result;
 	ERRORCONTEXTCALLBACK;
@@ -244,7 +267,9 @@ rpgsql_get_results(int ntuples, SPITupleTable *tuptable)
 		HeapTuple	   *tuples = tuptable->vals;
 		TupleDesc		tupdesc = tuptable->tupdesc;
 
-		result = pg_tuple_get_r_frame(ntuples, tuples, tupdesc);
+		PLR_STAT_ADD(rows_in, ntuples);
+
+		result = pg_tuple_get_r_frame(ntuples, tuples, tupdesc, array_matrix);
 	}
 	else
 		result = R_NilValue;
@@ -254,6 +279,165 @@ rpgsql_get_results(int ntuples, SPITupleTable *tuptable)
 	return result;
 }
 
+/*
+ * Parse the optional limit and sample arguments shared by pg.spi.exec and
+ * pg.spi.execp. A limit of zero means all rows; sampling needs a limit.
+ */
+static void
+get_limit_args(SEXP rlimit, SEXP rsample, int *count, bool *sample)
+{
+	*count = 0;
+	*sample = false;
+
+	if (rlimit != R_NilValue)
+	{
+		PROTECT(rlimit = AS_INTEGER(rlimit));
+		if (length(rlimit) > 0)
+			*count = INTEGER_DATA(rlimit)[0];
+		UNPROTECT(1);
+
+		if (*count == NA_INTEGER || *count < 0)
+			error("%s", "limit must be a non-negative integer");
+	}
+
+	if (rsample != R_NilValue && asLogical(rsample) == TRUE)
+	{
+		if (*count == 0)
+			error("%s", "sample requires a positive limit");
+		*sample = true;
+	}
+}
+
+/*
+ * Run a query through a cursor and keep a uniform random sample of at most
+ * limit of its rows, using reservoir sampling over the fetched batches. The
+ * full result is never materialized; at most limit tuples plus one batch
+ * are held at any time, and room for the kept tuples is only made as they
+ * arrive. Random numbers come from R's generator, so set.seed() makes the
+ * sample reproducible.
+ *
+ * Either sql or an already prepared plan (with its argument values) must
+ * be given.
+ */
+static SEXP
+rpgsql_sample_results(const char *sql, void *plan, Datum *argvalues,
+					  char *nulls, int limit, bool array_matrix)
+{
+	Portal			portal;
+	TupleDesc		tupdesc = NULL;
+	HeapTuple	   *reservoir = NULL;
+	int				nkept = 0;
+	int				nalloc = 0;
+	double			seen = 0;
+	int				i;
+	SEXP			result;
+	MemoryContext	oldcontext;
+	PREPARE_PG_TRY;
+
+	GetRNGstate();
+
+	/* switch to SPI memory context */
+	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
+
+	/*
+	 * trap elog/ereport so we can let R finish up gracefully
+	 * and generate the error once we exit the interpreter
+	 */
+	PG_TRY();
+	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, NULL);
+
+		if (plan == NULL)
+		{
+			plan = SPI_prepare(sql, 0, NULL);
+			if (plan == NULL)
+				elog(ERROR, "SPI_prepare() failed: %s",
+							SPI_result_code_string(SPI_result));
+		}
+
+		portal = SPI_cursor_open(NULL, plan, argvalues, nulls, false);
+		tupdesc = CreateTupleDescCopy(portal->tupDesc);
+
+		for (;;)
+		{
+			SPI_cursor_fetch(portal, true, PLR_SAMPLE_FETCH_SIZE);
+			if (SPI_processed == 0)
+				break;
+
+			for (i = 0; i < SPI_processed; i++)
+			{
+				HeapTuple	tuple = SPI_tuptable->vals[i];
+
+				seen += 1;
+				PLR_STAT_ADD(rows_in, 1);
+				if (nkept < limit)
+				{
+					/* the reservoir grows with the rows, up to limit */
+					if (nkept == nalloc)
+					{
+						if (nalloc == 0)
+						{
+							nalloc = Min(limit, PLR_SAMPLE_FETCH_SIZE);
+							reservoir = (HeapTuple *)
+								palloc(nalloc * sizeof(HeapTuple));
+						}
+						else
+						{
+							nalloc += Min(limit - nalloc, nalloc);
+							reservoir = (HeapTuple *)
+								repalloc(reservoir, nalloc * sizeof(HeapTuple));
+						}
+					}
+					reservoir[nkept++] = heap_copytuple(tuple);
+				}
+				else
+				{
+					/* replace a kept row with probability limit / seen */
+					double	j = floor(unif_rand() * seen);
+
+					if (j < limit)
+					{
+						heap_freetuple(reservoir[(int) j]);
+						reservoir[(int) j] = heap_copytuple(tuple);
+					}
+				}
+			}
+			SPI_freetuptable(SPI_tuptable);
+		}
+
+		SPI_cursor_close(portal);
+
+		plr_phase_end(phase_level);
+	}
+	PG_CATCH();
+	{
+		MemoryContext temp_context;
+		ErrorData  *edata;
+
+		SWITCHTO_PLR_SPI_CONTEXT(temp_context);
+		edata = CopyErrorData();
+		MemoryContextSwitchTo(temp_context);
+		plr_phase_unwind(PLR_PHASE_SPI);
+
+		/* keep the generator state the sample used up so far */
+		PutRNGstate();
+		error("error in SQL statement : %s", edata->message);
+	}
+	PLR_PG_END_TRY();
+
+	/* back to caller's memory context */
+	MemoryContextSwitchTo(oldcontext);
+
+	PutRNGstate();
+
+	if (nkept > 0)
+		result = pg_tuple_get_r_frame(nkept, reservoir, tupdesc, array_matrix);
+	else
+		result = R_NilValue;
+
+	return result;
+}
+
 /*
  * plr_SPI_prepare - The builtin SPI_prepare command for the R interpreter
  */
@@ -266,6 +450,7 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
 	Oid				   *typeids = NULL;
 	Oid				   *typelems = NULL;
 	FmgrInfo		   *typinfuncs = NULL;
+	plr_native_conv	   *typconvs = NULL;
 	void			   *pplan = NULL;
 	void			   *saved_plan;
 	saved_plan_desc	   *plan_desc;
@@ -310,6 +495,7 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
 		typeids = (Oid *) palloc(nargs * sizeof(Oid));
 		typelems = (Oid *) palloc(nargs * sizeof(Oid));
 		typinfuncs = (FmgrInfo *) palloc(nargs * sizeof(FmgrInfo));
+		typconvs = (plr_native_conv *) palloc(nargs * sizeof(plr_native_conv));
 
 		MemoryContextSwitchTo(oldcontext);
 
@@ -337,6 +523,9 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
 			/* perm_fmgr_info already uses TopMemoryContext */
 			perm_fmgr_info(typinput, &typinfunc);
 			typinfuncs[i] = typinfunc;
+
+			/* pick the native binding for this slot once, up front */
+			typconvs[i] = get_native_datum_conv(typeids[i]);
 		}
 	}
 	else
@@ -353,8 +542,12 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
 	 */
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.prepare");
+
 		/* Prepare plan for query */
 		pplan = SPI_prepare(sql, nargs, typeids);
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -438,6 +631,7 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
 	plan_desc->typeids = typeids;
 	plan_desc->typelems = typelems;
 	plan_desc->typinfuncs = typinfuncs;
+	plan_desc->typconvs = typconvs;
 
 	result = R_MakeExternalPtr(plan_desc, R_NilValue, R_NilValue);
 
@@ -449,7 +643,8 @@ plr_SPI_prepare(SEXP rsql, SEXP rargtypes)
  * plr_SPI_execp - The builtin SPI_execp command for the R interpreter
  */
 SEXP
-plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
+plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues, SEXP rlimit, SEXP rsample,
+			  SEXP rarray_matrix)
 {
 	saved_plan_desc	   *plan_desc = (saved_plan_desc *) R_ExternalPtrAddr(rsaved_plan);
 	void			   *saved_plan = plan_desc->saved_plan;
@@ -457,6 +652,7 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 	Oid				   *typeids = plan_desc->typeids;
 	Oid				   *typelems = plan_desc->typelems;
 	FmgrInfo		   *typinfuncs = plan_desc->typinfuncs;
+	plr_native_conv	   *typconvs = plan_desc->typconvs;
 	int					i;
 	Datum			   *argvalues = NULL;
 	char			   *nulls = NULL;
@@ -465,6 +661,8 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 	int					spi_rc = 0;
 	char				buf[64];
 	int					count = 0;
+	bool				sample = false;
+	bool				array_matrix;
 	int					ntuples;
 	SEXP				result = NULL;
 	MemoryContext		oldcontext;
@@ -473,6 +671,9 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 	/* set up error context */
 	PUSH_PLERRCONTEXT(rsupport_error_callback, "pg.spi.execp");
 
+	get_limit_args(rlimit, rsample, &count, &sample);
+	array_matrix = (asLogical(rarray_matrix) == TRUE);
+
 	if (nargs > 0)
 	{
 		if (!Rf_isVectorList(rargvalues))
@@ -492,7 +693,10 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 	{
 		PROTECT(obj = VECTOR_ELT(rargvalues, i));
 
-		argvalues[i] = get_datum(obj, typeids[i], typelems[i], typinfuncs[i], &isnull);
+		isnull = false;
+		if (typconvs[i] == NULL ||
+			!(*typconvs[i]) (obj, &argvalues[i], &isnull))
+			argvalues[i] = get_datum(obj, typeids[i], typelems[i], typinfuncs[i], &isnull);
 		if (!isnull)
 			nulls[i] = ' ';
 		else
@@ -501,6 +705,14 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 		UNPROTECT(1);
 	}
 
+	if (sample)
+	{
+		result = rpgsql_sample_results(NULL, saved_plan, argvalues, nulls, count,
+									   array_matrix);
+		POP_PLERRCONTEXT;
+		return result;
+	}
+
 	/* switch to SPI memory context */
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 
@@ -510,8 +722,12 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 	 */
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.execp");
+
 		/* Execute the plan */
 		spi_rc = SPI_execp(saved_plan, argvalues, nulls, count);
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -549,7 +765,7 @@ plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues)
 			ntuples = SPI_processed;
 			if (ntuples > 0)
 			{
-				result = rpgsql_get_results(ntuples, SPI_tuptable);
+				result = rpgsql_get_results(ntuples, SPI_tuptable, array_matrix);
 				SPI_freetuptable(SPI_tuptable);
 			}
 			else
@@ -604,6 +820,211 @@ plr_SPI_lastoid(void)
 	return result;
 }
 
+/*
+ * Shared object store, see plr_shared_store(). Each call runs in a
+ * subtransaction, so that a Postgres error releases the store's lock
+ * before it becomes an R error, which R code can catch.
+ */
+#define PLR_SHARED_TRY() \
+		BeginInternalSubTransaction(NULL); \
+		MemoryContextSwitchTo(oldcontext); \
+		PG_TRY()
+
+#define PLR_SHARED_COMMIT() \
+		ReleaseCurrentSubTransaction(); \
+		MemoryContextSwitchTo(oldcontext); \
+		CurrentResourceOwner = oldowner
+
+#define PLR_SHARED_CATCH() \
+		PG_CATCH(); \
+		{ \
+			ErrorData  *edata; \
+			MemoryContextSwitchTo(oldcontext); \
+			edata = CopyErrorData(); \
+			FlushErrorState(); \
+			RollbackAndReleaseCurrentSubTransaction(); \
+			MemoryContextSwitchTo(oldcontext); \
+			CurrentResourceOwner = oldowner; \
+			if (edata->detail) \
+				error("%s: %s", edata->message, edata->detail); \
+			else \
+				error("%s", edata->message); \
+		}
+
+/* the R objects last read from the store, by name */
+typedef struct plr_shared_local
+{
+	char		name[NAMEDATALEN];	/* hash key -- must be first */
+	uint64		version;
+	SEXP		obj;				/* preserved from R's garbage collector */
+}	plr_shared_local;
+
+static HTAB *plr_shared_local_hash = NULL;
+
+static void
+shared_name_arg(SEXP rname, char *key)
+{
+	const char *name;
+
+	if (!isString(rname) || LENGTH(rname) != 1 || STRING_ELT(rname, 0) == NA_STRING)
+		error("%s", "name must be a single string");
+	name = CHAR(STRING_ELT(rname, 0));
+	if (strlen(name) >= NAMEDATALEN)
+		error("shared object name \"%s\" is too long", name);
+
+	memset(key, 0, NAMEDATALEN);
+	strcpy(key, name);
+}
+
+static void
+shared_forget_local(const char *key)
+{
+	plr_shared_local *local;
+
+	if (plr_shared_local_hash == NULL)
+		return;
+
+	local = (plr_shared_local *) hash_search(plr_shared_local_hash, (void *) key,
+											 HASH_FIND, NULL);
+	if (local != NULL)
+	{
+		R_ReleaseObject(local->obj);
+		hash_search(plr_shared_local_hash, (void *) key, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * pg.shared.put(name, obj) - serialize obj into the shared object store as
+ * the new version of name, and return the version
+ */
+SEXP
+plr_shared_put(SEXP rname, SEXP obj)
+{
+	char			key[NAMEDATALEN];
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+	volatile uint64	version = 0;
+
+	shared_name_arg(rname, key);
+
+	PLR_SHARED_TRY();
+	{
+		bytea  *data = plr_serialize(obj);
+
+		version = plr_shared_store(key, VARDATA(data), VARSIZE(data) - VARHDRSZ);
+		pfree(data);
+		PLR_SHARED_COMMIT();
+	}
+	PLR_SHARED_CATCH();
+	PG_END_TRY();
+
+	return ScalarReal((double) version);
+}
+
+/*
+ * pg.shared.get(name) - the current version of name in the shared object
+ * store, or NULL. The object is only unserialized again once a newer
+ * version was put.
+ */
+SEXP
+plr_shared_get(SEXP rname)
+{
+	char			key[NAMEDATALEN];
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+	volatile SEXP	result = R_NilValue;
+
+	shared_name_arg(rname, key);
+
+	PLR_SHARED_TRY();
+	{
+		plr_shared_local   *local = NULL;
+		uint64				version;
+		char			   *data;
+		Size				size;
+
+		if (plr_shared_local_hash == NULL)
+		{
+			HASHCTL		ctl;
+
+			memset(&ctl, 0, sizeof(ctl));
+			ctl.keysize = NAMEDATALEN;
+			ctl.entrysize = sizeof(plr_shared_local);
+			ctl.hash = tag_hash;
+			plr_shared_local_hash = hash_create("PLR shared objects read",
+												32,
+												&ctl,
+												HASH_ELEM | HASH_FUNCTION);
+		}
+		else
+			local = (plr_shared_local *) hash_search(plr_shared_local_hash,
+													 (void *) key,
+													 HASH_FIND, NULL);
+
+		if (!plr_shared_fetch(key, local != NULL ? local->version : 0,
+							  &version, &data, &size))
+			shared_forget_local(key);
+		else if (data == NULL)
+			result = local->obj;
+		else
+		{
+			SEXP	obj;
+			bool	found;
+
+			PROTECT(obj = plr_unserialize(data, size));
+			pfree(data);
+#ifdef MARK_NOT_MUTABLE
+			MARK_NOT_MUTABLE(obj);
+#else
+			SET_NAMED(obj, 2);
+#endif
+
+			local = (plr_shared_local *) hash_search(plr_shared_local_hash,
+													 (void *) key,
+													 HASH_ENTER, &found);
+			R_PreserveObject(obj);
+			if (found)
+				R_ReleaseObject(local->obj);
+			local->obj = obj;
+			local->version = version;
+			UNPROTECT(1);
+
+			result = obj;
+		}
+		PLR_SHARED_COMMIT();
+	}
+	PLR_SHARED_CATCH();
+	PG_END_TRY();
+
+	return result;
+}
+
+/*
+ * pg.shared.remove(name) - remove name from the shared object store,
+ * returning whether it was there
+ */
+SEXP
+plr_shared_rm(SEXP rname)
+{
+	char			key[NAMEDATALEN];
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ResourceOwner	oldowner = CurrentResourceOwner;
+	volatile bool	removed = false;
+
+	shared_name_arg(rname, key);
+
+	PLR_SHARED_TRY();
+	{
+		removed = plr_shared_remove(key);
+		shared_forget_local(key);
+		PLR_SHARED_COMMIT();
+	}
+	PLR_SHARED_CATCH();
+	PG_END_TRY();
+
+	return ScalarLogical(removed ? TRUE : FALSE);
+}
+
 /*
  * Takes the prepared plan rsaved_plan and creates a cursor 
  * for it using the values specified in ragvalues.
@@ -617,6 +1038,7 @@ plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues)
 	int					nargs = plan_desc->nargs;
 	Oid				   *typeids = plan_desc->typeids;
 	FmgrInfo		   *typinfuncs = plan_desc->typinfuncs;
+	plr_native_conv	   *typconvs = plan_desc->typconvs;
 	int					i;
 	Datum			   *argvalues = NULL;
 	char			   *nulls = NULL;
@@ -649,7 +1071,10 @@ plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues)
 	{
 		PROTECT(obj = VECTOR_ELT(rargvalues, i));
 
-		argvalues[i] = get_scalar_datum(obj, typeids[i], typinfuncs[i], &isnull);
+		isnull = false;
+		if (typconvs[i] == NULL ||
+			!(*typconvs[i]) (obj, &argvalues[i], &isnull))
+			argvalues[i] = get_scalar_datum(obj, typeids[i], typinfuncs[i], &isnull);
 		if (!isnull)
 			nulls[i] = ' ';
 		else
@@ -657,7 +1082,20 @@ plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues)
 
 		UNPROTECT(1);
 	}
-	strncpy(cursor_name, CHAR(STRING_ELT(cursor_name_arg,0)), 64);
+
+	/*
+	 * A missing, NA or empty cursor name lets SPI generate a unique portal
+	 * name, so that any number of cursors can be open at the same time
+	 */
+	if (isString(cursor_name_arg) && length(cursor_name_arg) > 0 &&
+		STRING_ELT(cursor_name_arg, 0) != NA_STRING &&
+		*CHAR(STRING_ELT(cursor_name_arg, 0)) != '\0')
+	{
+		strncpy(cursor_name, CHAR(STRING_ELT(cursor_name_arg, 0)), 64);
+		cursor_name[63] = '\0';
+	}
+	else
+		cursor_name[0] = '\0';
 
 	/* switch to SPI memory context */
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
@@ -668,9 +1106,13 @@ plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues)
 	 */
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.cursor_open");
+
 		/* Open the cursor */
-		portal = SPI_cursor_open(cursor_name,saved_plan, argvalues, nulls,1);
+		portal = SPI_cursor_open(cursor_name[0] ? cursor_name : NULL,
+								 saved_plan, argvalues, nulls,1);
 
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -688,7 +1130,7 @@ plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues)
 }
 
 SEXP
-plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
+plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in, SEXP as_frame_in)
 {
 	Portal				portal=NULL;
 	int					ntuples;
@@ -696,6 +1138,7 @@ plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 	MemoryContext		oldcontext;
 	int					forward;
 	int					rows;
+	int					as_frame = TRUE;
 	PREPARE_PG_TRY;
 	PUSH_PLERRCONTEXT(rsupport_error_callback, "pg.spi.cursor_fetch");
 
@@ -710,6 +1153,15 @@ plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 		error("pg.spi.cursor_fetch arg3 must be an integer");
 		return result;
 	}
+	if (as_frame_in != R_NilValue)
+	{
+		if (!IS_LOGICAL(as_frame_in))
+		{
+			error("pg.spi.cursor_fetch arg4 must be boolean");
+			return result;
+		}
+		as_frame = LOGICAL_DATA(as_frame_in)[0];
+	}
 	forward = LOGICAL_DATA(forward_in)[0];
 	rows  = INTEGER_DATA(rows_in)[0];
 
@@ -717,9 +1169,12 @@ plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.cursor_fetch");
+
 		/* Open the cursor */
 		SPI_cursor_fetch(portal,forward,rows);
-		
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -730,7 +1185,14 @@ plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 	ntuples = SPI_processed;
 	if (ntuples > 0)
 	{
-		result = rpgsql_get_results(ntuples, SPI_tuptable);
+		if (as_frame)
+			result = rpgsql_get_results(ntuples, SPI_tuptable, false);
+		else
+		{
+			PLR_STAT_ADD(rows_in, ntuples);
+			result = pg_tuple_get_r_list(ntuples, SPI_tuptable->vals,
+										 SPI_tuptable->tupdesc, false);
+		}
 		SPI_freetuptable(SPI_tuptable);
 	}
 	else
@@ -740,6 +1202,85 @@ plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 	return result;
 }
 
+/*
+ * plr_SPI_cursor_fetch_into - fetch from a cursor into the columns of an
+ * existing data.frame (or list of columns) in place, rather than
+ * allocating a new one for each batch. The frame must have the shape
+ * pg.spi.cursor_fetch would produce and at least rows rows; only the first
+ * n rows are overwritten, where n, the number of rows fetched, is returned.
+ */
+SEXP
+plr_SPI_cursor_fetch_into(SEXP cursor_in, SEXP forward_in, SEXP rows_in, SEXP frame)
+{
+	Portal				portal=NULL;
+	int					ntuples;
+	SEXP				result = NULL;
+	MemoryContext		oldcontext;
+	int					forward;
+	int					rows;
+	PREPARE_PG_TRY;
+	PUSH_PLERRCONTEXT(rsupport_error_callback, "pg.spi.cursor_fetch_into");
+
+	portal = R_ExternalPtrAddr(cursor_in);
+	if(!IS_LOGICAL(forward_in))
+	{
+		error("pg.spi.cursor_fetch_into arg2 must be boolean");
+		return result;
+	}
+	if(!IS_INTEGER(rows_in))
+	{
+		error("pg.spi.cursor_fetch_into arg3 must be an integer");
+		return result;
+	}
+	forward = LOGICAL_DATA(forward_in)[0];
+	rows  = INTEGER_DATA(rows_in)[0];
+
+	/* check the frame before consuming anything from the cursor */
+	if (portal == NULL || portal->tupDesc == NULL)
+	{
+		error("pg.spi.cursor_fetch_into cursor does not return tuples");
+		return result;
+	}
+	if (!pg_tuple_r_frame_matches(portal->tupDesc, frame, rows))
+	{
+		error("pg.spi.cursor_fetch_into arg4 does not match the shape "
+			  "of the cursor's result");
+		return result;
+	}
+
+	/* switch to SPI memory context */
+	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
+	PG_TRY();
+	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.cursor_fetch_into");
+
+		SPI_cursor_fetch(portal,forward,rows);
+
+		plr_phase_end(phase_level);
+	}
+	PLR_PG_CATCH();
+	PLR_PG_END_TRY();
+	/* back to caller's memory context */
+	MemoryContextSwitchTo(oldcontext);
+
+	/* check the result */
+	ntuples = SPI_processed;
+	if (ntuples > 0)
+	{
+		PLR_STAT_ADD(rows_in, ntuples);
+		pg_tuple_fill_r_frame(ntuples, SPI_tuptable->vals,
+							  SPI_tuptable->tupdesc, frame);
+		SPI_freetuptable(SPI_tuptable);
+	}
+
+	PROTECT(result = NEW_INTEGER(1));
+	INTEGER_DATA(result)[0] = ntuples;
+	UNPROTECT(1);
+
+	POP_PLERRCONTEXT;
+	return result;
+}
+
 void
 plr_SPI_cursor_close(SEXP cursor_in)
 {
@@ -754,8 +1295,12 @@ plr_SPI_cursor_close(SEXP cursor_in)
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.cursor_close");
+
 		/* Open the cursor */
 		SPI_cursor_close(portal);
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
@@ -791,8 +1336,12 @@ plr_SPI_cursor_move(SEXP cursor_in,SEXP forward_in, SEXP rows_in)
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 	PG_TRY();
 	{
+		int		phase_level = plr_phase_start(PLR_PHASE_SPI, "pg.spi.cursor_move");
+
 		/* Open the cursor */
 		SPI_cursor_move(portal, forward, rows);
+
+		plr_phase_end(phase_level);
 	}
 	PLR_PG_CATCH();
 	PLR_PG_END_TRY();
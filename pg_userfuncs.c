@@ -507,46 +507,21 @@ plr_set_display(PG_FUNCTION_ARGS)
  *		utility function to ...
  *----------------------------------------------------------------------------
  */
-extern char *last_R_error_msg;
- 
 PG_FUNCTION_INFO_V1(plr_get_raw);
 Datum
 plr_get_raw(PG_FUNCTION_ARGS)
 {
 	SEXP	result;
-	SEXP 	s, t, obj;
-	int		status;
 	bytea  *bvalue = PG_GETARG_BYTEA_P(0);
 	int		len, rsize;
 	bytea  *bresult;
 	char   *brptr;
 
-	PROTECT(obj = NEW_RAW(VARSIZE(bvalue)));
-	memcpy((char *) RAW(obj), VARDATA(bvalue), VARSIZE(bvalue));
-
-	/*
-	 * Need to construct a call to
-	 * unserialize(rval)
-	 */
-	PROTECT(t = s = allocList(2));
-	SET_TYPEOF(s, LANGSXP);
-	SETCAR(t, install("unserialize")); t = CDR(t);
-	SETCAR(t, obj);
-
-	PROTECT(result = R_tryEval(s, R_GlobalEnv, &status));
-	if(status != 0)
-	{
-		if (last_R_error_msg)
-			ereport(ERROR,
-					(errcode(ERRCODE_DATA_EXCEPTION),
-					 errmsg("R interpreter expression evaluation error"),
-					 errdetail("%s", last_R_error_msg)));
-		else
-			ereport(ERROR,
-					(errcode(ERRCODE_DATA_EXCEPTION),
-					 errmsg("R interpreter expression evaluation error"),
-					 errdetail("R expression evaluation error caught in \"unserialize\".")));
-	}
+	PROTECT(result = plr_unserialize(VARDATA(bvalue), VARSIZE(bvalue) - VARHDRSZ));
+	if (TYPEOF(result) != RAWSXP)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("serialized R object is not of type raw")));
 
 	len = LENGTH(result);
 	rsize = VARHDRSZ + len;
@@ -555,7 +530,954 @@ plr_get_raw(PG_FUNCTION_ARGS)
 	brptr = VARDATA(bresult);
 	memcpy(brptr, (char *) RAW(result), rsize - VARHDRSZ);
 
-	UNPROTECT(3);
+	UNPROTECT(1);
 
 	PG_RETURN_BYTEA_P(bresult);
 }
+
+/*-----------------------------------------------------------------------------
+ * plr_stat_functions :
+ *		show the execution statistics collected for the PL/R functions of
+ *		the current database while plr.track_functions is on
+ *----------------------------------------------------------------------------
+ */
+#define PLR_STAT_FUNCTIONS_COLS		14
+PG_FUNCTION_INFO_V1(plr_stat_functions);
+Datum
+plr_stat_functions(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate	   *tupstore;
+	HeapTuple			tuple;
+	TupleDesc			tupdesc;
+	AttInMetadata	   *attinmeta;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+	Oid				   *funcids;
+	plr_func_stats	   *stats;
+	int					nfuncs;
+	int					i, j;
+	char				buf[PLR_STAT_FUNCTIONS_COLS][64];
+	char			   *values[PLR_STAT_FUNCTIONS_COLS];
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/*
+	 * Check to make sure we have a reasonable tuple descriptor
+	 */
+	if (tupdesc->natts != PLR_STAT_FUNCTIONS_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+
+	/* OK to use it */
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	/* initialize our tuplestore */
+	tupstore = TUPLESTORE_BEGIN_HEAP;
+
+	for (j = 0; j < PLR_STAT_FUNCTIONS_COLS; j++)
+		values[j] = buf[j];
+
+	nfuncs = plr_stat_collect(&funcids, &stats);
+	for (i = 0; i < nfuncs; i++)
+	{
+		plr_func_stats *st = &stats[i];
+		char		   *funcname = get_func_name(funcids[i]);
+
+		snprintf(buf[0], 64, "%u", funcids[i]);
+		/* function may have been dropped since */
+		values[1] = funcname;
+		snprintf(buf[2], 64, INT64_FORMAT, st->calls);
+		snprintf(buf[3], 64, "%.3f", st->total_time);
+		snprintf(buf[4], 64, "%.3f", st->args_time);
+		snprintf(buf[5], 64, "%.3f", st->eval_time);
+		snprintf(buf[6], 64, "%.3f", st->result_time);
+		snprintf(buf[7], 64, INT64_FORMAT, st->rows_in);
+		snprintf(buf[8], 64, INT64_FORMAT, st->rows_out);
+		snprintf(buf[9], 64, INT64_FORMAT, st->bytes_in);
+		snprintf(buf[10], 64, INT64_FORMAT, st->bytes_out);
+		snprintf(buf[11], 64, INT64_FORMAT, st->gc_count);
+		snprintf(buf[12], 64, "%.3f", st->gc_time);
+		snprintf(buf[13], 64, "%.3f", st->gc_max_time);
+
+		tuple = BuildTupleFromCStrings(attinmeta, values);
+		tuplestore_puttuple(tupstore, tuple);
+
+		if (funcname)
+			pfree(funcname);
+	}
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through
+	 * rsinfo->setResult. rsinfo->setDesc is set to the tuple description
+	 * that we actually used to build our tuples with, so the caller can
+	 * verify we did what it was expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return (Datum) 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_stat_reset :
+ *		discard the PL/R function statistics of the current database
+ *----------------------------------------------------------------------------
+ */
+PG_FUNCTION_INFO_V1(plr_stat_reset);
+Datum
+plr_stat_reset(PG_FUNCTION_ARGS)
+{
+	plr_stat_reset_entries();
+
+	PG_RETURN_VOID();
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_r_memory :
+ *		show the usage of the R heaps of the current backend, next to the
+ *		limit set by plr.max_heap_size
+ *----------------------------------------------------------------------------
+ */
+#define PLR_R_MEMORY_COLS		6
+PG_FUNCTION_INFO_V1(plr_r_memory);
+Datum
+plr_r_memory(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate	   *tupstore;
+	HeapTuple			tuple;
+	TupleDesc			tupdesc;
+	AttInMetadata	   *attinmeta;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+	plr_r_heap_usage	heaps[2];
+	char			   *heap_names[2] = {"Ncells", "Vcells"};
+	int					i, j;
+	char				buf[PLR_R_MEMORY_COLS][64];
+	char			   *values[PLR_R_MEMORY_COLS];
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	/* do the R side before we start building anything */
+	plr_get_r_heap_usage(&heaps[0], &heaps[1]);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/*
+	 * Check to make sure we have a reasonable tuple descriptor
+	 */
+	if (tupdesc->natts != PLR_R_MEMORY_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+
+	/* OK to use it */
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	/* initialize our tuplestore */
+	tupstore = TUPLESTORE_BEGIN_HEAP;
+
+	for (i = 0; i < 2; i++)
+	{
+		plr_r_heap_usage *heap = &heaps[i];
+
+		for (j = 0; j < PLR_R_MEMORY_COLS; j++)
+			values[j] = buf[j];
+
+		values[0] = heap_names[i];
+		snprintf(buf[1], 64, "%.0f", heap->used);
+		snprintf(buf[2], 64, "%.0f", heap->used * heap->cell_size);
+		snprintf(buf[3], 64, "%.0f", heap->gc_trigger * heap->cell_size);
+		snprintf(buf[4], 64, "%.0f", heap->max_used * heap->cell_size);
+		if (heap->limit > 0)
+			snprintf(buf[5], 64, "%.0f", heap->limit * heap->cell_size);
+		else
+			values[5] = NULL;
+
+		tuple = BuildTupleFromCStrings(attinmeta, values);
+		tuplestore_puttuple(tupstore, tuple);
+	}
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through
+	 * rsinfo->setResult. rsinfo->setDesc is set to the tuple description
+	 * that we actually used to build our tuples with, so the caller can
+	 * verify we did what it was expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return (Datum) 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_gc :
+ *		collect R garbage now, returning the time it took in milliseconds
+ *----------------------------------------------------------------------------
+ */
+PG_FUNCTION_INFO_V1(plr_gc);
+Datum
+plr_gc(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(plr_gc_collect());
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_object_cache :
+ *		show the size and the hit counters of the cache of R objects
+ *		unserialized from bytea arguments, see plr.object_cache_size
+ *----------------------------------------------------------------------------
+ */
+#define PLR_OBJECT_CACHE_COLS		6
+PG_FUNCTION_INFO_V1(plr_object_cache);
+Datum
+plr_object_cache(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate	   *tupstore;
+	HeapTuple			tuple;
+	TupleDesc			tupdesc;
+	AttInMetadata	   *attinmeta;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+	plr_object_cache_stats stats;
+	int					j;
+	char				buf[PLR_OBJECT_CACHE_COLS][64];
+	char			   *values[PLR_OBJECT_CACHE_COLS];
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	plr_object_cache_get_stats(&stats);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/*
+	 * Check to make sure we have a reasonable tuple descriptor
+	 */
+	if (tupdesc->natts != PLR_OBJECT_CACHE_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+
+	/* OK to use it */
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	/* initialize our tuplestore */
+	tupstore = TUPLESTORE_BEGIN_HEAP;
+
+	for (j = 0; j < PLR_OBJECT_CACHE_COLS; j++)
+		values[j] = buf[j];
+
+	snprintf(buf[0], 64, "%ld", stats.entries);
+	snprintf(buf[1], 64, INT64_FORMAT, (int64) stats.bytes);
+	snprintf(buf[2], 64, INT64_FORMAT, (int64) plr_object_cache_size * 1024);
+	snprintf(buf[3], 64, INT64_FORMAT, stats.hits);
+	snprintf(buf[4], 64, INT64_FORMAT, stats.misses);
+	snprintf(buf[5], 64, INT64_FORMAT, stats.evictions);
+
+	tuple = BuildTupleFromCStrings(attinmeta, values);
+	tuplestore_puttuple(tupstore, tuple);
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through
+	 * rsinfo->setResult. rsinfo->setDesc is set to the tuple description
+	 * that we actually used to build our tuples with, so the caller can
+	 * verify we did what it was expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return (Datum) 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_object_cache_reset :
+ *		drop the cached R objects of the current backend and zero the
+ *		counters
+ *----------------------------------------------------------------------------
+ */
+PG_FUNCTION_INFO_V1(plr_object_cache_reset);
+Datum
+plr_object_cache_reset(PG_FUNCTION_ARGS)
+{
+	plr_object_cache_clear();
+
+	PG_RETURN_VOID();
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_shared_objects :
+ *		list the objects of the shared object store, see pg.shared.put
+ *----------------------------------------------------------------------------
+ */
+#define PLR_SHARED_OBJECTS_COLS		4
+PG_FUNCTION_INFO_V1(plr_shared_objects);
+Datum
+plr_shared_objects(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate	   *tupstore;
+	HeapTuple			tuple;
+	TupleDesc			tupdesc;
+	AttInMetadata	   *attinmeta;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+	plr_shared_info	   *objects;
+	int					nobjects;
+	int					i, j;
+	char				buf[PLR_SHARED_OBJECTS_COLS][64];
+	char			   *values[PLR_SHARED_OBJECTS_COLS];
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/*
+	 * Check to make sure we have a reasonable tuple descriptor
+	 */
+	if (tupdesc->natts != PLR_SHARED_OBJECTS_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+
+	/* OK to use it */
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	/* initialize our tuplestore */
+	tupstore = TUPLESTORE_BEGIN_HEAP;
+
+	nobjects = plr_shared_collect(&objects);
+	for (i = 0; i < nobjects; i++)
+	{
+		for (j = 0; j < PLR_SHARED_OBJECTS_COLS; j++)
+			values[j] = buf[j];
+
+		values[0] = objects[i].name;
+		snprintf(buf[1], 64, UINT64_FORMAT, objects[i].version);
+		snprintf(buf[2], 64, INT64_FORMAT, (int64) objects[i].size);
+		snprintf(buf[3], 64, INT64_FORMAT, objects[i].reads);
+
+		tuple = BuildTupleFromCStrings(attinmeta, values);
+		tuplestore_puttuple(tupstore, tuple);
+	}
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through
+	 * rsinfo->setResult. rsinfo->setDesc is set to the tuple description
+	 * that we actually used to build our tuples with, so the caller can
+	 * verify we did what it was expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return (Datum) 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_profile :
+ *		show the R profiler samples collected by the current backend while
+ *		plr.profile_functions is on, per function and R call stack
+ *----------------------------------------------------------------------------
+ */
+#define PLR_PROFILE_COLS		5
+PG_FUNCTION_INFO_V1(plr_profile);
+Datum
+plr_profile(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate	   *tupstore;
+	HeapTuple			tuple;
+	TupleDesc			tupdesc;
+	AttInMetadata	   *attinmeta;
+	MemoryContext		per_query_ctx;
+	MemoryContext		oldcontext;
+	plr_profile_entry  *entries;
+	int					nentries;
+	int					i;
+	char				buf[PLR_PROFILE_COLS][64];
+	char			   *values[PLR_PROFILE_COLS];
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/*
+	 * Check to make sure we have a reasonable tuple descriptor
+	 */
+	if (tupdesc->natts != PLR_PROFILE_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+
+	/* OK to use it */
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	/* initialize our tuplestore */
+	tupstore = TUPLESTORE_BEGIN_HEAP;
+
+	nentries = plr_profile_collect(&entries);
+	for (i = 0; i < nentries; i++)
+	{
+		plr_profile_entry  *entry = &entries[i];
+		char			   *funcname = get_func_name(entry->key.funcid);
+
+		snprintf(buf[0], 64, "%u", entry->key.funcid);
+		values[0] = buf[0];
+		/* function may have been dropped since */
+		values[1] = funcname;
+		values[2] = entry->key.stack;
+		snprintf(buf[3], 64, INT64_FORMAT, entry->self_samples);
+		values[3] = buf[3];
+		snprintf(buf[4], 64, INT64_FORMAT, entry->total_samples);
+		values[4] = buf[4];
+
+		tuple = BuildTupleFromCStrings(attinmeta, values);
+		tuplestore_puttuple(tupstore, tuple);
+
+		if (funcname)
+			pfree(funcname);
+	}
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through
+	 * rsinfo->setResult. rsinfo->setDesc is set to the tuple description
+	 * that we actually used to build our tuples with, so the caller can
+	 * verify we did what it was expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return (Datum) 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * plr_profile_reset :
+ *		discard the R profiler samples collected by the current backend
+ *----------------------------------------------------------------------------
+ */
+PG_FUNCTION_INFO_V1(plr_profile_reset);
+Datum
+plr_profile_reset(PG_FUNCTION_ARGS)
+{
+	plr_profile_reset_entries();
+
+	PG_RETURN_VOID();
+}
+
+/*-----------------------------------------------------------------------------
+ * conversion micro-benchmarks :
+ *		run one of the converters of pg_conversion.c over synthetic data a
+ *		number of times, outside of the executor. The SQL definitions are
+ *		in bench/setup.sql, not in the extension. Every value is the input
+ *		function's reading of "1".
+ *
+ *		Each returns (loops, elements, total_ms, ns_per_element, pg_bytes,
+ *		r_bytes): pg_bytes is the PostgreSQL memory allocated by a single
+ *		conversion (NULL before PostgreSQL 13), r_bytes the object.size()
+ *		of the R side of the conversion.
+ *----------------------------------------------------------------------------
+ */
+#define PLR_BENCH_COLS		6
+
+/* the synthetic value of a type */
+static Datum
+plr_bench_value(Oid typid)
+{
+	Oid			typinput;
+	Oid			typioparam;
+
+	getTypeInputInfo(typid, &typinput, &typioparam);
+	return OidInputFunctionCall(typinput, "1", typioparam, -1);
+}
+
+static Oid *
+plr_bench_coltypes(ArrayType *coltypes, int *ncols)
+{
+	Datum	   *elems;
+	Oid		   *typids;
+	int			i;
+
+	deconstruct_array(coltypes, REGTYPEOID, sizeof(Oid), true, 'i',
+					  &elems, NULL, ncols);
+	if (*ncols < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("at least one column type is required")));
+
+	typids = (Oid *) palloc(*ncols * sizeof(Oid));
+	for (i = 0; i < *ncols; i++)
+		typids[i] = DatumGetObjectId(elems[i]);
+
+	return typids;
+}
+
+/* a table of nrows identical rows of the given column types */
+static HeapTuple *
+plr_bench_tuples(Oid *typids, int ncols, int nrows, TupleDesc *tupdesc)
+{
+	Datum	   *values;
+	bool	   *nulls;
+	HeapTuple	tuple;
+	HeapTuple  *tuples;
+	char		attname[NAMEDATALEN];
+	int			i;
+
+#if PG_VERSION_NUM >= 120000
+	*tupdesc = CreateTemplateTupleDesc(ncols);
+#else
+	*tupdesc = CreateTemplateTupleDesc(ncols, false);
+#endif
+	values = (Datum *) palloc(ncols * sizeof(Datum));
+	nulls = (bool *) palloc0(ncols * sizeof(bool));
+	for (i = 0; i < ncols; i++)
+	{
+		snprintf(attname, sizeof(attname), "c%d", i + 1);
+		TupleDescInitEntry(*tupdesc, (AttrNumber) (i + 1), attname,
+						   typids[i], -1, 0);
+		values[i] = plr_bench_value(typids[i]);
+	}
+
+	tuple = heap_form_tuple(*tupdesc, values, nulls);
+	tuples = (HeapTuple *) palloc(nrows * sizeof(HeapTuple));
+	for (i = 0; i < nrows; i++)
+		tuples[i] = heap_copytuple(tuple);
+
+	return tuples;
+}
+
+static int64
+plr_bench_object_size(SEXP obj)
+{
+	SEXP		call;
+	SEXP		ans;
+	int			errorOccurred;
+	int64		result = -1;
+
+	PROTECT(call = lang2(install("object.size"), obj));
+	PROTECT(ans = R_tryEval(call, R_GlobalEnv, &errorOccurred));
+	if (!errorOccurred && isReal(ans) && length(ans) == 1)
+		result = (int64) REAL(ans)[0];
+	UNPROTECT(2);
+
+	return result;
+}
+
+static MemoryContext
+plr_bench_context(void)
+{
+	return AllocSetContextCreate(CurrentMemoryContext,
+								 "PL/R bench",
+								 ALLOCSET_DEFAULT_MINSIZE,
+								 ALLOCSET_DEFAULT_INITSIZE,
+								 ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+static int64
+plr_bench_allocated(MemoryContext context)
+{
+#if PG_VERSION_NUM >= 130000
+	return (int64) MemoryContextMemAllocated(context, true);
+#else
+	return -1;
+#endif
+}
+
+static Datum
+plr_bench_result(FunctionCallInfo fcinfo, int loops, int64 elements,
+				 instr_time total, int64 pg_bytes, int64 r_bytes)
+{
+	TupleDesc	tupdesc;
+	Datum		values[PLR_BENCH_COLS];
+	bool		nulls[PLR_BENCH_COLS];
+	double		total_ms = INSTR_TIME_GET_DOUBLE(total) * 1000.0;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE ||
+		tupdesc->natts != PLR_BENCH_COLS)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("query-specified return tuple and "
+						"function return type are not compatible")));
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int32GetDatum(loops);
+	values[1] = Int64GetDatum(elements);
+	values[2] = Float8GetDatum(total_ms);
+	values[3] = Float8GetDatum(elements > 0 && loops > 0 ?
+							   total_ms * 1000000.0 / ((double) elements * loops) : 0);
+	values[4] = Int64GetDatum(pg_bytes);
+	nulls[4] = (pg_bytes < 0);
+	values[5] = Int64GetDatum(r_bytes);
+	nulls[5] = (r_bytes < 0);
+
+	return HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls));
+}
+
+static void
+plr_bench_check_loops(int loops)
+{
+	if (loops < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of loops must be positive")));
+}
+
+/*
+ * plr_bench_array_get_r(elemtype regtype, dims int4[], loops int4)
+ *		pg_array_get_r() on an array of the given element type and shape
+ */
+PG_FUNCTION_INFO_V1(plr_bench_array_get_r);
+Datum
+plr_bench_array_get_r(PG_FUNCTION_ARGS)
+{
+	Oid				elemtype = PG_GETARG_OID(0);
+	ArrayType	   *dimsarr = PG_GETARG_ARRAYTYPE_P(1);
+	int				loops = PG_GETARG_INT32(2);
+	int				ndims;
+	int			   *dims;
+	int				lbs[MAXDIM];
+	int				nitems;
+	int16			typlen;
+	bool			typbyval;
+	char			typalign;
+	Oid				typoutput;
+	bool			typisvarlena;
+	FmgrInfo		out_func;
+	Datum			value;
+	Datum		   *elems;
+	ArrayType	   *array;
+	MemoryContext	scratch;
+	MemoryContext	oldcontext;
+	instr_time		start;
+	instr_time		end;
+	instr_time		total;
+	int64			base_bytes;
+	int64			pg_bytes = -1;
+	int64			r_bytes = -1;
+	int				i;
+
+	plr_bench_check_loops(loops);
+	if (ARR_NDIM(dimsarr) != 1 || ARR_HASNULL(dimsarr) ||
+		ARR_ELEMTYPE(dimsarr) != INT4OID ||
+		ARR_DIMS(dimsarr)[0] < 1 || ARR_DIMS(dimsarr)[0] > MAXDIM)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("dims must be a one dimensional int4 array "
+						"of 1 to %d sizes", MAXDIM)));
+	ndims = ARR_DIMS(dimsarr)[0];
+	dims = (int *) ARR_DATA_PTR(dimsarr);
+	for (i = 0; i < ndims; i++)
+		lbs[i] = 1;
+	nitems = ArrayGetNItems(ndims, dims);
+
+	/* R is all we need, not the builtins */
+	plr_init();
+
+	get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+	getTypeOutputInfo(elemtype, &typoutput, &typisvarlena);
+	fmgr_info(typoutput, &out_func);
+
+	value = plr_bench_value(elemtype);
+	elems = (Datum *) palloc(Max(nitems, 1) * sizeof(Datum));
+	for (i = 0; i < nitems; i++)
+		elems[i] = value;
+	array = construct_md_array(elems, NULL, ndims, dims, lbs,
+							   elemtype, typlen, typbyval, typalign);
+
+	scratch = plr_bench_context();
+	base_bytes = plr_bench_allocated(scratch);
+	INSTR_TIME_SET_ZERO(total);
+
+	for (i = 0; i < loops; i++)
+	{
+		SEXP	result;
+
+		oldcontext = MemoryContextSwitchTo(scratch);
+		INSTR_TIME_SET_CURRENT(start);
+		PROTECT(result = pg_array_get_r(PointerGetDatum(array), &out_func,
+										typlen, typbyval, typalign));
+		INSTR_TIME_SET_CURRENT(end);
+		MemoryContextSwitchTo(oldcontext);
+		INSTR_TIME_ACCUM_DIFF(total, end, start);
+
+		if (i == 0)
+		{
+			if (base_bytes >= 0)
+				pg_bytes = plr_bench_allocated(scratch) - base_bytes;
+			r_bytes = plr_bench_object_size(result);
+		}
+		UNPROTECT(1);
+		MemoryContextReset(scratch);
+	}
+
+	MemoryContextDelete(scratch);
+
+	return plr_bench_result(fcinfo, loops, nitems, total, pg_bytes, r_bytes);
+}
+
+/*
+ * plr_bench_tuple_get_r_frame(coltypes regtype[], nrows int4, loops int4)
+ *		pg_tuple_get_r_frame() on a tuple table of the given shape
+ */
+PG_FUNCTION_INFO_V1(plr_bench_tuple_get_r_frame);
+Datum
+plr_bench_tuple_get_r_frame(PG_FUNCTION_ARGS)
+{
+	ArrayType	   *coltypes = PG_GETARG_ARRAYTYPE_P(0);
+	int				nrows = PG_GETARG_INT32(1);
+	int				loops = PG_GETARG_INT32(2);
+	Oid			   *typids;
+	int				ncols;
+	TupleDesc		tupdesc;
+	HeapTuple	   *tuples;
+	MemoryContext	scratch;
+	MemoryContext	oldcontext;
+	instr_time		start;
+	instr_time		end;
+	instr_time		total;
+	int64			base_bytes;
+	int64			pg_bytes = -1;
+	int64			r_bytes = -1;
+	int				i;
+
+	plr_bench_check_loops(loops);
+	if (nrows < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of rows must be positive")));
+
+	plr_init();
+
+	typids = plr_bench_coltypes(coltypes, &ncols);
+	tuples = plr_bench_tuples(typids, ncols, nrows, &tupdesc);
+
+	scratch = plr_bench_context();
+	base_bytes = plr_bench_allocated(scratch);
+	INSTR_TIME_SET_ZERO(total);
+
+	for (i = 0; i < loops; i++)
+	{
+		SEXP	result;
+
+		oldcontext = MemoryContextSwitchTo(scratch);
+		INSTR_TIME_SET_CURRENT(start);
+		PROTECT(result = pg_tuple_get_r_frame(nrows, tuples, tupdesc, false));
+		INSTR_TIME_SET_CURRENT(end);
+		MemoryContextSwitchTo(oldcontext);
+		INSTR_TIME_ACCUM_DIFF(total, end, start);
+
+		if (i == 0)
+		{
+			if (base_bytes >= 0)
+				pg_bytes = plr_bench_allocated(scratch) - base_bytes;
+			r_bytes = plr_bench_object_size(result);
+		}
+		UNPROTECT(1);
+		MemoryContextReset(scratch);
+	}
+
+	MemoryContextDelete(scratch);
+
+	return plr_bench_result(fcinfo, loops, (int64) nrows * ncols, total,
+							pg_bytes, r_bytes);
+}
+
+/*
+ * plr_bench_frame_tuplestore(coltypes regtype[], nrows int4, loops int4)
+ *		get_frame_tuplestore() on a data.frame of the given shape, built
+ *		from the same tuple table as above
+ */
+PG_FUNCTION_INFO_V1(plr_bench_frame_tuplestore);
+Datum
+plr_bench_frame_tuplestore(PG_FUNCTION_ARGS)
+{
+	ArrayType	   *coltypes = PG_GETARG_ARRAYTYPE_P(0);
+	int				nrows = PG_GETARG_INT32(1);
+	int				loops = PG_GETARG_INT32(2);
+	Oid			   *typids;
+	int				ncols;
+	TupleDesc		tupdesc;
+	HeapTuple	   *tuples;
+	AttInMetadata  *attinmeta;
+	plr_function   *function;
+	SEXP			frame;
+	MemoryContext	scratch;
+	MemoryContext	oldcontext;
+	instr_time		start;
+	instr_time		end;
+	instr_time		total;
+	int64			base_bytes;
+	int64			pg_bytes = -1;
+	int64			r_bytes;
+	int				i;
+
+	plr_bench_check_loops(loops);
+	if (nrows < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of rows must be positive")));
+
+	plr_init();
+
+	typids = plr_bench_coltypes(coltypes, &ncols);
+	for (i = 0; i < ncols; i++)
+		if (type_is_array(typids[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("array columns are not supported here")));
+	tuples = plr_bench_tuples(typids, ncols, nrows, &tupdesc);
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+
+	/* only array columns look at the function */
+	function = (plr_function *) palloc0(sizeof(plr_function));
+
+	PROTECT(frame = pg_tuple_get_r_frame(nrows, tuples, tupdesc, false));
+	r_bytes = plr_bench_object_size(frame);
+
+	scratch = plr_bench_context();
+	base_bytes = plr_bench_allocated(scratch);
+	INSTR_TIME_SET_ZERO(total);
+
+	for (i = 0; i < loops; i++)
+	{
+		Tuplestorestate *tupstore;
+
+		oldcontext = MemoryContextSwitchTo(scratch);
+		INSTR_TIME_SET_CURRENT(start);
+		tupstore = get_frame_tuplestore(frame, function, attinmeta,
+										scratch, true);
+		INSTR_TIME_SET_CURRENT(end);
+		MemoryContextSwitchTo(oldcontext);
+		INSTR_TIME_ACCUM_DIFF(total, end, start);
+
+		if (i == 0 && base_bytes >= 0)
+			pg_bytes = plr_bench_allocated(scratch) - base_bytes;
+		tuplestore_end(tupstore);
+		MemoryContextReset(scratch);
+	}
+
+	MemoryContextDelete(scratch);
+	UNPROTECT(1);
+
+	return plr_bench_result(fcinfo, loops, (int64) nrows * ncols, total,
+							pg_bytes, r_bytes);
+}
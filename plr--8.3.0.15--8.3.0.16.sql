@@ -0,0 +1,62 @@
+/* plr/plr--8.3.0.15--8.3.0.16.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION plr UPDATE TO '8.3.0.16'" to load this file. \quit
+
+CREATE TYPE plr_stat_functions_type AS (funcid oid, funcname name,
+  calls int8, total_time float8, args_time float8, eval_time float8,
+  result_time float8, rows_in int8, rows_out int8, bytes_in int8,
+  bytes_out int8, gc_count int8, gc_time float8, gc_max_time float8);
+CREATE OR REPLACE FUNCTION plr_stat_functions ()
+RETURNS SETOF plr_stat_functions_type
+AS 'MODULE_PATHNAME','plr_stat_functions'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_stat_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_stat_reset'
+LANGUAGE C;
+REVOKE EXECUTE ON FUNCTION plr_stat_reset () FROM PUBLIC;
+
+CREATE TYPE plr_r_memory_type AS (heap text, used int8, used_bytes int8,
+  gc_trigger_bytes int8, max_used_bytes int8, limit_bytes int8);
+CREATE OR REPLACE FUNCTION plr_r_memory ()
+RETURNS SETOF plr_r_memory_type
+AS 'MODULE_PATHNAME','plr_r_memory'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_gc ()
+RETURNS float8
+AS 'MODULE_PATHNAME','plr_gc'
+LANGUAGE C;
+
+CREATE TYPE plr_object_cache_type AS (entries int8, bytes int8,
+  budget_bytes int8, hits int8, misses int8, evictions int8);
+CREATE OR REPLACE FUNCTION plr_object_cache ()
+RETURNS SETOF plr_object_cache_type
+AS 'MODULE_PATHNAME','plr_object_cache'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_object_cache_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_object_cache_reset'
+LANGUAGE C;
+
+CREATE TYPE plr_shared_objects_type AS (name text, version int8,
+  bytes int8, reads int8);
+CREATE OR REPLACE FUNCTION plr_shared_objects ()
+RETURNS SETOF plr_shared_objects_type
+AS 'MODULE_PATHNAME','plr_shared_objects'
+LANGUAGE C;
+
+CREATE TYPE plr_profile_type AS (funcid oid, funcname name, stack text,
+  self_samples int8, total_samples int8);
+CREATE OR REPLACE FUNCTION plr_profile ()
+RETURNS SETOF plr_profile_type
+AS 'MODULE_PATHNAME','plr_profile'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_profile_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_profile_reset'
+LANGUAGE C;
@@ -0,0 +1,158 @@
+-- keep this in sync with the plr.sql.in legacy install file
+
+CREATE FUNCTION plr_call_handler()
+RETURNS LANGUAGE_HANDLER
+AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE LANGUAGE plr HANDLER plr_call_handler;
+
+CREATE OR REPLACE FUNCTION plr_version ()
+RETURNS text
+AS 'MODULE_PATHNAME','plr_version'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION reload_plr_modules ()
+RETURNS text
+AS 'MODULE_PATHNAME','reload_plr_modules'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION install_rcmd (text)
+RETURNS text
+AS 'MODULE_PATHNAME','install_rcmd'
+LANGUAGE C WITH (isstrict);
+REVOKE EXECUTE ON FUNCTION install_rcmd (text) FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION plr_singleton_array (float8)
+RETURNS float8[]
+AS 'MODULE_PATHNAME','plr_array'
+LANGUAGE C WITH (isstrict);
+
+CREATE OR REPLACE FUNCTION plr_array_push (_float8, float8)
+RETURNS float8[]
+AS 'MODULE_PATHNAME','plr_array_push'
+LANGUAGE C WITH (isstrict);
+
+CREATE OR REPLACE FUNCTION plr_array_accum (_float8, float8)
+RETURNS float8[]
+AS 'MODULE_PATHNAME','plr_array_accum'
+LANGUAGE C;
+
+CREATE TYPE plr_environ_type AS (name text, value text);
+CREATE OR REPLACE FUNCTION plr_environ ()
+RETURNS SETOF plr_environ_type
+AS 'MODULE_PATHNAME','plr_environ'
+LANGUAGE C;
+
+REVOKE EXECUTE ON FUNCTION plr_environ() FROM PUBLIC;
+
+CREATE TYPE r_typename AS (typename text, typeoid oid);
+CREATE OR REPLACE FUNCTION r_typenames()
+RETURNS SETOF r_typename AS '
+  x <- ls(name = .GlobalEnv, pat = "OID")
+  y <- vector()
+  for (i in 1:length(x)) {y[i] <- eval(parse(text = x[i]))}
+  data.frame(typename = x, typeoid = y)
+' language 'plr';
+
+CREATE OR REPLACE FUNCTION load_r_typenames()
+RETURNS text AS '
+  sql <- "select upper(typname::text) || ''OID'' as typename, oid from pg_catalog.pg_type where typtype = ''b'' order by typname"
+  rs <- pg.spi.exec(sql)
+  for(i in 1:nrow(rs))
+  {
+    typobj <- rs[i,1]
+    typval <- rs[i,2]
+    if (substr(typobj,1,1) == "_")
+      typobj <- paste("ARRAYOF", substr(typobj,2,nchar(typobj)), sep="")
+    assign(typobj, typval, .GlobalEnv)
+  }
+  return("OK")
+' language 'plr';
+
+CREATE TYPE r_version_type AS (name text, value text);
+CREATE OR REPLACE FUNCTION r_version()
+RETURNS setof r_version_type as '
+  cbind(names(version),unlist(version))
+' language 'plr';
+
+CREATE OR REPLACE FUNCTION plr_set_rhome (text)
+RETURNS text
+AS 'MODULE_PATHNAME','plr_set_rhome'
+LANGUAGE C WITH (isstrict);
+REVOKE EXECUTE ON FUNCTION plr_set_rhome (text) FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION plr_unset_rhome ()
+RETURNS text
+AS 'MODULE_PATHNAME','plr_unset_rhome'
+LANGUAGE C;
+REVOKE EXECUTE ON FUNCTION plr_unset_rhome () FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION plr_set_display (text)
+RETURNS text
+AS 'MODULE_PATHNAME','plr_set_display'
+LANGUAGE C WITH (isstrict);
+REVOKE EXECUTE ON FUNCTION plr_set_display (text) FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION plr_get_raw (bytea)
+RETURNS bytea
+AS 'MODULE_PATHNAME','plr_get_raw'
+LANGUAGE C WITH (isstrict);
+
+CREATE TYPE plr_stat_functions_type AS (funcid oid, funcname name,
+  calls int8, total_time float8, args_time float8, eval_time float8,
+  result_time float8, rows_in int8, rows_out int8, bytes_in int8,
+  bytes_out int8, gc_count int8, gc_time float8, gc_max_time float8);
+CREATE OR REPLACE FUNCTION plr_stat_functions ()
+RETURNS SETOF plr_stat_functions_type
+AS 'MODULE_PATHNAME','plr_stat_functions'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_stat_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_stat_reset'
+LANGUAGE C;
+REVOKE EXECUTE ON FUNCTION plr_stat_reset () FROM PUBLIC;
+
+CREATE TYPE plr_r_memory_type AS (heap text, used int8, used_bytes int8,
+  gc_trigger_bytes int8, max_used_bytes int8, limit_bytes int8);
+CREATE OR REPLACE FUNCTION plr_r_memory ()
+RETURNS SETOF plr_r_memory_type
+AS 'MODULE_PATHNAME','plr_r_memory'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_gc ()
+RETURNS float8
+AS 'MODULE_PATHNAME','plr_gc'
+LANGUAGE C;
+
+CREATE TYPE plr_object_cache_type AS (entries int8, bytes int8,
+  budget_bytes int8, hits int8, misses int8, evictions int8);
+CREATE OR REPLACE FUNCTION plr_object_cache ()
+RETURNS SETOF plr_object_cache_type
+AS 'MODULE_PATHNAME','plr_object_cache'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_object_cache_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_object_cache_reset'
+LANGUAGE C;
+
+CREATE TYPE plr_shared_objects_type AS (name text, version int8,
+  bytes int8, reads int8);
+CREATE OR REPLACE FUNCTION plr_shared_objects ()
+RETURNS SETOF plr_shared_objects_type
+AS 'MODULE_PATHNAME','plr_shared_objects'
+LANGUAGE C;
+
+CREATE TYPE plr_profile_type AS (funcid oid, funcname name, stack text,
+  self_samples int8, total_samples int8);
+CREATE OR REPLACE FUNCTION plr_profile ()
+RETURNS SETOF plr_profile_type
+AS 'MODULE_PATHNAME','plr_profile'
+LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION plr_profile_reset ()
+RETURNS void
+AS 'MODULE_PATHNAME','plr_profile_reset'
+LANGUAGE C;
+
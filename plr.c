@@ -41,10 +41,142 @@ MemoryContext plr_caller_context;
 MemoryContext plr_SPI_context = NULL;
 HTAB *plr_HashTable = (HTAB *) NULL;
 char *last_R_error_msg = NULL;
+int plr_max_heap_size = 0;
+int plr_gc_mode = PLR_GC_AUTO;
+int plr_gc_min_heap = 0;
+int plr_serialize_format = PLR_SERIALIZE_XDR;
+int plr_serialize_version = PLR_SERIALIZE_MAX_VERSION;
+int plr_serialize_compression = PLR_COMPRESS_NONE;
+int plr_object_cache_size = 0;
+bool plr_native_datetime = false;
+int plr_numeric_conversion = PLR_NUMERIC_DOUBLE;
+int plr_int8_conversion = PLR_INT8_DOUBLE;
+static char *plr_preload_packages = NULL;
+static bool plr_cache_modules = true;
+static bool plr_lazy_modules = false;
 
 static bool	plr_pm_init_done = false;
 static bool	plr_be_init_done = false;
 
+/* builtins and packages are in R, possibly since before the fork */
+static bool	plr_r_env_done = false;
+static bool	plr_r_env_preloaded = false;
+
+/* md5 of the source of each plr_modules entry evaluated in this backend */
+static char **plr_loaded_modules = NULL;
+static int	plr_num_loaded_modules = 0;
+
+/* R environment naming the deferred entries evaluated since by their md5 */
+static SEXP	plr_forced_modules = NULL;
+
+/* R code ran since PL/R last collected garbage */
+static bool	plr_gc_pending = false;
+
+/*
+ * number of executor runs and utility statements running, to find the
+ * end of top level statements
+ */
+static int	plr_nesting_level = 0;
+#if PG_VERSION_NUM >= 80400
+#if PG_VERSION_NUM >= 100000
+#define PLR_EXECUTOR_RUN_PARAMS \
+	QueryDesc *queryDesc, ScanDirection direction, uint64 count, \
+	bool execute_once
+#define PLR_EXECUTOR_RUN_ARGS	queryDesc, direction, count, execute_once
+#elif PG_VERSION_NUM >= 90600
+#define PLR_EXECUTOR_RUN_PARAMS \
+	QueryDesc *queryDesc, ScanDirection direction, uint64 count
+#define PLR_EXECUTOR_RUN_ARGS	queryDesc, direction, count
+#else
+#define PLR_EXECUTOR_RUN_PARAMS \
+	QueryDesc *queryDesc, ScanDirection direction, long count
+#define PLR_EXECUTOR_RUN_ARGS	queryDesc, direction, count
+#endif
+
+#if PG_VERSION_NUM >= 140000
+#define PLR_PROCESS_UTILITY_PARAMS \
+	PlannedStmt *pstmt, const char *queryString, bool readOnlyTree, \
+	ProcessUtilityContext context, ParamListInfo params, \
+	QueryEnvironment *queryEnv, DestReceiver *dest, QueryCompletion *qc
+#define PLR_PROCESS_UTILITY_ARGS \
+	pstmt, queryString, readOnlyTree, context, params, queryEnv, dest, qc
+#elif PG_VERSION_NUM >= 130000
+#define PLR_PROCESS_UTILITY_PARAMS \
+	PlannedStmt *pstmt, const char *queryString, \
+	ProcessUtilityContext context, ParamListInfo params, \
+	QueryEnvironment *queryEnv, DestReceiver *dest, QueryCompletion *qc
+#define PLR_PROCESS_UTILITY_ARGS \
+	pstmt, queryString, context, params, queryEnv, dest, qc
+#elif PG_VERSION_NUM >= 100000
+#define PLR_PROCESS_UTILITY_PARAMS \
+	PlannedStmt *pstmt, const char *queryString, \
+	ProcessUtilityContext context, ParamListInfo params, \
+	QueryEnvironment *queryEnv, DestReceiver *dest, char *completionTag
+#define PLR_PROCESS_UTILITY_ARGS \
+	pstmt, queryString, context, params, queryEnv, dest, completionTag
+#elif PG_VERSION_NUM >= 90300
+#define PLR_PROCESS_UTILITY_PARAMS \
+	Node *parsetree, const char *queryString, \
+	ProcessUtilityContext context, ParamListInfo params, \
+	DestReceiver *dest, char *completionTag
+#define PLR_PROCESS_UTILITY_ARGS \
+	parsetree, queryString, context, params, dest, completionTag
+#else
+#define PLR_PROCESS_UTILITY_PARAMS \
+	Node *parsetree, const char *queryString, ParamListInfo params, \
+	bool isTopLevel, DestReceiver *dest, char *completionTag
+#define PLR_PROCESS_UTILITY_ARGS \
+	parsetree, queryString, params, isTopLevel, dest, completionTag
+#endif
+
+static ExecutorRun_hook_type prev_ExecutorRun = NULL;
+#if PG_VERSION_NUM >= 90100
+static ExecutorFinish_hook_type prev_ExecutorFinish = NULL;
+#endif
+static ExecutorEnd_hook_type prev_ExecutorEnd = NULL;
+static ProcessUtility_hook_type prev_ProcessUtility = NULL;
+
+static const struct config_enum_entry plr_gc_mode_options[] = {
+	{"auto", PLR_GC_AUTO, false},
+	{"statement", PLR_GC_STATEMENT, false},
+	{"transaction", PLR_GC_TRANSACTION, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry plr_numeric_conversion_options[] = {
+	{"double", PLR_NUMERIC_DOUBLE, false},
+	{"character", PLR_NUMERIC_CHARACTER, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry plr_int8_conversion_options[] = {
+	{"double", PLR_INT8_DOUBLE, false},
+	{"integer64", PLR_INT8_INTEGER64, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry plr_serialize_format_options[] = {
+	{"xdr", PLR_SERIALIZE_XDR, false},
+	{"binary", PLR_SERIALIZE_BINARY, false},
+	{NULL, 0, false}
+};
+
+/* only the methods this server can decompress */
+static const struct config_enum_entry plr_serialize_compression_options[] = {
+	{"none", PLR_COMPRESS_NONE, false},
+#if PG_VERSION_NUM >= 90500
+	{"pglz", PLR_COMPRESS_PGLZ, false},
+#endif
+#ifdef USE_LZ4
+	{"lz4", PLR_COMPRESS_LZ4, false},
+#endif
+#ifdef USE_ZSTD
+	{"zstd", PLR_COMPRESS_ZSTD, false},
+#endif
+	{NULL, 0, false}
+};
+#endif
+
 /* namespace OID for the PL/R language handler function */
 static Oid plr_nspOid = InvalidOid;
 
@@ -58,6 +190,72 @@ int R_SignalHandlers = 1;  /* Exposed in R_interface.h */
 #define MAX_PRONAME_LEN		NAMEDATALEN
 
 #define OPTIONS_NULL_CMD	"options(error = expression(NULL))"
+/*
+ * Returns the expressions of a plr_modules entry, parsed and byte-compiled,
+ * from the cache file named by hash when there is one, otherwise writing
+ * it. A broken cache only costs the caching.
+ */
+#define MODULE_PREPARE_CMD \
+			"function(src, hash) {\n" \
+			"  exprs <- NULL\n" \
+			"  cache <- NA\n" \
+			"  if (!is.na(hash)) {\n" \
+			"    cache <- file.path(\"" PLR_MODULE_CACHE_DIR "\", " \
+			"paste(hash, getRversion(), \"rds\", sep = \".\"))\n" \
+			"    if (file.exists(cache))\n" \
+			"      exprs <- tryCatch(readRDS(cache), error = function(e) NULL)\n" \
+			"  }\n" \
+			"  if (is.null(exprs)) {\n" \
+			"    exprs <- as.list(parse(text = src, keep.source = FALSE))\n" \
+			"    if (!is.na(cache)) {\n" \
+			"      exprs <- tryCatch(lapply(exprs, compiler::compile), " \
+			"error = function(e) exprs)\n" \
+			"      tmp <- paste(cache, Sys.getpid(), sep = \".\")\n" \
+			"      tryCatch({\n" \
+			"        dir.create(dirname(cache), showWarnings = FALSE)\n" \
+			"        saveRDS(exprs, tmp)\n" \
+			"        file.rename(tmp, cache)\n" \
+			"      }, error = function(e) unlink(tmp))\n" \
+			"    }\n" \
+			"  }\n" \
+			"  exprs\n" \
+			"}"
+/*
+ * Binds every symbol a plr_modules entry assigns at top level to a promise
+ * that evaluates the whole module on first use, and records the hash of
+ * the module in forced once that succeeded. Should it fail, the promises
+ * are bound again for the next use. Modules doing anything else at top
+ * level are left to be evaluated now, returning FALSE.
+ */
+#define MODULE_DEFER_CMD \
+			"function(exprs, hash, forced) {\n" \
+			"  syms <- character(0)\n" \
+			"  for (e in exprs) {\n" \
+			"    if (typeof(e) == \"bytecode\")\n" \
+			"      e <- compiler::disassemble(e)[[3L]][[1L]]\n" \
+			"    if (!is.call(e) || length(e) != 3L || !is.name(e[[2L]]) ||\n" \
+			"        !(as.character(e[[1L]]) %in% c(\"<-\", \"=\", \"<<-\")))\n" \
+			"      return(FALSE)\n" \
+			"    syms <- c(syms, as.character(e[[2L]]))\n" \
+			"  }\n" \
+			"  env <- globalenv()\n" \
+			"  done <- FALSE\n" \
+			"  load <- function() if (!done) {\n" \
+			"    on.exit(if (!done) bind())\n" \
+			"    for (e in exprs) eval(e, env)\n" \
+			"    done <<- TRUE\n" \
+			"    assign(hash, TRUE, envir = forced)\n" \
+			"  }\n" \
+			"  bind <- function() for (s in unique(syms)) local({\n" \
+			"    sym <- s\n" \
+			"    delayedAssign(sym, { load(); get(sym, envir = env) }, " \
+			"assign.env = env)\n" \
+			"  })\n" \
+			"  bind()\n" \
+			"  TRUE\n" \
+			"}"
+/* hashes of the deferred plr_modules entries that were evaluated since */
+#define MODULE_FORCED_CMD	"new.env(hash = TRUE)"
 #define THROWRERROR_CMD \
 			"pg.throwrerror <-function(msg) " \
 			"{" \
@@ -83,19 +281,76 @@ int R_SignalHandlers = 1;  /* Exposed in R_interface.h */
 			"pg.quoteident <-function(sql) " \
 			"{.Call(\"plr_quote_ident\", sql)}"
 #define SPI_EXEC_CMD \
-			"pg.spi.exec <-function(sql) {.Call(\"plr_SPI_exec\", sql)}"
+			"pg.spi.exec <-function(sql, limit = 0L, sample = FALSE, " \
+			"array.matrix = FALSE) " \
+			"{.Call(\"plr_SPI_exec\", sql, limit, sample, array.matrix)}"
 #define SPI_PREPARE_CMD \
 			"pg.spi.prepare <-function(sql, argtypes = NA) " \
 			"{.Call(\"plr_SPI_prepare\", sql, argtypes)}"
 #define SPI_EXECP_CMD \
-			"pg.spi.execp <-function(sql, argvalues = NA) " \
-			"{.Call(\"plr_SPI_execp\", sql, argvalues)}"
+			"pg.spi.execp <-function(sql, argvalues = NA, limit = 0L, sample = FALSE, " \
+			"array.matrix = FALSE) " \
+			"{.Call(\"plr_SPI_execp\", sql, argvalues, limit, sample, array.matrix)}"
 #define SPI_CURSOR_OPEN_CMD \
 			"pg.spi.cursor_open<-function(cursor_name,plan,argvalues=NA) " \
 			"{.Call(\"plr_SPI_cursor_open\",cursor_name,plan,argvalues)}"
 #define SPI_CURSOR_FETCH_CMD \
-			"pg.spi.cursor_fetch<-function(cursor,forward,rows) " \
-			"{.Call(\"plr_SPI_cursor_fetch\",cursor,forward,rows)}"
+			"pg.spi.cursor_fetch<-function(cursor,forward,rows,as.frame=TRUE) " \
+			"{.Call(\"plr_SPI_cursor_fetch\",cursor,forward,rows,as.frame)}"
+#define SPI_CURSOR_FETCH_INTO_CMD \
+			"pg.spi.cursor_fetch_into<-function(cursor,forward,rows,frame) " \
+			"{.Call(\"plr_SPI_cursor_fetch_into\",cursor,forward,rows,frame)}"
+#define SPI_CURSOR_ITER_CMD \
+			"pg.spi.cursor_iter <- function(plan, argvalues = NA, " \
+			"batch = 1000L, prefetch = TRUE, limit = 0L) {\n" \
+			"  it <- new.env(parent = emptyenv())\n" \
+			"  it$cursor <- pg.spi.cursor_open(NA, plan, argvalues)\n" \
+			"  it$batch <- as.integer(batch)\n" \
+			"  it$remaining <- if (limit > 0) as.integer(limit) else NA\n" \
+			"  it$prefetch <- prefetch\n" \
+			"  it$ahead <- NULL\n" \
+			"  it$done <- FALSE\n" \
+			"  class(it) <- \"pg.spi.cursor_iter\"\n" \
+			"  if (prefetch)\n" \
+			"    pg.spi.iter_has_next(it)\n" \
+			"  return(it)\n" \
+			"}"
+#define SPI_ITER_HAS_NEXT_CMD \
+			"pg.spi.iter_has_next <- function(it) {\n" \
+			"  if (it$done)\n" \
+			"    return(FALSE)\n" \
+			"  if (is.null(it$ahead)) {\n" \
+			"    n <- it$batch\n" \
+			"    if (!is.na(it$remaining))\n" \
+			"      n <- min(n, it$remaining)\n" \
+			"    if (n > 0)\n" \
+			"      it$ahead <- pg.spi.cursor_fetch(it$cursor, TRUE, n)\n" \
+			"    if (is.null(it$ahead))\n" \
+			"      it$done <- TRUE\n" \
+			"    else if (!is.na(it$remaining))\n" \
+			"      it$remaining <- it$remaining - nrow(it$ahead)\n" \
+			"  }\n" \
+			"  return(!it$done)\n" \
+			"}"
+#define SPI_ITER_NEXT_CMD \
+			"pg.spi.iter_next <- function(it) {\n" \
+			"  if (!pg.spi.iter_has_next(it))\n" \
+			"    return(NULL)\n" \
+			"  data <- it$ahead\n" \
+			"  it$ahead <- NULL\n" \
+			"  if (it$prefetch)\n" \
+			"    pg.spi.iter_has_next(it)\n" \
+			"  return(data)\n" \
+			"}"
+#define SPI_ITER_CLOSE_CMD \
+			"pg.spi.iter_close <- function(it) {\n" \
+			"  if (!is.null(it$cursor))\n" \
+			"    pg.spi.cursor_close(it$cursor)\n" \
+			"  it$cursor <- NULL\n" \
+			"  it$ahead <- NULL\n" \
+			"  it$done <- TRUE\n" \
+			"  invisible(NULL)\n" \
+			"}"
 #define SPI_CURSOR_MOVE_CMD \
 			"pg.spi.cursor_move<-function(cursor,forward,rows) " \
 			"{.Call(\"plr_SPI_cursor_move\",cursor,forward,rows)}"
@@ -105,6 +360,15 @@ int R_SignalHandlers = 1;  /* Exposed in R_interface.h */
 #define SPI_LASTOID_CMD \
 			"pg.spi.lastoid <-function() " \
 			"{.Call(\"plr_SPI_lastoid\")}"
+#define SHARED_PUT_CMD \
+			"pg.shared.put <-function(name, obj) " \
+			"{.Call(\"plr_shared_put\", name, obj)}"
+#define SHARED_GET_CMD \
+			"pg.shared.get <-function(name) " \
+			"{.Call(\"plr_shared_get\", name)}"
+#define SHARED_REMOVE_CMD \
+			"pg.shared.remove <-function(name) " \
+			"{.Call(\"plr_shared_rm\", name)}"
 #define SPI_DBDRIVER_CMD \
 			"dbDriver <-function(db_name)\n" \
 			"{return(NA)}"
@@ -114,7 +378,7 @@ int R_SignalHandlers = 1;  /* Exposed in R_interface.h */
 #define SPI_DBSENDQUERY_CMD \
 			"dbSendQuery <- function(conn, sql) {\n" \
 			"plan <- pg.spi.prepare(sql)\n" \
-			"cursor_obj <- pg.spi.cursor_open(\"plr_cursor\",plan)\n" \
+			"cursor_obj <- pg.spi.cursor_open(NA,plan)\n" \
 			"return(cursor_obj)\n" \
 			"}"
 #define SPI_DBFETCH_CMD \
@@ -163,8 +427,31 @@ int R_SignalHandlers = 1;  /* Exposed in R_interface.h */
  * static declarations
  */
 static void plr_atexit(void);
+static void plr_gc_collect_pending(void);
+#if PG_VERSION_NUM >= 80400
+static void plr_gc_ExecutorRun(PLR_EXECUTOR_RUN_PARAMS);
+#if PG_VERSION_NUM >= 90100
+static void plr_gc_ExecutorFinish(QueryDesc *queryDesc);
+#endif
+static void plr_gc_ExecutorEnd(QueryDesc *queryDesc);
+static void plr_gc_ProcessUtility(PLR_PROCESS_UTILITY_PARAMS);
+#endif
+static void plr_gc_xact_callback(XactEvent event, void *arg);
 static void plr_load_builtins(Oid funcid);
+static void plr_load_packages(void);
+static void plr_load_r_env(Oid funcid);
+static void plr_backend_tempdir(void);
+static bool plr_load_module(const char *src, const char *hash, bool lazy);
+static SEXP plr_module_fn(const char *cmd, SEXP *fn);
+static bool plr_module_loaded(const char *hash);
+static bool plr_module_forced(const char *hash);
 static void plr_init_all(Oid funcid);
+static plr_trigger_args *plr_trigger_args_find(plr_function *function,
+											   TriggerData *trigdata);
+static plr_trigger_args *plr_trigger_args_remember(plr_function *function,
+												   TriggerData *trigdata,
+												   SEXP rargs);
+static void plr_trigger_args_free(plr_trigger_args *entry);
 static Datum plr_trigger_handler(PG_FUNCTION_ARGS);
 static Datum plr_func_handler(PG_FUNCTION_ARGS);
 static plr_function *compile_plr_function(FunctionCallInfo fcinfo);
@@ -172,6 +459,8 @@ static plr_function *do_compile(FunctionCallInfo fcinfo,
 								HeapTuple procTup,
 								plr_func_hashkey *hashkey);
 static SEXP plr_parse_func_body(const char *body);
+static SEXP plr_call_function(plr_function *function, SEXP fun, SEXP rargs);
+static Size plr_arg_size(plr_function *function, int i, Datum value);
 static SEXP plr_convertargs(plr_function *function, Datum *arg, bool *argnull, FunctionCallInfo fcinfo);
 static void plr_error_callback(void *arg);
 static Oid getNamespaceOidFromFunctionOid(Oid fnOid);
@@ -234,6 +523,7 @@ load_r_cmd(const char *cmd)
 	if (!plr_pm_init_done)
 		plr_init();
 
+	plr_stat_gc_forget();
 	PROTECT(cmdSexp = NEW_CHARACTER(1));
 	SET_STRING_ELT(cmdSexp, 0, COPY_TO_USER_STRING(cmd));
 	PROTECT(cmdexpr = R_PARSEVECTOR(cmdSexp, -1, &status));
@@ -323,6 +613,366 @@ plr_atexit(void)
 }
 
 
+/*
+ * _PG_init() - library load-time initialization
+ *
+ * DO NOT make this static nor change its name!
+ */
+void
+_PG_init(void)
+{
+	DefineCustomBoolVariable("plr.track_functions",
+							 "Collects execution statistics of PL/R functions.",
+							 "The statistics are shown by plr_stat_functions(). "
+							 "They are aggregated across backends only when "
+							 "PL/R is in shared_preload_libraries.",
+							 &plr_track_functions,
+#if PG_VERSION_NUM >= 80400
+							 false,
+#endif
+							 PGC_SUSET,
+#if PG_VERSION_NUM >= 80400
+							 0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("plr.max_heap_size",
+							"Limits the size of each of the R heaps of a backend.",
+							"The limit applies separately to R's cons cells and "
+							"vector cells. Zero means no limit.",
+							&plr_max_heap_size,
+#if PG_VERSION_NUM >= 80400
+							0,
+#endif
+							0,
+							MAX_KILOBYTES,
+							PGC_SUSET,
+#if PG_VERSION_NUM >= 80400
+							GUC_UNIT_KB,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("plr.profile_functions",
+							 "Samples PL/R function calls with the R profiler.",
+							 "The samples are shown by plr_profile(). Set it "
+							 "for single functions with ALTER FUNCTION ... SET.",
+							 &plr_profile_functions,
+#if PG_VERSION_NUM >= 80400
+							 false,
+#endif
+							 PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							 0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("plr.profile_interval",
+							"Sets the sampling interval of the R profiler.",
+							NULL,
+							&plr_profile_interval,
+#if PG_VERSION_NUM >= 80400
+							20,
+#endif
+							1,
+							1000,
+							PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							GUC_UNIT_MS,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+#if PG_VERSION_NUM >= 80400
+	DefineCustomEnumVariable("plr.gc_mode",
+							 "Sets when PL/R collects R garbage itself.",
+							 "With statement or transaction, R's heap is "
+							 "collected after each statement or transaction "
+							 "that ran R code, besides R's own collections.",
+							 &plr_gc_mode,
+							 PLR_GC_AUTO,
+							 plr_gc_mode_options,
+							 PGC_USERSET,
+							 0,
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+#endif
+
+	DefineCustomIntVariable("plr.gc_min_heap",
+							"Sets the minimum size of each of the R heaps.",
+							"R does not collect garbage until a heap reaches "
+							"this size. Takes effect when R starts.",
+							&plr_gc_min_heap,
+#if PG_VERSION_NUM >= 80400
+							0,
+#endif
+							0,
+							MAX_KILOBYTES,
+							PGC_SUSET,
+#if PG_VERSION_NUM >= 80400
+							GUC_UNIT_KB,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+#if PG_VERSION_NUM >= 80400
+	DefineCustomEnumVariable("plr.serialize_format",
+							 "Sets the format of R objects returned as bytea.",
+							 "xdr is portable between machines, binary uses "
+							 "the native byte order and is faster. Both are "
+							 "read back in either format.",
+							 &plr_serialize_format,
+							 PLR_SERIALIZE_XDR,
+							 plr_serialize_format_options,
+							 PGC_USERSET,
+							 0,
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomEnumVariable("plr.serialize_compression",
+							 "Sets the compression of R objects returned as bytea.",
+							 "Only serializations of at least 1kB that "
+							 "compress are stored compressed.",
+							 &plr_serialize_compression,
+							 PLR_COMPRESS_NONE,
+							 plr_serialize_compression_options,
+							 PGC_USERSET,
+							 0,
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+#endif
+
+	DefineCustomIntVariable("plr.serialize_version",
+							"Sets the R serialization version of R objects returned as bytea.",
+							"Version 3 needs R 3.5.0 or later to read and "
+							"keeps compact ALTREP objects compact.",
+							&plr_serialize_version,
+#if PG_VERSION_NUM >= 80400
+							PLR_SERIALIZE_MAX_VERSION,
+#endif
+							2,
+							PLR_SERIALIZE_MAX_VERSION,
+							PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("plr.object_cache_size",
+							"Sets the size of the cache of R objects unserialized from bytea arguments.",
+							"Calls given the same bytea value again, such as a "
+							"model stored in a table, reuse the R object. Zero "
+							"disables the cache.",
+							&plr_object_cache_size,
+#if PG_VERSION_NUM >= 80400
+							0,
+#endif
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							GUC_UNIT_KB,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("plr.shared_objects_size",
+							"Sets the maximum size of the shared R object store.",
+							"The least recently used objects are evicted to make "
+							"room for new ones.",
+							&plr_shared_objects_size,
+#if PG_VERSION_NUM >= 80400
+							65536,
+#endif
+							1,
+							MAX_KILOBYTES,
+							PGC_SIGHUP,
+#if PG_VERSION_NUM >= 80400
+							GUC_UNIT_KB,
+#endif
+#if PG_VERSION_NUM >= 90100
+							NULL,
+#endif
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("plr.native_datetime",
+							 "Passes date and time values to R as Date, POSIXct and difftime.",
+							 "Otherwise date, timestamp, timestamptz and interval "
+							 "values are passed as character strings.",
+							 &plr_native_datetime,
+#if PG_VERSION_NUM >= 80400
+							 false,
+#endif
+							 PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							 0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+#if PG_VERSION_NUM >= 80400
+	DefineCustomEnumVariable("plr.numeric_conversion",
+							 "Sets how numeric values are passed to R.",
+							 "double converts them to the nearest R numeric, "
+							 "character passes their exact decimal text.",
+							 &plr_numeric_conversion,
+							 PLR_NUMERIC_DOUBLE,
+							 plr_numeric_conversion_options,
+							 PGC_USERSET,
+							 0,
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomEnumVariable("plr.int8_conversion",
+							 "Sets how int8 values are passed to R.",
+							 "double converts them to the nearest R numeric, "
+							 "integer64 passes them exactly as bit64 integer64 "
+							 "vectors.",
+							 &plr_int8_conversion,
+							 PLR_INT8_DOUBLE,
+							 plr_int8_conversion_options,
+							 PGC_USERSET,
+							 0,
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+#endif
+
+	DefineCustomBoolVariable("plr.cache_modules",
+							 "Caches plr_modules entries parsed and byte-compiled.",
+							 "The cache is kept in files under the data "
+							 "directory, shared by all backends.",
+							 &plr_cache_modules,
+#if PG_VERSION_NUM >= 80400
+							 true,
+#endif
+							 PGC_SUSET,
+#if PG_VERSION_NUM >= 80400
+							 0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("plr.lazy_modules",
+							 "Defers evaluating plr_modules entries until first use.",
+							 "Entries that only assign objects at top level are "
+							 "evaluated when one of the objects is first used, "
+							 "unless their modeager column is true.",
+							 &plr_lazy_modules,
+#if PG_VERSION_NUM >= 80400
+							 false,
+#endif
+							 PGC_USERSET,
+#if PG_VERSION_NUM >= 80400
+							 0,
+#endif
+#if PG_VERSION_NUM >= 90100
+							 NULL,
+#endif
+							 NULL,
+							 NULL);
+
+	DefineCustomStringVariable("plr.preload_packages",
+							   "Lists R packages to attach when R starts.",
+							   "A comma separated list of package names. When "
+							   "PL/R is in shared_preload_libraries, R starts "
+							   "in the postmaster and the packages are "
+							   "attached once for all backends.",
+							   &plr_preload_packages,
+#if PG_VERSION_NUM >= 80400
+							   "",
+#endif
+							   PGC_POSTMASTER,
+#if PG_VERSION_NUM >= 80400
+							   GUC_LIST_INPUT,
+#endif
+#if PG_VERSION_NUM >= 90100
+							   NULL,
+#endif
+							   NULL,
+							   NULL);
+
+	EmitWarningsOnPlaceholders("plr");
+
+#if PG_VERSION_NUM >= 80400
+	prev_ExecutorRun = ExecutorRun_hook;
+	ExecutorRun_hook = plr_gc_ExecutorRun;
+#if PG_VERSION_NUM >= 90100
+	prev_ExecutorFinish = ExecutorFinish_hook;
+	ExecutorFinish_hook = plr_gc_ExecutorFinish;
+#endif
+	prev_ExecutorEnd = ExecutorEnd_hook;
+	ExecutorEnd_hook = plr_gc_ExecutorEnd;
+	prev_ProcessUtility = ProcessUtility_hook;
+	ProcessUtility_hook = plr_gc_ProcessUtility;
+#endif
+	RegisterXactCallback(plr_gc_xact_callback, NULL);
+
+	plr_phase_init();
+	plr_stat_shmem_request();
+	plr_shared_shmem_request();
+
+#if PG_VERSION_NUM >= 80400
+	/*
+	 * Preloaded into the postmaster: start R and load everything that does
+	 * not need a database now, so that backends fork with a warm interpreter
+	 * and share its pages copy-on-write. Backends of EXEC_BACKEND builds
+	 * load the library themselves and are left to initialize on first use.
+	 */
+	if (process_shared_preload_libraries_in_progress && !IsUnderPostmaster)
+	{
+		plr_init();
+		plr_load_r_env(InvalidOid);
+		plr_r_env_preloaded = true;
+	}
+#endif
+}
+
 /*
  * plr_init() - Initialize all that's safe to do in the postmaster
  *
@@ -333,12 +983,18 @@ plr_init(void)
 {
 	char	   *r_home;
 	int			rargc;
-	char	   *rargv[] = {"PL/R", "--slave", "--silent", "--no-save", "--no-restore"};
+	char	   *rargv[] = {"PL/R", "--slave", "--silent", "--no-save", "--no-restore",
+							NULL, NULL};
+	char		min_vsize[32];
+	char		min_nsize[32];
+	int			phase_level;
 
 	/* refuse to init more than once */
 	if (plr_pm_init_done)
 		return;
 
+	phase_level = plr_phase_start(PLR_PHASE_INIT, NULL);
+
 	/* refuse to start if R_HOME is not defined */
 	r_home = getenv("R_HOME");
 	if (r_home == NULL)
@@ -367,7 +1023,20 @@ plr_init(void)
 							 "of the user that starts the postmaster process.")));
 	}
 
-	rargc = sizeof(rargv)/sizeof(rargv[0]);
+	rargc = 5;
+
+	/* R only takes its minimum heap sizes at startup */
+	if (plr_gc_min_heap > 0)
+	{
+		/* R refuses more than 50M cons cells */
+		double		nsize = Min((double) plr_gc_min_heap * 1024.0 / PLR_NCELL_SIZE,
+								50000000.0);
+
+		snprintf(min_vsize, sizeof(min_vsize), "--min-vsize=%dK", plr_gc_min_heap);
+		snprintf(min_nsize, sizeof(min_nsize), "--min-nsize=%.0f", nsize);
+		rargv[rargc++] = min_vsize;
+		rargv[rargc++] = min_nsize;
+	}
 
 	/*
 	 * register an exit callback to handle the case where R does not initialize
@@ -404,6 +1073,7 @@ plr_init(void)
 	R_Interactive = false;
 #endif
 
+	plr_phase_end(phase_level);
 
 	plr_pm_init_done = true;
 }
@@ -436,9 +1106,17 @@ plr_load_builtins(Oid funcid)
 		SPI_EXECP_CMD,
 		SPI_CURSOR_OPEN_CMD,
 		SPI_CURSOR_FETCH_CMD,
+		SPI_CURSOR_FETCH_INTO_CMD,
+		SPI_CURSOR_ITER_CMD,
+		SPI_ITER_HAS_NEXT_CMD,
+		SPI_ITER_NEXT_CMD,
+		SPI_ITER_CLOSE_CMD,
 		SPI_CURSOR_MOVE_CMD,
 		SPI_CURSOR_CLOSE_CMD,
 		SPI_LASTOID_CMD,
+		SHARED_PUT_CMD,
+		SHARED_GET_CMD,
+		SHARED_REMOVE_CMD,
 		SPI_DBDRIVER_CMD,
 		SPI_DBCONN_CMD,
 		SPI_DBSENDQUERY_CMD,
@@ -474,6 +1152,68 @@ plr_load_builtins(Oid funcid)
 		load_r_cmd(cmds[j]);
 }
 
+/*
+ * plr_load_packages() - attach the packages of plr.preload_packages
+ */
+static void
+plr_load_packages(void)
+{
+	char	   *rawstring;
+	char	   *pkg;
+	char	   *p;
+	char	   *cmd;
+
+	if (plr_preload_packages == NULL || plr_preload_packages[0] == '\0')
+		return;
+
+	rawstring = pstrdup(plr_preload_packages);
+	for (pkg = strtok(rawstring, ","); pkg != NULL; pkg = strtok(NULL, ","))
+	{
+		/* trim the blanks around the name */
+		while (isspace((unsigned char) *pkg))
+			pkg++;
+		for (p = pkg + strlen(pkg); p > pkg && isspace((unsigned char) p[-1]); p--)
+			p[-1] = '\0';
+		if (*pkg == '\0')
+			continue;
+
+		/* R package names are letters, digits and periods */
+		for (p = pkg; *p; p++)
+			if (!isalnum((unsigned char) *p) && *p != '.')
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid R package name \"%s\" in "
+								"plr.preload_packages", pkg)));
+
+		cmd = (char *) palloc(strlen(pkg) + 64);
+		sprintf(cmd, "suppressPackageStartupMessages(library(\"%s\"))", pkg);
+		load_r_cmd(cmd);
+		pfree(cmd);
+	}
+	pfree(rawstring);
+}
+
+/*
+ * plr_load_r_env() - load the builtins and attach the preloaded packages,
+ *				  once per interpreter. Without a function, as in the
+ *				  postmaster, the library is found as $libdir/plr.
+ */
+static void
+plr_load_r_env(Oid funcid)
+{
+	MemoryContext		oldcontext;
+
+	if (plr_r_env_done)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	plr_load_builtins(funcid);
+	plr_load_packages();
+	MemoryContextSwitchTo(oldcontext);
+
+	plr_r_env_done = true;
+}
+
 /*
  * plr_load_modules() - Load procedures from
  *				  		table plr_modules (if it exists)
@@ -486,19 +1226,28 @@ plr_load_modules(void)
 {
 	int				spi_rc;
 	char		   *cmd;
+	char		   *hash;
 	int				i;
 	int				fno;
+	int				hno;
+	int				eno;
+	char		  **loaded;
+	int				nloaded;
 	MemoryContext	oldcontext;
 	char		   *modulesSql;
+	int				phase_level;
 
 	/* switch to SPI memory context */
 	SWITCHTO_PLR_SPI_CONTEXT(oldcontext);
 
+	phase_level = plr_phase_start(PLR_PHASE_MODULE_LOAD, NULL);
+
 	/*
 	 * Check if table plr_modules exists
 	 */
 	if (!haveModulesTable(plr_nspOid))
 	{
+		plr_phase_end(phase_level);
 		/* clean up if SPI was used, and regardless restore caller's context */
 		CLEANUP_PLR_SPI_CONTEXT(oldcontext);
 		return;
@@ -521,6 +1270,8 @@ plr_load_modules(void)
 	if (SPI_processed == 0)
 	{
 		SPI_freetuptable(SPI_tuptable);
+		plr_num_loaded_modules = 0;
+		plr_phase_end(phase_level);
 		/* clean up if SPI was used, and regardless restore caller's context */
 		CLEANUP_PLR_SPI_CONTEXT(oldcontext);
 		return;
@@ -528,9 +1279,14 @@ plr_load_modules(void)
 
 	/*
 	 * There is at least on module to load. Get the
-	 * source from the modsrc load it in the R interpreter
+	 * source from the modsrc load it in the R interpreter,
+	 * unless exactly that source was loaded before
 	 */
 	fno = SPI_fnumber(SPI_tuptable->tupdesc, "modsrc");
+	hno = SPI_fnumber(SPI_tuptable->tupdesc, "modhash");
+	eno = SPI_fnumber(SPI_tuptable->tupdesc, "modeager");
+	loaded = (char **) palloc(SPI_processed * sizeof(char *));
+	nloaded = 0;
 
 	for (i = 0; i < SPI_processed; i++)
 	{
@@ -539,16 +1295,196 @@ plr_load_modules(void)
 
 		if (cmd != NULL)
 		{
-			load_r_cmd(cmd);
+			bool	evaluated = true;
+
+			hash = SPI_getvalue(SPI_tuptable->vals[i],
+								SPI_tuptable->tupdesc, hno);
+			if (!plr_module_loaded(hash) && !plr_module_forced(hash))
+			{
+				bool	isnull;
+				Datum	eager = SPI_getbinval(SPI_tuptable->vals[i],
+											  SPI_tuptable->tupdesc,
+											  eno, &isnull);
+
+				evaluated = plr_load_module(cmd, hash, plr_lazy_modules &&
+											(isnull || !DatumGetBool(eager)));
+			}
+
+			/* a deferred module is loaded again until it was used */
+			if (evaluated)
+				loaded[nloaded++] = hash;
 			pfree(cmd);
 		}
 	}
+
+	/* all went well, so this is what the interpreter has now */
+	for (i = 0; i < plr_num_loaded_modules; i++)
+		pfree(plr_loaded_modules[i]);
+	if (plr_loaded_modules)
+		pfree(plr_loaded_modules);
+	plr_loaded_modules = (char **) MemoryContextAlloc(TopMemoryContext,
+										Max(nloaded, 1) * sizeof(char *));
+	for (i = 0; i < nloaded; i++)
+		plr_loaded_modules[i] = MemoryContextStrdup(TopMemoryContext, loaded[i]);
+	plr_num_loaded_modules = nloaded;
+
 	SPI_freetuptable(SPI_tuptable);
+	plr_phase_end(phase_level);
 
 	/* clean up if SPI was used, and regardless restore caller's context */
 	CLEANUP_PLR_SPI_CONTEXT(oldcontext);
 }
 
+/*
+ * plr_module_loaded() - was a module with this source hash loaded already?
+ */
+static bool
+plr_module_loaded(const char *hash)
+{
+	int			i;
+
+	for (i = 0; i < plr_num_loaded_modules; i++)
+		if (strcmp(plr_loaded_modules[i], hash) == 0)
+			return true;
+
+	return false;
+}
+
+/*
+ * plr_module_forced() - was a deferred module with this source hash
+ *				  evaluated since?
+ */
+static bool
+plr_module_forced(const char *hash)
+{
+	if (plr_forced_modules == NULL)
+		return false;
+
+	return findVarInFrame(plr_forced_modules,
+						  install(hash)) != R_UnboundValue;
+}
+
+/*
+ * plr_module_fn() - the R object defined by cmd, created on first use
+ */
+static SEXP
+plr_module_fn(const char *cmd, SEXP *fn)
+{
+	SEXP		cmdSexp;
+	SEXP		cmdexpr;
+	SEXP		result;
+	int			status;
+
+	if (*fn != NULL)
+		return *fn;
+
+	PROTECT(cmdSexp = mkString(cmd));
+	PROTECT(cmdexpr = R_PARSEVECTOR(cmdSexp, -1, &status));
+	if (status != PARSE_OK)
+	{
+		UNPROTECT(2);
+		/* internal error */
+		elog(ERROR, "plr_module_fn: could not parse module loader");
+	}
+	result = R_tryEval(VECTOR_ELT(cmdexpr, 0), R_GlobalEnv, &status);
+	UNPROTECT(2);
+	if (status != 0)
+		/* internal error */
+		elog(ERROR, "plr_module_fn: could not create module loader");
+	R_PreserveObject(result);
+	*fn = result;
+
+	return result;
+}
+
+/*
+ * plr_load_module() - evaluate one plr_modules entry, going through the
+ *				  module cache for its parsed and compiled form. When lazy,
+ *				  the entry is evaluated on first use of what it defines
+ *				  if that is possible. Returns false if it was deferred.
+ */
+static bool
+plr_load_module(const char *src, const char *hash, bool lazy)
+{
+	static SEXP		prepare_fn = NULL;
+	static SEXP		defer_fn = NULL;
+	SEXP			rsrc;
+	SEXP			rhash;
+	SEXP			call;
+	SEXP			exprs;
+	int				status;
+	int				i;
+
+	plr_module_fn(MODULE_PREPARE_CMD, &prepare_fn);
+	if (lazy)
+	{
+		plr_module_fn(MODULE_DEFER_CMD, &defer_fn);
+		plr_module_fn(MODULE_FORCED_CMD, &plr_forced_modules);
+	}
+
+	PROTECT(rsrc = mkString(src));
+	if (plr_cache_modules)
+		PROTECT(rhash = mkString(hash));
+	else
+		PROTECT(rhash = ScalarString(NA_STRING));
+	PROTECT(call = lang3(prepare_fn, rsrc, rhash));
+	PROTECT(exprs = R_tryEval(call, R_GlobalEnv, &status));
+	if (status != 0)
+	{
+		UNPROTECT(4);
+		if (last_R_error_msg)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("R interpreter parse error"),
+					 errdetail("%s", last_R_error_msg)));
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("R interpreter parse error"),
+					 errdetail("R parse error caught in \"%s\".", src)));
+	}
+
+	if (lazy)
+	{
+		SEXP	rname;
+		SEXP	deferred;
+
+		PROTECT(rname = mkString(hash));
+		PROTECT(call = lang4(defer_fn, exprs, rname, plr_forced_modules));
+		PROTECT(deferred = R_tryEval(call, R_GlobalEnv, &status));
+		if (status == 0 && asLogical(deferred) == TRUE)
+		{
+			UNPROTECT(7);
+			return false;
+		}
+		UNPROTECT(3);
+	}
+
+	for (i = 0; i < length(exprs); i++)
+	{
+		R_tryEval(VECTOR_ELT(exprs, i), R_GlobalEnv, &status);
+		if (status != 0)
+		{
+			UNPROTECT(4);
+			if (last_R_error_msg)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_EXCEPTION),
+						 errmsg("R interpreter expression evaluation error"),
+						 errdetail("%s", last_R_error_msg)));
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_EXCEPTION),
+						 errmsg("R interpreter expression evaluation error"),
+						 errdetail("R expression evaluation error caught " \
+								   "in \"%s\".", src)));
+		}
+	}
+
+	UNPROTECT(4);
+
+	return true;
+}
+
 static void
 plr_init_all(Oid funcid)
 {
@@ -567,8 +1503,19 @@ plr_init_all(Oid funcid)
 	 */
 	if (!plr_be_init_done)
 	{
-		/* load "builtin" R functions */
-		plr_load_builtins(funcid);
+		/*
+		 * Backends forked from a preloaded R inherit its temporary
+		 * directory and the state of rand(), which R names its temporary
+		 * files with
+		 */
+		if (plr_r_env_preloaded)
+		{
+			srand((unsigned int) MyProcPid);
+			plr_backend_tempdir();
+		}
+
+		/* load "builtin" R functions, unless the postmaster did */
+		plr_load_r_env(funcid);
 
 		/* obtain & store namespace OID of PL/R language handler */
 		plr_nspOid = getNamespaceOidFromFunctionOid(funcid);
@@ -583,6 +1530,209 @@ plr_init_all(Oid funcid)
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/*
+ * plr_backend_tempdir() - give a backend forked from a preloaded R a
+ *				  temporary directory of its own, removed when it exits
+ *
+ * The directory R created in the postmaster would otherwise be shared by
+ * all backends, and the postmaster's exit callbacks are not run by them.
+ */
+static void
+plr_backend_tempdir(void)
+{
+#ifndef WIN32
+	const char *tmp = NULL;
+	const char *envs[] = {"R_TMPDIR", "TMPDIR", "TMP", "TEMP"};
+	char	   *dir;
+	int			i;
+
+	/* where R looks for it, see InitTempDir() */
+	for (i = 0; i < lengthof(envs) && (tmp == NULL || tmp[0] == '\0'); i++)
+		tmp = getenv(envs[i]);
+	if (tmp == NULL || tmp[0] == '\0')
+		tmp = "/tmp";
+
+	/* R keeps R_TempDir for the life of the process */
+	dir = (char *) malloc(strlen(tmp) + 12);
+	if (dir == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory")));
+	sprintf(dir, "%s/RtmpXXXXXX", tmp);
+	if (mkdtemp(dir) == NULL)
+	{
+		int			save_errno = errno;
+		char	   *path = pstrdup(dir);
+
+		free(dir);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create R temporary directory \"%s\": %m",
+						path)));
+	}
+
+	R_TempDir = dir;
+	setenv("R_SESSION_TMPDIR", dir, 1);
+
+	/* removes the directory, see plr_cleanup() */
+	on_proc_exit(plr_cleanup, 0);
+#endif
+}
+
+/*
+ * plr_trigger_args_find() - the converted constant trigger arguments
+ *				  of the function for this trigger event, or NULL
+ *
+ * Each function keeps those of the last few trigger events it handled, so
+ * that the BEFORE and AFTER triggers of a table, or the triggers of
+ * several tables, do not convert them again on every row.
+ *
+ * A trigger or its relation can be renamed, and CREATE OR REPLACE TRIGGER
+ * can change the arguments, without changing the OIDs, so the names and
+ * arguments are compared as well.
+ */
+static plr_trigger_args *
+plr_trigger_args_find(plr_function *function, TriggerData *trigdata)
+{
+	Trigger			   *trigger = trigdata->tg_trigger;
+	plr_trigger_args   *entry;
+	plr_trigger_args   *prev = NULL;
+	const char		   *key;
+	int					i;
+
+	for (entry = function->trig_args; entry != NULL; entry = entry->next)
+	{
+		if (entry->tgoid == trigger->tgoid &&
+			entry->relid == trigdata->tg_relation->rd_id &&
+			entry->event == trigdata->tg_event)
+			break;
+		prev = entry;
+	}
+
+	if (entry == NULL || entry->nargs != trigger->tgnargs)
+		return NULL;
+
+	key = entry->key;
+	if (strcmp(key, trigger->tgname) != 0)
+		return NULL;
+	key += strlen(key) + 1;
+	if (strcmp(key, RelationGetRelationName(trigdata->tg_relation)) != 0)
+		return NULL;
+	key += strlen(key) + 1;
+	for (i = 0; i < trigger->tgnargs; i++)
+	{
+		if (strcmp(key, trigger->tgargs[i]) != 0)
+			return NULL;
+		key += strlen(key) + 1;
+	}
+
+	/* most recently used first */
+	if (prev != NULL)
+	{
+		prev->next = entry->next;
+		entry->next = function->trig_args;
+		function->trig_args = entry;
+	}
+
+	return entry;
+}
+
+/*
+ * plr_trigger_args_remember() - keep the converted constant trigger
+ *				  arguments for the following rows and statements,
+ *				  replacing those of the same trigger event and
+ *				  dropping the least recently used beyond the last
+ *				  PLR_TRIGGER_ARGS_MAX events
+ */
+static plr_trigger_args *
+plr_trigger_args_remember(plr_function *function, TriggerData *trigdata,
+						  SEXP rargs)
+{
+	plr_trigger_args   *entry;
+	plr_trigger_args  **link;
+	StringInfoData		key;
+	int					n;
+	int					i;
+
+	/* R code may modify its arguments, but not these shared ones */
+	for (i = 0; i < length(rargs); i++)
+	{
+#ifdef MARK_NOT_MUTABLE
+		MARK_NOT_MUTABLE(VECTOR_ELT(rargs, i));
+#else
+		SET_NAMED(VECTOR_ELT(rargs, i), 2);
+#endif
+	}
+
+	/* the names and arguments, one after the other with their null bytes */
+	initStringInfo(&key);
+	appendBinaryStringInfo(&key, trigdata->tg_trigger->tgname,
+						   strlen(trigdata->tg_trigger->tgname) + 1);
+	appendBinaryStringInfo(&key, RelationGetRelationName(trigdata->tg_relation),
+						   strlen(RelationGetRelationName(trigdata->tg_relation)) + 1);
+	for (i = 0; i < trigdata->tg_trigger->tgnargs; i++)
+		appendBinaryStringInfo(&key, trigdata->tg_trigger->tgargs[i],
+							   strlen(trigdata->tg_trigger->tgargs[i]) + 1);
+
+	entry = (plr_trigger_args *) MemoryContextAlloc(TopMemoryContext,
+													sizeof(plr_trigger_args));
+	entry->key = (char *) MemoryContextAlloc(TopMemoryContext, key.len);
+	memcpy(entry->key, key.data, key.len);
+	pfree(key.data);
+
+	R_PreserveObject(rargs);
+	entry->args = rargs;
+	entry->tgoid = trigdata->tg_trigger->tgoid;
+	entry->relid = trigdata->tg_relation->rd_id;
+	entry->event = trigdata->tg_event;
+	entry->nargs = trigdata->tg_trigger->tgnargs;
+	entry->next = function->trig_args;
+	function->trig_args = entry;
+
+	/* drop a stale entry of the same trigger event, and the oldest ones */
+	link = &entry->next;
+	n = 1;
+	while (*link != NULL)
+	{
+		plr_trigger_args   *old = *link;
+
+		if (n >= PLR_TRIGGER_ARGS_MAX ||
+			(old->tgoid == entry->tgoid && old->relid == entry->relid &&
+			 old->event == entry->event))
+		{
+			*link = old->next;
+			old->next = NULL;
+			plr_trigger_args_free(old);
+		}
+		else
+		{
+			link = &old->next;
+			n++;
+		}
+	}
+
+	return entry;
+}
+
+/*
+ * plr_trigger_args_free() - release a list of converted constant trigger
+ *				  arguments
+ */
+static void
+plr_trigger_args_free(plr_trigger_args *entry)
+{
+	while (entry != NULL)
+	{
+		plr_trigger_args   *next = entry->next;
+
+		R_ReleaseObject(entry->args);
+		pfree(entry->key);
+		pfree(entry);
+		entry = next;
+	}
+}
+
 static Datum
 plr_trigger_handler(PG_FUNCTION_ARGS)
 {
@@ -602,61 +1752,73 @@ plr_trigger_handler(PG_FUNCTION_ARGS)
 	int				dims[FIXED_NUM_DIMS];
 	int				lbs[FIXED_NUM_DIMS];
 #undef FIXED_NUM_DIMS
-	TRIGGERTUPLEVARS;
 	ERRORCONTEXTCALLBACK;
+	plr_stat_call	stat_call;
+	plr_trigger_args *trig_args;
+	HeapTuple		rettuple;
+	int				phase_level;
 	int				i;
 
-	if (trigdata->tg_trigger->tgnargs > 0)
-		dvalues = palloc(trigdata->tg_trigger->tgnargs * sizeof(Datum));
-	else
-		dvalues = NULL;
-	
 	/* Find or compile the function */
 	function = compile_plr_function(fcinfo);
 
 	/* set up error context */
 	PUSH_PLERRCONTEXT(plr_error_callback, function->proname);
 
-	/*
-	 * Build up arguments for the trigger function. The data types
-	 * are mostly hardwired in advance
-	 */
-	/* first is trigger name */
-	arg[0] = DirectFunctionCall1(textin,
-				 CStringGetDatum(trigdata->tg_trigger->tgname));
-	argnull[0] = false;
-
-	/* second is trigger relation oid */
-	arg[1] = ObjectIdGetDatum(trigdata->tg_relation->rd_id);
-	argnull[1] = false;
-
-	/* third is trigger relation name */
-	arg[2] = DirectFunctionCall1(textin,
-				 CStringGetDatum(get_rel_name(trigdata->tg_relation->rd_id)));
-	argnull[2] = false;
-
-	/* fourth is when trigger fired, i.e. BEFORE or AFTER */
-	if (TRIGGER_FIRED_BEFORE(trigdata->tg_event))
-		arg[3] = DirectFunctionCall1(textin,
-				 CStringGetDatum("BEFORE"));
-	else if (TRIGGER_FIRED_AFTER(trigdata->tg_event))
-		arg[3] = DirectFunctionCall1(textin,
-				 CStringGetDatum("AFTER"));
-	else
-		/* internal error */
-		elog(ERROR, "unrecognized tg_event");
-	argnull[3] = false;
+	/* building the arguments is part of converting them */
+	plr_stat_begin(&stat_call);
+	phase_level = plr_phase_start(PLR_PHASE_ARGS, function->proname);
 
 	/*
-	 * fifth is level trigger fired, i.e. ROW or STATEMENT
-	 * sixth is operation that fired trigger, i.e. INSERT, UPDATE, or DELETE
-	 * seventh is NEW, eigth is OLD
+	 * All arguments but NEW and OLD only depend on the trigger event, so
+	 * they are converted once for each
 	 */
-	if (TRIGGER_FIRED_FOR_STATEMENT(trigdata->tg_event))
+	trig_args = plr_trigger_args_find(function, trigdata);
+	if (trig_args == NULL)
 	{
-		arg[4] = DirectFunctionCall1(textin,
-				 CStringGetDatum("STATEMENT"));
+		/*
+		 * Build up arguments for the trigger function. The data types
+		 * are mostly hardwired in advance
+		 */
+		/* first is trigger name */
+		arg[0] = DirectFunctionCall1(textin,
+					 CStringGetDatum(trigdata->tg_trigger->tgname));
+		argnull[0] = false;
+
+		/* second is trigger relation oid */
+		arg[1] = ObjectIdGetDatum(trigdata->tg_relation->rd_id);
+		argnull[1] = false;
+
+		/* third is trigger relation name */
+		arg[2] = DirectFunctionCall1(textin,
+					 CStringGetDatum(get_rel_name(trigdata->tg_relation->rd_id)));
+		argnull[2] = false;
+
+		/* fourth is when trigger fired, i.e. BEFORE or AFTER */
+		if (TRIGGER_FIRED_BEFORE(trigdata->tg_event))
+			arg[3] = DirectFunctionCall1(textin,
+					 CStringGetDatum("BEFORE"));
+		else if (TRIGGER_FIRED_AFTER(trigdata->tg_event))
+			arg[3] = DirectFunctionCall1(textin,
+					 CStringGetDatum("AFTER"));
+		else
+			/* internal error */
+			elog(ERROR, "unrecognized tg_event");
+		argnull[3] = false;
+
+		/* fifth is level trigger fired, i.e. ROW or STATEMENT */
+		if (TRIGGER_FIRED_FOR_STATEMENT(trigdata->tg_event))
+			arg[4] = DirectFunctionCall1(textin,
+					 CStringGetDatum("STATEMENT"));
+		else if (TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+			arg[4] = DirectFunctionCall1(textin,
+					 CStringGetDatum("ROW"));
+		else
+			/* internal error */
+			elog(ERROR, "unrecognized tg_event");
+		argnull[4] = false;
 
+		/* sixth is operation that fired trigger, i.e. INSERT, UPDATE, or DELETE */
 		if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
 			arg[5] = DirectFunctionCall1(textin, CStringGetDatum("INSERT"));
 		else if (TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
@@ -666,70 +1828,163 @@ plr_trigger_handler(PG_FUNCTION_ARGS)
 		else
 			/* internal error */
 			elog(ERROR, "unrecognized tg_event");
+		argnull[5] = false;
 
+		/* seventh is NEW, eigth is OLD, filled in per row below */
 		arg[6] = (Datum) 0;
 		argnull[6] = true;
-
 		arg[7] = (Datum) 0;
 		argnull[7] = true;
+
+		/*
+		 * finally, ninth argument is a text array of trigger arguments
+		 */
+		if (trigdata->tg_trigger->tgnargs > 0)
+			dvalues = palloc(trigdata->tg_trigger->tgnargs * sizeof(Datum));
+		else
+			dvalues = NULL;
+		for (i = 0; i < trigdata->tg_trigger->tgnargs; i++)
+			dvalues[i] = DirectFunctionCall1(textin,
+							 CStringGetDatum(trigdata->tg_trigger->tgargs[i]));
+
+		dims[0] = trigdata->tg_trigger->tgnargs;
+		lbs[0] = 1;
+		array = construct_md_array(dvalues, NULL, ndims, dims, lbs,
+									TEXTOID, -1, false, 'i');
+
+		arg[8] = PointerGetDatum(array);
+		argnull[8] = false;
+
+		PROTECT(rargs = plr_convertargs(function, arg, argnull, fcinfo));
+		trig_args = plr_trigger_args_remember(function, trigdata, rargs);
+		UNPROTECT(1);
 	}
-	else if (TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+
+	/*
+	 * All done building args; from this point it is just like
+	 * calling a non-trigger function, except we need to be careful
+	 * that the return value tuple is the same tupdesc as the trigger tuple.
+	 */
+	PROTECT(fun = function->fun);
+
+	/* a fresh argument list, sharing the converted constant arguments */
+	PROTECT(rargs = allocVector(VECSXP, TRIGGER_NARGS));
+	for (i = 0; i < TRIGGER_NARGS; i++)
+		SET_VECTOR_ELT(rargs, i, VECTOR_ELT(trig_args->args, i));
+
+	/*
+	 * NEW and OLD of row triggers, converted straight from the trigger
+	 * tuples
+	 */
+	if (TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
 	{
-		arg[4] = DirectFunctionCall1(textin,
-				 CStringGetDatum("ROW"));
+		HeapTuple	rowtup[2] = {NULL, NULL};
 
 		if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
-			SET_INSERT_ARGS_567;
+			rowtup[0] = trigdata->tg_trigtuple;
 		else if (TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
-			SET_DELETE_ARGS_567;
+			rowtup[1] = trigdata->tg_trigtuple;
 		else if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
-			SET_UPDATE_ARGS_567;
+		{
+			rowtup[0] = trigdata->tg_newtuple;
+			rowtup[1] = trigdata->tg_trigtuple;
+		}
 		else
 			/* internal error */
 			elog(ERROR, "unrecognized tg_event");
-	}
-	else
-		/* internal error */
-		elog(ERROR, "unrecognized tg_event");
 
-	argnull[4] = false;
-	argnull[5] = false;
+		for (i = 0; i < 2; i++)
+		{
+			SEXP	el;
 
-	/*
-	 * finally, ninth argument is a text array of trigger arguments
-	 */
-	for (i = 0; i < trigdata->tg_trigger->tgnargs; i++)
-		dvalues[i] = DirectFunctionCall1(textin,
-						 CStringGetDatum(trigdata->tg_trigger->tgargs[i]));
+			if (rowtup[i] == NULL)
+				continue;
+
+			PROTECT(el = pg_heap_tuple_get_r_frame(rowtup[i], tupdesc));
 
-	dims[0] = trigdata->tg_trigger->tgnargs;
-	lbs[0] = 1;
-	array = construct_md_array(dvalues, NULL, ndims, dims, lbs,
-								TEXTOID, -1, false, 'i');
+			/*
+			 * so that any change made by R copies it, and a returned NEW
+			 * that is still this object is known to be unchanged
+			 */
+#ifdef MARK_NOT_MUTABLE
+			MARK_NOT_MUTABLE(el);
+#else
+			SET_NAMED(el, 2);
+#endif
+			SET_VECTOR_ELT(rargs, 6 + i, el);
+			UNPROTECT(1);
 
-	arg[8] = PointerGetDatum(array);
-	argnull[8] = false;
+			if (plr_track_functions)
+				PLR_STAT_ADD(bytes_in, rowtup[i]->t_len);
+		}
+	}
 
+#if PG_VERSION_NUM >= 100000
 	/*
-	 * All done building args; from this point it is just like
-	 * calling a non-trigger function, except we need to be careful
-	 * that the return value tuple is the same tupdesc as the trigger tuple.
+	 * Statement triggers see their transition tables, if declared with
+	 * REFERENCING, as pg.tg.new and pg.tg.old, and SPI can query them
+	 * by their names
 	 */
-	PROTECT(fun = function->fun);
+	if (TRIGGER_FIRED_FOR_STATEMENT(trigdata->tg_event) &&
+		(trigdata->tg_newtable || trigdata->tg_oldtable))
+	{
+		SEXP	frame;
 
-	/* Convert all call arguments */
-	PROTECT(rargs = plr_convertargs(function, arg, argnull, fcinfo));
+		if (SPI_register_trigger_data(trigdata) != SPI_OK_TD_REGISTER)
+			elog(ERROR, "SPI_register_trigger_data failed");
+
+		if (trigdata->tg_newtable)
+		{
+			PROTECT(frame = pg_tuplestore_get_r_frame(trigdata->tg_newtable,
+													  tupdesc));
+			SET_VECTOR_ELT(rargs, 6, frame);
+			UNPROTECT(1);
+		}
+		if (trigdata->tg_oldtable)
+		{
+			PROTECT(frame = pg_tuplestore_get_r_frame(trigdata->tg_oldtable,
+													  tupdesc));
+			SET_VECTOR_ELT(rargs, 7, frame);
+			UNPROTECT(1);
+		}
+	}
+#endif
+	PLR_STAT_PHASE(stat_call, args_time);
+	plr_phase_end(phase_level);
+	plr_phase_start(PLR_PHASE_EVAL, function->proname);
 
 	/* Call the R function */
-	PROTECT(rvalue = call_r_func(fun, rargs));
+	PROTECT(rvalue = plr_call_function(function, fun, rargs));
+	PLR_STAT_PHASE(stat_call, eval_time);
+	plr_phase_end(phase_level);
+	plr_phase_start(PLR_PHASE_RESULT, function->proname);
 
 	/*
 	 * Convert the return value from an R object to a Datum.
 	 * We expect r_get_pg to do the right thing with missing or empty results.
+	 * A returned pg.tg.new only needs the columns R changed replaced in
+	 * the trigger tuple, if any.
 	 */
 	if (SPI_finish() != SPI_OK_FINISH)
 		elog(ERROR, "SPI_finish failed");
-	retval = r_get_pg(rvalue, function, fcinfo);
+	if (TRIGGER_FIRED_FOR_ROW(trigdata->tg_event) &&
+		!TRIGGER_FIRED_BY_DELETE(trigdata->tg_event) &&
+		get_trigger_modified_tuple(rvalue, VECTOR_ELT(rargs, 6),
+								   TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) ?
+								   trigdata->tg_newtuple : trigdata->tg_trigtuple,
+								   tupdesc, &rettuple))
+		retval = PointerGetDatum(rettuple);
+	else
+		retval = r_get_pg(rvalue, function, fcinfo);
+	PLR_STAT_PHASE(stat_call, result_time);
+	plr_phase_end(phase_level);
+
+	if (stat_call.active && retval != (Datum) 0)
+	{
+		PLR_STAT_ADD(rows_out, 1);
+		PLR_STAT_ADD(bytes_out, ((HeapTuple) DatumGetPointer(retval))->t_len);
+	}
+	plr_stat_end(&stat_call, function);
 
 	POP_PLERRCONTEXT;
 	UNPROTECT(3);
@@ -746,6 +2001,8 @@ plr_func_handler(PG_FUNCTION_ARGS)
 	SEXP			rvalue;
 	Datum			retval;
 	ERRORCONTEXTCALLBACK;
+	plr_stat_call	stat_call;
+	int				phase_level;
 
 	/* Find or compile the function */
 	function = compile_plr_function(fcinfo);
@@ -753,13 +2010,22 @@ plr_func_handler(PG_FUNCTION_ARGS)
 	/* set up error context */
 	PUSH_PLERRCONTEXT(plr_error_callback, function->proname);
 
+	plr_stat_begin(&stat_call);
+	phase_level = plr_phase_start(PLR_PHASE_ARGS, function->proname);
+
 	PROTECT(fun = function->fun);
 
 	/* Convert all call arguments */
 	PROTECT(rargs = plr_convertargs(function, fcinfo->arg, fcinfo->argnull, fcinfo));
+	PLR_STAT_PHASE(stat_call, args_time);
+	plr_phase_end(phase_level);
+	plr_phase_start(PLR_PHASE_EVAL, function->proname);
 
 	/* Call the R function */
-	PROTECT(rvalue = call_r_func(fun, rargs));
+	PROTECT(rvalue = plr_call_function(function, fun, rargs));
+	PLR_STAT_PHASE(stat_call, eval_time);
+	plr_phase_end(phase_level);
+	plr_phase_start(PLR_PHASE_RESULT, function->proname);
 
 	/*
 	 * Convert the return value from an R object to a Datum.
@@ -768,6 +2034,18 @@ plr_func_handler(PG_FUNCTION_ARGS)
 	if (SPI_finish() != SPI_OK_FINISH)
 		elog(ERROR, "SPI_finish failed");
 	retval = r_get_pg(rvalue, function, fcinfo);
+	PLR_STAT_PHASE(stat_call, result_time);
+	plr_phase_end(phase_level);
+
+	/* set returning and composite results are counted as they are stored */
+	if (stat_call.active && !fcinfo->isnull &&
+		!function->result_istuple && !fcinfo->flinfo->fn_retset)
+	{
+		PLR_STAT_ADD(rows_out, 1);
+		PLR_STAT_ADD(bytes_out, datumGetSize(retval, function->result_typbyval,
+											 function->result_typlen));
+	}
+	plr_stat_end(&stat_call, function);
 
 	POP_PLERRCONTEXT;
 	UNPROTECT(3);
@@ -792,6 +2070,7 @@ compile_plr_function(FunctionCallInfo fcinfo)
 	plr_function	   *function;
 	plr_func_hashkey	hashkey;
 	bool				hashkey_valid = false;
+	int					phase_level;
 	ERRORCONTEXTCALLBACK;
 
 	/*
@@ -857,6 +2136,7 @@ compile_plr_function(FunctionCallInfo fcinfo)
 			/* free some of the subsidiary storage */
 			xpfree(function->proname);
 			R_ReleaseObject(function->fun);
+			plr_trigger_args_free(function->trig_args);
 			xpfree(function);
 
 			function = NULL;
@@ -878,7 +2158,10 @@ compile_plr_function(FunctionCallInfo fcinfo)
 		/*
 		 * Do the hard part.
 		 */
+		phase_level = plr_phase_start(PLR_PHASE_COMPILE,
+									  NameStr(procStruct->proname));
 		function = do_compile(fcinfo, procTup, &hashkey);
+		plr_phase_end(phase_level);
 	}
 
 	ReleaseSysCache(procTup);
@@ -1036,6 +2319,9 @@ do_compile(FunctionCallInfo fcinfo,
 			procStruct->prorettype == RECORDOID)
 			function->result_istuple = true;
 
+		function->result_typlen = typeStruct->typlen;
+		function->result_typbyval = typeStruct->typbyval;
+
 		perm_fmgr_info(typeStruct->typinput, &(function->result_in_func));
 
 		if (function->result_istuple)
@@ -1212,6 +2498,7 @@ do_compile(FunctionCallInfo fcinfo,
 
 			/* save argument typbyval in case we need for optimization in conversions */
 			function->arg_typbyval[i] = typeStruct->typbyval;
+			function->arg_typlen[i] = typeStruct->typlen;
 
 			/*
 			 * Is argument type an array? get_element_type will return InvalidOid
@@ -1273,6 +2560,7 @@ do_compile(FunctionCallInfo fcinfo,
 					typelem;
 		FmgrInfo	outputproc;
 		char		typalign;
+		int			i;
 
 		function->nargs = TRIGGER_NARGS;
 
@@ -1282,6 +2570,8 @@ do_compile(FunctionCallInfo fcinfo,
 								 &typdelim, &typelem, &typoutput);
 
 		function->arg_typid[1] = OIDOID;
+		function->arg_typbyval[1] = typbyval;
+		function->arg_typlen[1] = typlen;
 		function->arg_elem[1] = InvalidOid;
 		function->arg_is_rel[1] = 0;
 		perm_fmgr_info(typoutput, &(function->arg_out_func[1]));
@@ -1290,6 +2580,15 @@ do_compile(FunctionCallInfo fcinfo,
 								 &typlen, &typbyval, &typalign,
 								 &typdelim, &typelem, &typoutput);
 
+		/* the other scalar arguments all are text */
+		for (i = 0; i < TRIGGER_NARGS; i++)
+		{
+			if (i == 1)
+				continue;
+			function->arg_typbyval[i] = typbyval;
+			function->arg_typlen[i] = typlen;
+		}
+
 		function->arg_typid[0] = TEXTOID;
 		function->arg_elem[0] = InvalidOid;
 		function->arg_is_rel[0] = 0;
@@ -1448,6 +2747,320 @@ plr_parse_func_body(const char *body)
 	return(fun);
 }
 
+#if (R_VERSION >= 197888) /* R_VERSION >= 3.5.0 */
+/*
+ * Set one of R's heap limits through mem.maxNSize() or mem.maxVSize(),
+ * returning the limit now in effect
+ */
+static double
+plr_set_r_heap_limit(const char *fname, double limit)
+{
+	SEXP		call,
+				ans;
+	int			errorOccurred;
+	double		result = 0;
+
+	PROTECT(call = lang2(install(fname), ScalarReal(limit)));
+	PROTECT(ans = R_tryEval(call, R_GlobalEnv, &errorOccurred));
+	if (!errorOccurred && isReal(ans) && length(ans) == 1)
+		result = REAL(ans)[0];
+	UNPROTECT(2);
+
+	return result;
+}
+#endif
+
+/*
+ * Bring R's heap limits in line with plr.max_heap_size before running
+ * R code. R exceeding them raises an ordinary R error.
+ */
+static void
+plr_apply_heap_limit(void)
+{
+	static int	applied_heap_size = 0;
+
+	if (plr_max_heap_size == applied_heap_size)
+		return;
+	applied_heap_size = plr_max_heap_size;
+
+#if (R_VERSION >= 197888) /* R_VERSION >= 3.5.0 */
+	if (plr_max_heap_size > 0)
+	{
+		double		bytes = (double) plr_max_heap_size * 1024.0;
+		double		nsize = floor(bytes / PLR_NCELL_SIZE);
+		double		vsize = bytes / (1024.0 * 1024.0);
+
+		/* R ignores limits below the current heap size, so shrink it first */
+		R_gc();
+
+		if (plr_set_r_heap_limit("mem.maxNSize", nsize) > nsize ||
+			plr_set_r_heap_limit("mem.maxVSize", vsize) > vsize)
+			ereport(WARNING,
+					(errmsg("R heap is already larger than plr.max_heap_size"),
+					 errdetail("The limit takes effect only for the heap that "
+							   "is still below it.")));
+	}
+	else
+	{
+		plr_set_r_heap_limit("mem.maxNSize", R_PosInf);
+		plr_set_r_heap_limit("mem.maxVSize", R_PosInf);
+	}
+#else
+	if (plr_max_heap_size > 0)
+		ereport(WARNING,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("plr.max_heap_size requires R 3.5.0 or later")));
+#endif
+}
+
+/*
+ * Report the usage of R's cons cell and vector cell heaps. Running gc()
+ * is the only way to get exact figures, so this collects garbage.
+ */
+void
+plr_get_r_heap_usage(plr_r_heap_usage *ncells, plr_r_heap_usage *vcells)
+{
+	SEXP		call,
+				ans;
+	int			errorOccurred;
+	int			ncol;
+
+	if (!plr_pm_init_done)
+		plr_init();
+
+	memset(ncells, 0, sizeof(plr_r_heap_usage));
+	memset(vcells, 0, sizeof(plr_r_heap_usage));
+	ncells->cell_size = PLR_NCELL_SIZE;
+	vcells->cell_size = PLR_VCELL_SIZE;
+
+	/*
+	 * gc() returns a two row matrix, Ncells and Vcells, whose columns are
+	 * used, (Mb), gc trigger, (Mb), [limit (Mb),] max used, (Mb)
+	 */
+	plr_stat_gc_forget();
+	PROTECT(call = lang2(install("gc"), ScalarLogical(FALSE)));
+	PROTECT(ans = R_tryEval(call, R_GlobalEnv, &errorOccurred));
+	if (errorOccurred || !isReal(ans) || length(ans) < 12 ||
+		length(ans) % 2 != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("could not get R heap usage from gc()")));
+
+	ncol = length(ans) / 2;
+	ncells->used = REAL(ans)[0];
+	vcells->used = REAL(ans)[1];
+	ncells->gc_trigger = REAL(ans)[4];
+	vcells->gc_trigger = REAL(ans)[5];
+	ncells->max_used = REAL(ans)[2 * (ncol - 2)];
+	vcells->max_used = REAL(ans)[2 * (ncol - 2) + 1];
+	UNPROTECT(2);
+
+#if (R_VERSION >= 197888) /* R_VERSION >= 3.5.0 */
+	/* a zero argument queries the limit; unlimited is reported as Inf */
+	ncells->limit = plr_set_r_heap_limit("mem.maxNSize", 0);
+	vcells->limit = plr_set_r_heap_limit("mem.maxVSize", 0) *
+					(1024.0 * 1024.0) / PLR_VCELL_SIZE;
+	if (!R_FINITE(ncells->limit))
+		ncells->limit = 0;
+	if (!R_FINITE(vcells->limit))
+		vcells->limit = 0;
+#endif
+}
+
+/*
+ * Call the R function of a PL/R function, under the R profiler when
+ * plr.profile_functions is on
+ */
+static SEXP
+plr_call_function(plr_function *function, SEXP fun, SEXP rargs)
+{
+	SEXP	rvalue;
+
+	if (!plr_profile_begin())
+		return call_r_func(fun, rargs);
+
+	PG_TRY();
+	{
+		rvalue = call_r_func(fun, rargs);
+	}
+	PG_CATCH();
+	{
+		plr_profile_abort();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	PROTECT(rvalue);
+	plr_profile_end(function);
+	UNPROTECT(1);
+
+	return rvalue;
+}
+
+/*
+ * Collect R garbage now, returning the time it took in milliseconds
+ */
+double
+plr_gc_collect(void)
+{
+	instr_time	start;
+	instr_time	elapsed;
+	double		msecs;
+
+	if (!plr_pm_init_done)
+		plr_init();
+
+	INSTR_TIME_SET_CURRENT(start);
+	R_gc();
+	INSTR_TIME_SET_CURRENT(elapsed);
+	plr_stat_gc_forget();
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	plr_gc_pending = false;
+	msecs = INSTR_TIME_GET_DOUBLE(elapsed) * 1000.0;
+	elog(DEBUG1, "PL/R garbage collection took %.3f ms", msecs);
+
+	return msecs;
+}
+
+static void
+plr_gc_collect_pending(void)
+{
+	if (plr_gc_pending && plr_pm_init_done)
+		(void) plr_gc_collect();
+}
+
+#if PG_VERSION_NUM >= 80400
+/*
+ * The executor and utility hooks count how deep statements are nested,
+ * restoring the count should the statement fail, so that whatever runs
+ * inside a top level statement, be it the queries of a trigger fired by
+ * COPY or those of a DO block, never looks like the end of one.
+ */
+static void
+plr_gc_ExecutorRun(PLR_EXECUTOR_RUN_PARAMS)
+{
+	plr_nesting_level++;
+	PG_TRY();
+	{
+		if (prev_ExecutorRun)
+			prev_ExecutorRun(PLR_EXECUTOR_RUN_ARGS);
+		else
+			standard_ExecutorRun(PLR_EXECUTOR_RUN_ARGS);
+	}
+	PG_CATCH();
+	{
+		plr_nesting_level--;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	plr_nesting_level--;
+}
+
+#if PG_VERSION_NUM >= 90100
+static void
+plr_gc_ExecutorFinish(QueryDesc *queryDesc)
+{
+	plr_nesting_level++;
+	PG_TRY();
+	{
+		if (prev_ExecutorFinish)
+			prev_ExecutorFinish(queryDesc);
+		else
+			standard_ExecutorFinish(queryDesc);
+	}
+	PG_CATCH();
+	{
+		plr_nesting_level--;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	plr_nesting_level--;
+}
+#endif
+
+/*
+ * With plr.gc_mode = statement, collect garbage when the executor of a
+ * top level query is done, so that the next statement starts with a clean
+ * heap
+ */
+static void
+plr_gc_ExecutorEnd(QueryDesc *queryDesc)
+{
+	plr_nesting_level++;
+	PG_TRY();
+	{
+		if (prev_ExecutorEnd)
+			prev_ExecutorEnd(queryDesc);
+		else
+			standard_ExecutorEnd(queryDesc);
+	}
+	PG_CATCH();
+	{
+		plr_nesting_level--;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (--plr_nesting_level == 0 && plr_gc_mode == PLR_GC_STATEMENT)
+		plr_gc_collect_pending();
+}
+
+/*
+ * Likewise when a top level utility statement is done
+ */
+static void
+plr_gc_ProcessUtility(PLR_PROCESS_UTILITY_PARAMS)
+{
+	plr_nesting_level++;
+	PG_TRY();
+	{
+		if (prev_ProcessUtility)
+			prev_ProcessUtility(PLR_PROCESS_UTILITY_ARGS);
+		else
+			standard_ProcessUtility(PLR_PROCESS_UTILITY_ARGS);
+	}
+	PG_CATCH();
+	{
+		plr_nesting_level--;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (--plr_nesting_level == 0 && plr_gc_mode == PLR_GC_STATEMENT)
+		plr_gc_collect_pending();
+}
+#endif
+
+/*
+ * Collect garbage before a transaction commits unless R is left to
+ * itself; R is not run while a transaction aborts, the garbage waits for
+ * the next collection.
+ */
+static void
+plr_gc_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+#if PG_VERSION_NUM >= 90300
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+#else
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PREPARE:
+#endif
+			if (plr_gc_mode != PLR_GC_AUTO)
+				plr_gc_collect_pending();
+			break;
+		case XACT_EVENT_ABORT:
+			/* nothing survives the transaction; the hooks unwind anyway */
+			plr_nesting_level = 0;
+			break;
+		default:
+			break;
+	}
+}
+
 SEXP
 call_r_func(SEXP fun, SEXP rargs)
 {
@@ -1481,6 +3094,9 @@ call_r_func(SEXP fun, SEXP rargs)
 		SETCAR(call, fun);
 	}
 
+	plr_apply_heap_limit();
+	plr_gc_pending = true;
+
 	ans = R_tryEval(call, R_GlobalEnv, &errorOccurred);
 	UNPROTECT(1);
 
@@ -1490,7 +3106,10 @@ call_r_func(SEXP fun, SEXP rargs)
 			ereport(ERROR,
 					(errcode(ERRCODE_DATA_EXCEPTION),
 					 errmsg("R interpreter expression evaluation error"),
-					 errdetail("%s", last_R_error_msg)));
+					 errdetail("%s", last_R_error_msg),
+					 plr_max_heap_size > 0 &&
+					 strstr(last_R_error_msg, "memory exhausted") != NULL ?
+					 errhint("The R heap is limited by plr.max_heap_size.") : 0));
 		else
 			ereport(ERROR,
 					(errcode(ERRCODE_DATA_EXCEPTION),
@@ -1499,6 +3118,20 @@ call_r_func(SEXP fun, SEXP rargs)
 	return ans;
 }
 
+/*
+ * Size of a non-null argument value, for the function statistics
+ */
+static Size
+plr_arg_size(plr_function *function, int i, Datum value)
+{
+	if (function->arg_is_rel[i] || function->arg_elem[i] != InvalidOid)
+		return VARSIZE_ANY(DatumGetPointer(value));
+	if (function->arg_typlen[i] == 0)
+		return 0;
+
+	return datumGetSize(value, function->arg_typbyval[i], function->arg_typlen[i]);
+}
+
 static SEXP
 plr_convertargs(plr_function *function, Datum *arg, bool *argnull, FunctionCallInfo fcinfo)
 {
@@ -1559,7 +3192,7 @@ plr_convertargs(plr_function *function, Datum *arg, bool *argnull, FunctionCallI
 			{
 				/* better be a pg array arg, convert to a multi-row vector */
 				Datum		dvalue = (Datum) PG_DETOAST_DATUM(arg[i]);
-				FmgrInfo	out_func = function->arg_elem_out_func[i];
+				FmgrInfo   *out_func = &function->arg_elem_out_func[i];
 				int			typlen = function->arg_elem_typlen[i];
 				bool		typbyval = function->arg_elem_typbyval[i];
 				char		typalign = function->arg_elem_typalign[i];
@@ -1568,6 +3201,9 @@ plr_convertargs(plr_function *function, Datum *arg, bool *argnull, FunctionCallI
 			}
 			SET_VECTOR_ELT(rargs, i, el);
 			UNPROTECT(1);
+
+			if (plr_track_functions && !argnull[i])
+				PLR_STAT_ADD(bytes_in, plr_arg_size(function, i, arg[i]));
 #ifdef HAVE_WINDOW_FUNCTIONS
 		}
 		else
@@ -1602,7 +3238,7 @@ plr_convertargs(plr_function *function, Datum *arg, bool *argnull, FunctionCallI
 			else
 			{
 				/* better be a pg array arg, convert to a multi-row vector */
-				FmgrInfo	out_func = function->arg_elem_out_func[i];
+				FmgrInfo   *out_func = &function->arg_elem_out_func[i];
 				int			typlen = function->arg_elem_typlen[i];
 				bool		typbyval = function->arg_elem_typbyval[i];
 				char		typalign = function->arg_elem_typalign[i];
@@ -1757,7 +3393,8 @@ haveModulesTable(Oid nspOid)
 /*
  * getModulesSql(Oid) - Builds and returns SQL needed to extract contents from
  * plr_modules table.  The table must exist in the namespace designated by the
- * OID input argument.  Results are ordered by the "modseq" field.
+ * OID input argument.  Results are ordered by the "modseq" field. The
+ * "modeager" field is NULL when the table does not have it.
  *
  * IMPORTANT: return value must be pfree'd
  */
@@ -1765,11 +3402,34 @@ static char *
 getModulesSql(Oid nspOid)
 {
 	StringInfo		sql = makeStringInfo();
-	char		   *sql_format = "SELECT modseq, modsrc "
+	char		   *sql_format = "SELECT modseq, modsrc, "
+								 "pg_catalog.md5(modsrc) AS modhash, "
+								 "%s AS modeager "
 								 "FROM %s "
 								 "ORDER BY modseq";
+	char		   *eager_format = "SELECT NULL "
+								   "FROM pg_catalog.pg_attribute a, "
+								   "pg_catalog.pg_class c "
+								   "WHERE "
+								   "c.relname = 'plr_modules' AND "
+								   "c.relnamespace = %u AND "
+								   "a.attrelid = c.oid AND "
+								   "a.attname = 'modeager' AND "
+								   "NOT a.attisdropped";
+	int				spiRc;
+	bool			haveEager;
+
+	/* the modeager column is optional */
+	appendStringInfo(sql, eager_format, nspOid);
+	spiRc = SPI_exec(sql->data, 1);
+	if (spiRc != SPI_OK_SELECT)
+		/* internal error */
+		elog(ERROR, "getModulesSql: select from pg_attribute failed");
+	haveEager = (SPI_processed == 1);
 
+	resetStringInfo(sql);
 	appendStringInfo(sql, sql_format,
+					 haveEager ? "modeager::pg_catalog.bool" : "NULL::pg_catalog.bool",
 					 quote_qualified_identifier(get_namespace_name(nspOid),
 												"plr_modules"));
 
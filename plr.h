@@ -33,51 +33,113 @@
 #ifndef PLR_H
 #define PLR_H
 
-#define PLR_VERSION		"08.03.00.15"
+#define PLR_VERSION		"08.03.00.16"
 
 #include "postgres.h"
 
 #include "fmgr.h"
 #include "funcapi.h"
 #include "miscadmin.h"
+#if PG_VERSION_NUM >= 100000
+#include "pgstat.h"
+#endif
+#include "pgtime.h"
 #if PG_VERSION_NUM >= 80400
 #include "windowapi.h"
 #endif
 #include "access/heapam.h"
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
 #if PG_VERSION_NUM >= 90300
 #include "access/htup_details.h"
 #else
 #include "access/htup.h"
 #endif
+#include "access/xact.h"
 #include "catalog/catversion.h"
 #include "catalog/pg_language.h"
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/trigger.h"
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#elif PG_VERSION_NUM >= 120000
+#include "utils/hashutils.h"
+#else
+#include "access/hash.h"
+#endif
+#if PG_VERSION_NUM >= 90500
+#include "common/pg_lzcompress.h"
+#endif
+#if PG_VERSION_NUM >= 120000
+#include "common/shortest_dec.h"
+#endif
+#include "executor/executor.h"
 #include "executor/spi.h"
 #include "lib/stringinfo.h"
 #include "nodes/makefuncs.h"
 #include "optimizer/clauses.h"
 #include "parser/parse_type.h"
+#if PG_VERSION_NUM >= 80400
+#include "portability/instr_time.h"
+#else
+#include "executor/instrument.h"
+#endif
+#include "storage/fd.h"
 #include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
+#include "tcop/utility.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#if PG_VERSION_NUM >= 100000
+#include "utils/dsa.h"
+#endif
+#if PG_VERSION_NUM >= 120000
+#include "utils/float.h"
+#endif
+#include "utils/guc.h"
+#if PG_VERSION_NUM < 100000
+#include "utils/int8.h"
+#endif
 #if PG_VERSION_NUM >= 80500
 #include "utils/bytea.h"
 #endif
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/numeric.h"
 #include "utils/rel.h"
+#include "utils/resowner.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 #include "utils/typcache.h"
 
 #include <unistd.h>
+#include <ctype.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#ifndef ZSTD_CLEVEL_DEFAULT
+#define ZSTD_CLEVEL_DEFAULT 3
+#endif
+#endif
+#ifdef PLR_USDT
+#include <sys/sdt.h>
+#endif
 
 /*
  * The R headers define various symbols that are also defined by the
@@ -292,6 +354,9 @@ extern void R_RunExitFinalizers(void);
 
 #define TRIGGER_NARGS	9
 
+/* trigger events each function keeps the converted constant arguments of */
+#define PLR_TRIGGER_ARGS_MAX	8
+
 #define TUPLESTORE_BEGIN_HEAP	tuplestore_begin_heap(true, false, work_mem)
 
 #define INIT_AUX_FMGR_ATTS \
@@ -307,58 +372,6 @@ extern void R_RunExitFinalizers(void);
 
 #define  PLR_CLEANUP \
 	plr_cleanup(int code, Datum arg)
-#define TRIGGERTUPLEVARS \
-	HeapTuple		tup; \
-	HeapTupleHeader	dnewtup; \
-	HeapTupleHeader	dtrigtup
-#define SET_INSERT_ARGS_567 \
-	do { \
-		arg[5] = DirectFunctionCall1(textin, CStringGetDatum("INSERT")); \
-		tup = trigdata->tg_trigtuple; \
-		dtrigtup = (HeapTupleHeader) palloc(tup->t_len); \
-		memcpy((char *) dtrigtup, (char *) tup->t_data, tup->t_len); \
-		HeapTupleHeaderSetDatumLength(dtrigtup, tup->t_len); \
-		HeapTupleHeaderSetTypeId(dtrigtup, tupdesc->tdtypeid); \
-		HeapTupleHeaderSetTypMod(dtrigtup, tupdesc->tdtypmod); \
-		arg[6] = PointerGetDatum(dtrigtup); \
-		argnull[6] = false; \
-		arg[7] = (Datum) 0; \
-		argnull[7] = true; \
-	} while (0)
-#define SET_DELETE_ARGS_567 \
-	do { \
-		arg[5] = DirectFunctionCall1(textin, CStringGetDatum("DELETE")); \
-		arg[6] = (Datum) 0; \
-		argnull[6] = true; \
-		tup = trigdata->tg_trigtuple; \
-		dtrigtup = (HeapTupleHeader) palloc(tup->t_len); \
-		memcpy((char *) dtrigtup, (char *) tup->t_data, tup->t_len); \
-		HeapTupleHeaderSetDatumLength(dtrigtup, tup->t_len); \
-		HeapTupleHeaderSetTypeId(dtrigtup, tupdesc->tdtypeid); \
-		HeapTupleHeaderSetTypMod(dtrigtup, tupdesc->tdtypmod); \
-		arg[7] = PointerGetDatum(dtrigtup); \
-		argnull[7] = false; \
-	} while (0)
-#define SET_UPDATE_ARGS_567 \
-	do { \
-		arg[5] = DirectFunctionCall1(textin, CStringGetDatum("UPDATE")); \
-		tup = trigdata->tg_newtuple; \
-		dnewtup = (HeapTupleHeader) palloc(tup->t_len); \
-		memcpy((char *) dnewtup, (char *) tup->t_data, tup->t_len); \
-		HeapTupleHeaderSetDatumLength(dnewtup, tup->t_len); \
-		HeapTupleHeaderSetTypeId(dnewtup, tupdesc->tdtypeid); \
-		HeapTupleHeaderSetTypMod(dnewtup, tupdesc->tdtypmod); \
-		arg[6] = PointerGetDatum(dnewtup); \
-		argnull[6] = false; \
-		tup = trigdata->tg_trigtuple; \
-		dtrigtup = (HeapTupleHeader) palloc(tup->t_len); \
-		memcpy((char *) dtrigtup, (char *) tup->t_data, tup->t_len); \
-		HeapTupleHeaderSetDatumLength(dtrigtup, tup->t_len); \
-		HeapTupleHeaderSetTypeId(dtrigtup, tupdesc->tdtypeid); \
-		HeapTupleHeaderSetTypMod(dtrigtup, tupdesc->tdtypmod); \
-		arg[7] = PointerGetDatum(dtrigtup); \
-		argnull[7] = false; \
-	} while (0)
 #define CONVERT_TUPLE_TO_DATAFRAME \
 	do { \
 		Oid			tupType; \
@@ -373,7 +386,7 @@ extern void R_RunExitFinalizers(void);
 		ItemPointerSetInvalid(&(tuple->t_self)); \
 		tuple->t_tableOid = InvalidOid; \
 		tuple->t_data = tuple_hdr; \
-		PROTECT(el = pg_tuple_get_r_frame(1, &tuple, tupdesc)); \
+		PROTECT(el = pg_tuple_get_r_frame(1, &tuple, tupdesc, false)); \
 		ReleaseTupleDesc(tupdesc); \
 		pfree(tuple); \
 	} while (0)
@@ -417,6 +430,7 @@ extern void R_RunExitFinalizers(void);
 			SWITCHTO_PLR_SPI_CONTEXT(temp_context); \
 			edata = CopyErrorData(); \
 			MemoryContextSwitchTo(temp_context); \
+			plr_phase_unwind(PLR_PHASE_SPI); \
 			error("error in SQL statement : %s", edata->message); \
 		}
 #define PLR_PG_END_TRY() \
@@ -448,6 +462,216 @@ typedef struct plr_func_hashkey
 
 
 /* The information we cache about loaded procedures */
+/*
+ * Execution statistics of a PL/R function, see plr_stat_functions().
+ * All times are in milliseconds.
+ */
+typedef struct plr_func_stats
+{
+	int64				calls;
+	double				total_time;
+	double				args_time;		/* converting arguments to R */
+	double				eval_time;		/* evaluating the R function */
+	double				result_time;	/* converting the R result back */
+	int64				rows_in;		/* rows read through pg.spi.* */
+	int64				rows_out;		/* rows returned */
+	int64				bytes_in;		/* size of the converted arguments */
+	int64				bytes_out;		/* size of the converted results */
+	int64				gc_count;		/* calls during which R collected garbage */
+	double				gc_time;
+	double				gc_max_time;	/* longest GC time of a single call */
+}	plr_func_stats;
+
+/* per call state while plr.track_functions is on */
+typedef struct plr_stat_call
+{
+	bool				active;
+	instr_time			start;
+	instr_time			mark;			/* start of the current phase */
+	double				gc_start;
+	plr_func_stats		counters;		/* this call so far */
+	plr_func_stats		base;			/* backend running totals at start */
+}	plr_stat_call;
+
+/*
+ * Usage of one of R's two heaps, see plr_r_memory().  Cons cells (Ncells)
+ * hold language objects, vector cells (Vcells) hold vector data.
+ */
+typedef struct plr_r_heap_usage
+{
+	double				used;			/* cells in use */
+	double				gc_trigger;		/* cells at which R collects next */
+	double				max_used;		/* high water mark in cells */
+	double				limit;			/* cell limit, or 0 when unlimited */
+	double				cell_size;		/* bytes per cell */
+}	plr_r_heap_usage;
+
+/* when PL/R collects garbage itself, see plr.gc_mode */
+typedef enum
+{
+	PLR_GC_AUTO,				/* leave it to R */
+	PLR_GC_STATEMENT,			/* after statements that ran R code */
+	PLR_GC_TRANSACTION			/* after transactions that ran R code */
+}	plr_gc_mode_type;
+
+/* how R objects returned as bytea are serialized, see plr.serialize_format */
+typedef enum
+{
+	PLR_SERIALIZE_XDR,			/* R's default, big-endian */
+	PLR_SERIALIZE_BINARY		/* native byte order, no swapping */
+}	plr_serialize_format_type;
+
+/* how numeric values are passed to R, see plr.numeric_conversion */
+typedef enum
+{
+	PLR_NUMERIC_DOUBLE,			/* R numeric, nearest double */
+	PLR_NUMERIC_CHARACTER		/* R character, exact decimal text */
+}	plr_numeric_conversion_type;
+
+/* how int8 values are passed to R, see plr.int8_conversion */
+typedef enum
+{
+	PLR_INT8_DOUBLE,			/* R numeric, nearest double */
+	PLR_INT8_INTEGER64			/* bit64 integer64, exact */
+}	plr_int8_conversion_type;
+
+/*
+ * Compression of serialized R objects, see plr.serialize_compression.
+ * The values are stored in compressed objects, so never renumber them.
+ */
+typedef enum
+{
+	PLR_COMPRESS_NONE = 0,
+	PLR_COMPRESS_PGLZ = 1,
+	PLR_COMPRESS_LZ4 = 2,
+	PLR_COMPRESS_ZSTD = 3
+}	plr_compress_method;
+
+/*
+ * Compressed serializations start with this header instead of R's format
+ * tag ("X\n", "B\n" or "A\n"): "PLR", the method, and the uncompressed
+ * size in four bytes, least significant first. Serializations shorter than
+ * PLR_COMPRESS_MIN_SIZE are stored uncompressed.
+ */
+#define PLR_SERIAL_MAGIC		"PLR"
+#define PLR_SERIAL_HDRSZ		8
+#define PLR_COMPRESS_MIN_SIZE	1024
+
+/* counters of the cache of unserialized R objects, see plr.object_cache_size */
+typedef struct plr_object_cache_stats
+{
+	long				entries;
+	Size				bytes;			/* serialized size of the entries */
+	int64				hits;
+	int64				misses;
+	int64				evictions;
+}	plr_object_cache_stats;
+
+/* an object of the shared object store, see pg.shared.put */
+typedef struct plr_shared_info
+{
+	char				name[NAMEDATALEN];
+	uint64				version;
+	Size				size;			/* serialized size */
+	int64				reads;
+}	plr_shared_info;
+
+/* smaller bytea arguments are unserialized every time */
+#define PLR_OBJECT_CACHE_MIN_SIZE	1024
+
+/* serialization version 3 stores ALTREP objects such as 1:n compactly */
+#if (R_VERSION >= 197888) /* R_VERSION >= 3.5.0 */
+#define PLR_SERIALIZE_MAX_VERSION	3
+#else
+#define PLR_SERIALIZE_MAX_VERSION	2
+#endif
+
+/* timestamps are int64 microseconds, rather than float8 seconds */
+#if PG_VERSION_NUM >= 100000 || defined(HAVE_INT64_TIMESTAMP)
+#define PLR_INT64_TIMESTAMP
+#endif
+
+/* an R cons cell (SEXPREC) is seven pointers wide, a vector cell 8 bytes */
+#define PLR_NCELL_SIZE		(7 * sizeof(void *))
+#define PLR_VCELL_SIZE		8
+
+/*
+ * Phases of PL/R execution, reported as wait events and to the phase
+ * hooks of a PLR_plugin
+ */
+typedef enum plr_phase
+{
+	PLR_PHASE_NONE = 0,
+	PLR_PHASE_INIT,				/* starting the R interpreter */
+	PLR_PHASE_MODULE_LOAD,		/* loading plr_modules */
+	PLR_PHASE_COMPILE,			/* compiling a function */
+	PLR_PHASE_ARGS,				/* converting arguments to R */
+	PLR_PHASE_EVAL,				/* evaluating the R function */
+	PLR_PHASE_SPI,				/* running a query for pg.spi.* */
+	PLR_PHASE_RESULT			/* converting the result back */
+}	plr_phase;
+
+#define PLR_PHASE_COUNT		(PLR_PHASE_RESULT + 1)
+
+/*
+ * Another library can hook into the phases by setting the "PLR_plugin"
+ * rendezvous variable (see find_rendezvous_variable()) to a PLR_plugin.
+ * The detail is the function name for the per call phases and the
+ * pg.spi.* function for PLR_PHASE_SPI; it may be NULL and is only valid
+ * during the callback.
+ */
+typedef struct PLR_plugin
+{
+	void		(*phase_start) (plr_phase phase, const char *detail);
+	void		(*phase_end) (plr_phase phase, const char *detail);
+}	PLR_plugin;
+
+/* USDT probes plr:phase__start and plr:phase__end, see Makefile */
+#ifdef PLR_USDT
+#define PLR_PROBE_PHASE_START(phase_, detail_) \
+	DTRACE_PROBE2(plr, phase__start, (int) (phase_), (detail_))
+#define PLR_PROBE_PHASE_END(phase_, detail_) \
+	DTRACE_PROBE2(plr, phase__end, (int) (phase_), (detail_))
+#else
+#define PLR_PROBE_PHASE_START(phase_, detail_)	((void) 0)
+#define PLR_PROBE_PHASE_END(phase_, detail_)	((void) 0)
+#endif
+
+/* directory, relative to the data directory, of the plr_modules cache */
+#define PLR_MODULE_CACHE_DIR		"pg_plr"
+
+/* R profiler samples of one call stack of a function, see plr_profile() */
+#define PLR_PROFILE_STACK_LEN		1024
+
+typedef struct plr_profile_key
+{
+	Oid					funcid;
+	char				stack[PLR_PROFILE_STACK_LEN];	/* outermost first */
+}	plr_profile_key;
+
+typedef struct plr_profile_entry
+{
+	plr_profile_key		key;			/* hash key -- must be first */
+	int64				self_samples;	/* samples taken in this frame */
+	int64				total_samples;	/* ... in this frame or its callees */
+}	plr_profile_entry;
+
+/*
+ * The converted constant arguments of one trigger event, see
+ * plr_trigger_args_find()
+ */
+typedef struct plr_trigger_args
+{
+	struct plr_trigger_args *next;
+	SEXP				args;		/* converted constant trigger args */
+	Oid					tgoid;		/* ... of this trigger */
+	Oid					relid;		/* ... on this relation */
+	TriggerEvent		event;		/* ... for this event */
+	int16				nargs;		/* ... with this many arguments */
+	char			   *key;		/* ... and the trigger name, relation
+									 * name and arguments in here */
+}	plr_trigger_args;
+
 typedef struct plr_function
 {
 	char			   *proname;
@@ -457,6 +681,8 @@ typedef struct plr_function
 	bool				lanpltrusted;
 	Oid					result_typid;
 	bool				result_istuple;
+	int16				result_typlen;
+	bool				result_typbyval;
 	FmgrInfo			result_in_func;
 	Oid					result_elem;
 	FmgrInfo			result_elem_in_func;
@@ -472,6 +698,7 @@ typedef struct plr_function
 	int					nargs;
 	Oid					arg_typid[FUNC_MAX_ARGS];
 	bool				arg_typbyval[FUNC_MAX_ARGS];
+	int16				arg_typlen[FUNC_MAX_ARGS];
 	FmgrInfo			arg_out_func[FUNC_MAX_ARGS];
 	Oid					arg_elem[FUNC_MAX_ARGS];
 	FmgrInfo			arg_elem_out_func[FUNC_MAX_ARGS];
@@ -480,11 +707,21 @@ typedef struct plr_function
 	char				arg_elem_typalign[FUNC_MAX_ARGS];
 	int					arg_is_rel[FUNC_MAX_ARGS];
 	SEXP				fun;	/* compiled R function */
+	plr_trigger_args   *trig_args;	/* per trigger event, most recent
+										 * first */
 #ifdef HAVE_WINDOW_FUNCTIONS
 	bool				iswindow;
 #endif
+	plr_func_stats		stats;	/* this backend's totals since compile */
 }	plr_function;
 
+/*
+ * Native binding of an R value to a scalar pg type, bypassing the type's
+ * input function. Returns false if the R value cannot be handled natively,
+ * in which case the caller should fall back to get_datum().
+ */
+typedef bool (*plr_native_conv) (SEXP rval, Datum *dvalue, bool *isnull);
+
 /* compiled function hash table */
 typedef struct plr_hashent
 {
@@ -502,6 +739,7 @@ extern int Rf_initEmbeddedR(int argc, char **argv);
 /* PL/R language handler */
 extern Datum plr_call_handler(PG_FUNCTION_ARGS);
 extern void PLR_CLEANUP;
+extern void _PG_init(void);
 extern void plr_init(void);
 extern void plr_load_modules(void);
 extern void load_r_cmd(const char *cmd);
@@ -509,26 +747,52 @@ extern SEXP call_r_func(SEXP fun, SEXP rargs);
 
 /* argument and return value conversion functions */
 extern SEXP pg_scalar_get_r(Datum dvalue, Oid arg_typid, FmgrInfo arg_out_func);
-extern SEXP pg_array_get_r(Datum dvalue, FmgrInfo out_func, int typlen, bool typbyval, char typalign);
+extern SEXP pg_array_get_r(Datum dvalue, FmgrInfo *out_func, int typlen, bool typbyval, char typalign);
 extern SEXP pg_datum_array_get_r(Datum *elem_values, bool *elem_nulls, int numels, bool has_nulls,
 								 Oid element_type, FmgrInfo out_func, bool typbyval);
-extern SEXP pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc);
+extern SEXP pg_tuple_get_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+								 bool array_matrix);
+#if PG_VERSION_NUM >= 100000
+extern SEXP pg_tuplestore_get_r_frame(Tuplestorestate *tupstore, TupleDesc tupdesc);
+#endif
+extern SEXP pg_heap_tuple_get_r_frame(HeapTuple tuple, TupleDesc tupdesc);
+extern SEXP pg_tuple_get_r_list(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+								bool array_matrix);
+extern bool pg_tuple_r_frame_matches(TupleDesc tupdesc, SEXP frame, int nr);
+extern void pg_tuple_fill_r_frame(int ntuples, HeapTuple *tuples, TupleDesc tupdesc,
+								  SEXP frame);
 extern Datum r_get_pg(SEXP rval, plr_function *function, FunctionCallInfo fcinfo);
+extern Tuplestorestate *get_frame_tuplestore(SEXP rval, plr_function *function,
+											 AttInMetadata *attinmeta,
+											 MemoryContext per_query_ctx,
+											 bool retset);
 extern Datum get_datum(SEXP rval, Oid typid, Oid typelem, FmgrInfo in_func, bool *isnull);
 extern Datum get_scalar_datum(SEXP rval, Oid result_typ, FmgrInfo result_in_func, bool *isnull);
+extern plr_native_conv get_native_datum_conv(Oid typid);
+extern bytea *plr_serialize(SEXP obj);
+extern SEXP plr_unserialize(const char *data, Size len);
+extern void plr_object_cache_get_stats(plr_object_cache_stats *stats);
+extern void plr_object_cache_clear(void);
+extern bool get_trigger_modified_tuple(SEXP rval, SEXP newframe, HeapTuple newtuple,
+									   TupleDesc tupdesc, HeapTuple *result);
 
 /* Postgres support functions installed into the R interpreter */
 extern void throw_pg_notice(const char **msg);
 extern SEXP plr_quote_literal(SEXP rawstr);
 extern SEXP plr_quote_ident(SEXP rawstr);
-extern SEXP plr_SPI_exec(SEXP rsql);
+extern SEXP plr_SPI_exec(SEXP rsql, SEXP rlimit, SEXP rsample, SEXP rarray_matrix);
 extern SEXP plr_SPI_prepare(SEXP rsql, SEXP rargtypes);
-extern SEXP plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues);
+extern SEXP plr_SPI_execp(SEXP rsaved_plan, SEXP rargvalues, SEXP rlimit, SEXP rsample,
+						  SEXP rarray_matrix);
 extern SEXP plr_SPI_cursor_open(SEXP cursor_name_arg,SEXP rsaved_plan, SEXP rargvalues);
-extern SEXP plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in);
+extern SEXP plr_SPI_cursor_fetch(SEXP cursor_in,SEXP forward_in, SEXP rows_in, SEXP as_frame_in);
+extern SEXP plr_SPI_cursor_fetch_into(SEXP cursor_in, SEXP forward_in, SEXP rows_in, SEXP frame);
 extern void plr_SPI_cursor_close(SEXP cursor_in);
 extern void plr_SPI_cursor_move(SEXP cursor_in, SEXP forward_in, SEXP rows_in);
 extern SEXP plr_SPI_lastoid(void);
+extern SEXP plr_shared_put(SEXP rname, SEXP obj);
+extern SEXP plr_shared_get(SEXP rname);
+extern SEXP plr_shared_rm(SEXP rname);
 extern void throw_r_error(const char **msg);
 
 /* Postgres callable functions useful in conjunction with PL/R */
@@ -543,6 +807,37 @@ extern Datum plr_set_rhome(PG_FUNCTION_ARGS);
 extern Datum plr_unset_rhome(PG_FUNCTION_ARGS);
 extern Datum plr_set_display(PG_FUNCTION_ARGS);
 extern Datum plr_get_raw(PG_FUNCTION_ARGS);
+extern Datum plr_stat_functions(PG_FUNCTION_ARGS);
+extern Datum plr_stat_reset(PG_FUNCTION_ARGS);
+extern Datum plr_r_memory(PG_FUNCTION_ARGS);
+extern Datum plr_gc(PG_FUNCTION_ARGS);
+extern Datum plr_object_cache(PG_FUNCTION_ARGS);
+extern Datum plr_object_cache_reset(PG_FUNCTION_ARGS);
+extern Datum plr_shared_objects(PG_FUNCTION_ARGS);
+extern Datum plr_bench_array_get_r(PG_FUNCTION_ARGS);
+extern Datum plr_bench_tuple_get_r_frame(PG_FUNCTION_ARGS);
+extern Datum plr_bench_frame_tuplestore(PG_FUNCTION_ARGS);
+extern Datum plr_profile(PG_FUNCTION_ARGS);
+extern Datum plr_profile_reset(PG_FUNCTION_ARGS);
+
+/* R heap accounting and garbage collection */
+extern int plr_max_heap_size;
+extern int plr_gc_mode;
+extern int plr_gc_min_heap;
+
+/* serialization of R objects to bytea */
+extern int plr_serialize_format;
+extern int plr_serialize_version;
+extern int plr_serialize_compression;
+extern int plr_object_cache_size;
+
+/* conversion of arguments and query results to R */
+extern bool plr_native_datetime;
+extern int plr_numeric_conversion;
+extern int plr_int8_conversion;
+extern double plr_gc_collect(void);
+extern void plr_get_r_heap_usage(plr_r_heap_usage *ncells,
+								 plr_r_heap_usage *vcells);
 
 /* Postgres backend support functions */
 extern void compute_function_hashkey(FunctionCallInfo fcinfo,
@@ -556,4 +851,51 @@ extern void plr_HashTableDelete(plr_function *function);
 extern char *get_load_self_ref_cmd(Oid funcid);
 extern void perm_fmgr_info(Oid functionId, FmgrInfo *finfo);
 
+/* function execution statistics */
+extern bool plr_track_functions;
+extern plr_func_stats plr_backend_stats;
+extern void plr_stat_shmem_request(void);
+extern void plr_stat_gc_forget(void);
+extern void plr_stat_begin(plr_stat_call *call);
+extern void plr_stat_phase(plr_stat_call *call, double *phase_time);
+extern void plr_stat_end(plr_stat_call *call, plr_function *function);
+extern int plr_stat_collect(Oid **funcids, plr_func_stats **stats);
+extern void plr_stat_reset_entries(void);
+
+/* shared object store */
+extern int plr_shared_objects_size;
+extern void plr_shared_shmem_request(void);
+extern uint64 plr_shared_store(const char *name, const char *data, Size size);
+extern bool plr_shared_fetch(const char *name, uint64 have_version, uint64 *version,
+							 char **data, Size *size);
+extern bool plr_shared_remove(const char *name);
+extern int plr_shared_collect(plr_shared_info **objects);
+
+/* execution phases */
+extern void plr_phase_init(void);
+extern int plr_phase_start(plr_phase phase, const char *detail);
+extern void plr_phase_end(int level);
+extern void plr_phase_unwind(plr_phase phase);
+
+/* R profiler */
+extern bool plr_profile_functions;
+extern int plr_profile_interval;
+extern bool plr_profile_begin(void);
+extern void plr_profile_end(plr_function *function);
+extern void plr_profile_abort(void);
+extern int plr_profile_collect(plr_profile_entry **entries);
+extern void plr_profile_reset_entries(void);
+
+/*
+ * Running totals of rows and bytes moved by this backend, from which each
+ * call's share is derived; cheap enough to maintain unconditionally.
+ */
+#define PLR_STAT_ADD(field_, n_) \
+	(plr_backend_stats.field_ += (n_))
+#define PLR_STAT_PHASE(call_, phase_) \
+	do { \
+		if ((call_).active) \
+			plr_stat_phase(&(call_), &(call_).counters.phase_); \
+	} while (0)
+
 #endif   /* PLR_H */
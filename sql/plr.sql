@@ -359,7 +359,18 @@ update foo set f1 = 'zzz' where f0 = 11;
 select * from foo where f0 = 11;
 delete from foo where f0 = 11;
 select count(*) from foo;
-drop trigger footrig on foo;
+-- the converted arguments are reused, but not once the trigger is renamed
+alter trigger footrig on foo rename to footrig2;
+insert into foo values(11,'cat99',1.89);
+delete from foo where f0 = 11;
+-- each trigger keeps its own converted arguments
+create trigger footrig3 before insert on foo for each statement execute procedure foonotice('good','bye');
+insert into foo values(11,'cat99',1.89);
+delete from foo where f0 = 11;
+insert into foo values(11,'cat99',1.89);
+delete from foo where f0 = 11;
+drop trigger footrig3 on foo;
+drop trigger footrig2 on foo;
 
 -- Test cursors: creating, scrolling forward, closing
 CREATE OR REPLACE FUNCTION cursor_fetch_test(integer,boolean) RETURNS SETOF integer AS 'plan<-pg.spi.prepare("SELECT * FROM generate_series(1,10)"); cursor<-pg.spi.cursor_open("curs",plan); dat<-pg.spi.cursor_fetch(cursor,arg2,arg1); pg.spi.cursor_close(cursor); return (dat);' language 'plr';
@@ -422,3 +433,232 @@ FROM (SELECT firm, fyear, eps,
 FROM test_data) AS a
 WHERE eps IS NOT NULL
 WINDOW w AS (ORDER BY firm, fyear ROWS 8 PRECEDING);
+
+--Test native parameter binding in pg.spi.execp
+create or replace function test_spi_execp_native(int, float8, bool, text) returns setof record as 'sp <- pg.spi.prepare("select $1 as i, $2 as f, $3 as b, $4 as t", c(INT4OID, FLOAT8OID, BOOLOID, TEXTOID)); pg.spi.execp(sp, list(arg1, arg2, arg3, arg4))' language 'plr';
+select * from test_spi_execp_native(42, 1.5, true, 'hello') as t(i int, f float8, b bool, t text);
+select i, f is null as fnull, b is null as bnull, t is null as tnull from test_spi_execp_native(42, null, null, null) as t(i int, f float8, b bool, t text);
+
+--Test cursors: fetching into an existing frame, column list mode
+CREATE OR REPLACE FUNCTION cursor_fetch_into_test() RETURNS text AS 'plan<-pg.spi.prepare("SELECT * FROM generate_series(1,10)"); cursor<-pg.spi.cursor_open("curs",plan); buf<-pg.spi.cursor_fetch(cursor,TRUE,as.integer(4),FALSE); s<-sum(buf[[1]]); while ((n<-pg.spi.cursor_fetch_into(cursor,TRUE,as.integer(4),buf)) > 0) s<-s+sum(buf[[1]][seq_len(n)]); pg.spi.cursor_close(cursor); return (paste(is.data.frame(buf), s));' language 'plr';
+SELECT cursor_fetch_into_test();
+
+--Test cursors: a column referenced elsewhere is not overwritten
+CREATE OR REPLACE FUNCTION cursor_fetch_into_shared_test() RETURNS text AS 'plan<-pg.spi.prepare("SELECT * FROM generate_series(1,10)"); cursor<-pg.spi.cursor_open("curs",plan); buf<-pg.spi.cursor_fetch(cursor,TRUE,as.integer(4),FALSE); x<-buf[[1]]; n<-pg.spi.cursor_fetch_into(cursor,TRUE,as.integer(4),buf); pg.spi.cursor_close(cursor); return (paste(sum(x), sum(buf[[1]][seq_len(n)])));' language 'plr';
+SELECT cursor_fetch_into_shared_test();
+
+--Test cursor iterators: two open at once with generated portal names
+CREATE OR REPLACE FUNCTION cursor_iter_test() RETURNS text AS 'plan<-pg.spi.prepare("SELECT * FROM generate_series(1,10)"); a<-pg.spi.cursor_iter(plan, batch=3L); b<-pg.spi.cursor_iter(plan, batch=4L, prefetch=FALSE); na<-0; sb<-0; while (pg.spi.iter_has_next(a)) na<-na+nrow(pg.spi.iter_next(a)); while (!is.null(d<-pg.spi.iter_next(b))) sb<-sb+sum(d[[1]]); pg.spi.iter_close(a); pg.spi.iter_close(b); return (paste(na, sb));' language 'plr';
+SELECT cursor_iter_test();
+
+--Test row limits and reservoir sampling in pg.spi.exec and pg.spi.execp
+CREATE OR REPLACE FUNCTION test_spi_exec_limit() RETURNS text AS 'h<-pg.spi.exec("SELECT * FROM generate_series(1,1000) g", 5L); set.seed(1); s<-pg.spi.exec("SELECT * FROM generate_series(1,1000) g", 20L, TRUE); plan<-pg.spi.prepare("SELECT * FROM generate_series(1,$1) g", c(INT4OID)); p<-pg.spi.execp(plan, list(10L), 3L); q<-pg.spi.execp(plan, list(10L), 50L, TRUE); return (paste(nrow(h), sum(h$g), nrow(s), length(unique(s$g)), all(s$g %in% 1:1000), nrow(p), nrow(q)));' language 'plr';
+SELECT test_spi_exec_limit();
+
+--Test returning fixed length numeric array columns as a matrix
+CREATE OR REPLACE FUNCTION test_spi_exec_array_matrix() RETURNS text AS 'sql<-"SELECT g, ARRAY[g, g * 10, g * 100]::float8[] AS v, CASE WHEN g > 1 THEN ARRAY[g] END AS w FROM generate_series(1,4) g"; d<-pg.spi.exec(sql, array.matrix=TRUE); l<-pg.spi.exec(sql); return (paste(paste(dim(d$v), collapse="x"), d$v[3,2], is.list(d$w), is.list(l$v), l$v[[3]][2]));' language 'plr';
+SELECT test_spi_exec_array_matrix();
+
+--Test function execution statistics
+SET plr.track_functions = on;
+SELECT plr_stat_reset();
+CREATE OR REPLACE FUNCTION test_stat_srf(int) RETURNS SETOF int AS 'seq_len(arg1)' language 'plr';
+SELECT count(*) FROM test_stat_srf(5);
+SELECT count(*) FROM test_stat_srf(3);
+SELECT funcname, calls, rows_out, bytes_in, total_time >= eval_time AS timed FROM plr_stat_functions() WHERE funcname = 'test_stat_srf';
+SET plr.track_functions = off;
+
+--Test R heap limits and usage reporting
+SET plr.max_heap_size = '256MB';
+CREATE OR REPLACE FUNCTION test_heap_limit() RETURNS int AS 'length(numeric(1000))' language 'plr';
+SELECT test_heap_limit();
+SELECT heap, used > 0 AS used, limit_bytes BETWEEN 268435000 AND 268435456 AS limited FROM plr_r_memory();
+RESET plr.max_heap_size;
+SELECT test_heap_limit();
+SELECT heap, limit_bytes IS NULL AS unlimited FROM plr_r_memory();
+
+--Test the R profiler
+CREATE OR REPLACE FUNCTION test_profile() RETURNS int AS 'spin <- function() { t <- proc.time()[[3]]; while (proc.time()[[3]] - t < 0.2) NULL; 1L }; spin()' language 'plr';
+ALTER FUNCTION test_profile() SET plr.profile_functions = on;
+SET plr.profile_interval = 1;
+SELECT test_profile();
+SELECT stack, total_samples > 0 AS sampled FROM plr_profile() WHERE funcname = 'test_profile' AND stack IN ('test_profile', 'test_profile -> spin') ORDER BY stack;
+SELECT plr_profile_reset();
+SELECT count(*) FROM plr_profile();
+RESET plr.profile_interval;
+
+--Test phase reporting through wait events
+CREATE OR REPLACE FUNCTION test_phase_wait() RETURNS bool AS 'pg.spi.exec("SELECT CASE WHEN current_setting(''server_version_num'')::int >= 170000 THEN wait_event_type = ''Extension'' AND wait_event = ''PLRSPI'' ELSE wait_event_type IS NULL END FROM pg_stat_activity WHERE pid = pg_backend_pid()")[[1]]' language 'plr';
+SELECT test_phase_wait();
+SELECT wait_event_type IS NULL AS cleared FROM pg_stat_activity WHERE pid = pg_backend_pid();
+
+--Test garbage collection control
+SET plr.gc_mode = 'statement';
+SELECT test_heap_limit();
+SELECT plr_gc() >= 0 AS collected;
+RESET plr.gc_mode;
+
+--Test that reloading plr_modules only evaluates changed modules
+INSERT INTO plr_modules VALUES (1, 'pg.test.module.count <- if (exists("pg.test.module.count")) pg.test.module.count + 1L else 1L');
+select reload_plr_modules();
+select reload_plr_modules();
+CREATE OR REPLACE FUNCTION test_module_count() RETURNS int AS 'pg.test.module.count' language 'plr';
+SELECT test_module_count();
+
+--Test lazy plr_modules loading
+ALTER TABLE plr_modules ADD COLUMN modeager bool;
+INSERT INTO plr_modules VALUES (2, 'pg.test.lazy <- { pg.test.lazy.done <- TRUE; 42L }', NULL);
+INSERT INTO plr_modules VALUES (3, 'pg.test.eager <- { pg.test.eager.done <- TRUE; 1L }', true);
+SET plr.lazy_modules = on;
+select reload_plr_modules();
+CREATE OR REPLACE FUNCTION test_module_done(text) RETURNS bool AS 'exists(arg1)' language 'plr';
+SELECT test_module_done('pg.test.lazy.done') AS lazy, test_module_done('pg.test.eager.done') AS eager;
+CREATE OR REPLACE FUNCTION test_module_lazy() RETURNS int AS 'pg.test.lazy' language 'plr';
+SELECT test_module_lazy();
+SELECT test_module_done('pg.test.lazy.done') AS lazy;
+INSERT INTO plr_modules VALUES (4, 'pg.test.retry <- if (exists("pg.test.retry.ok")) 2L else stop("not yet")', NULL);
+select reload_plr_modules();
+CREATE OR REPLACE FUNCTION test_module_retry() RETURNS text AS 'class(try(pg.test.retry, silent = TRUE))[1]' language 'plr';
+SELECT test_module_retry();
+CREATE OR REPLACE FUNCTION test_module_retry_ok() RETURNS bool AS 'assign("pg.test.retry.ok", TRUE, envir = globalenv())' language 'plr';
+SELECT test_module_retry_ok();
+SELECT test_module_retry();
+RESET plr.lazy_modules;
+
+--Test statement triggers with transition tables
+CREATE TABLE trans_tab (id int4, v text);
+CREATE OR REPLACE FUNCTION test_trans_trig() RETURNS trigger AS '
+pg.thrownotice(paste(pg.tg.op, pg.tg.level, nrow(pg.tg.new), sum(pg.tg.new$id), is.null(pg.tg.old),
+                     pg.spi.exec("SELECT count(*) FROM newtab")[[1]]))
+NULL
+' language 'plr';
+CREATE TRIGGER trans_trig AFTER INSERT ON trans_tab REFERENCING NEW TABLE AS newtab
+  FOR EACH STATEMENT EXECUTE PROCEDURE test_trans_trig();
+INSERT INTO trans_tab SELECT g, g::text FROM generate_series(1, 1000) g;
+
+--Test that constant trigger arguments are shared by the rows of a statement
+CREATE TABLE trig_args_tab (id int4);
+CREATE OR REPLACE FUNCTION test_trig_args() RETURNS trigger AS '
+pg.thrownotice(paste(pg.tg.relname, pg.tg.op, pg.tg.args[1], pg.tg.new$id))
+pg.tg.args[1] <- "changed"
+pg.tg.new
+' language 'plr';
+CREATE TRIGGER trig_args BEFORE INSERT ON trig_args_tab FOR EACH ROW EXECUTE PROCEDURE test_trig_args('orig');
+INSERT INTO trig_args_tab VALUES (1), (2);
+SELECT * FROM trig_args_tab ORDER BY id;
+
+--Test row triggers returning NEW unchanged or with some columns changed
+CREATE TABLE trig_mod_tab (id int4, f float8, t text);
+CREATE OR REPLACE FUNCTION test_trig_mod() RETURNS trigger AS '
+if (pg.tg.new$id > 1) pg.tg.new$f <- pg.tg.new$f * 2
+if (pg.tg.new$id > 2) pg.tg.new$t <- NA
+pg.tg.new
+' language 'plr';
+CREATE TRIGGER trig_mod BEFORE INSERT OR UPDATE ON trig_mod_tab FOR EACH ROW EXECUTE PROCEDURE test_trig_mod();
+INSERT INTO trig_mod_tab VALUES (1, 1.5, 'a'), (2, 1.5, 'b'), (3, 1.5, 'c');
+UPDATE trig_mod_tab SET t = 'u' WHERE id = 1;
+SELECT * FROM trig_mod_tab ORDER BY id;
+
+--Test changed trigger columns keep their typmods
+CREATE TABLE trig_typmod_tab (id int4, n numeric(5,2), v varchar(3));
+CREATE OR REPLACE FUNCTION test_trig_typmod() RETURNS trigger AS '
+pg.tg.new$n <- pg.tg.new$n / 3
+if (pg.tg.new$id > 1) pg.tg.new$v <- "abcd"
+pg.tg.new
+' language 'plr';
+CREATE TRIGGER trig_typmod BEFORE INSERT ON trig_typmod_tab FOR EACH ROW EXECUTE PROCEDURE test_trig_typmod();
+INSERT INTO trig_typmod_tab VALUES (1, 1.00, 'a');
+INSERT INTO trig_typmod_tab VALUES (2, 1.00, 'a');
+SELECT * FROM trig_typmod_tab;
+CREATE TABLE trig_float4_tab (f4 float4);
+CREATE OR REPLACE FUNCTION test_trig_float4() RETURNS trigger AS 'pg.tg.new$f4 <- 1e300; pg.tg.new' language 'plr';
+CREATE TRIGGER trig_float4 BEFORE INSERT ON trig_float4_tab FOR EACH ROW EXECUTE PROCEDURE test_trig_float4();
+INSERT INTO trig_float4_tab VALUES (1);
+
+--Test the conversion of trigger tuples to NEW and OLD
+CREATE TABLE trig_conv_tab (i2 int2, i8 int8, f4 float4, b bool, t text, n numeric, a int4[]);
+CREATE OR REPLACE FUNCTION test_trig_conv() RETURNS trigger AS '
+pg.thrownotice(paste(names(pg.tg.new), sapply(pg.tg.new, function(x) class(x)[1]), collapse = ","))
+pg.thrownotice(paste(pg.tg.new$i8, pg.tg.new$b, is.na(pg.tg.new$t), pg.tg.new$n, pg.tg.new$a[[1]][2], nrow(pg.tg.new), pg.tg.new$f4 == 0.1))
+NULL
+' language 'plr';
+CREATE TRIGGER trig_conv AFTER INSERT ON trig_conv_tab FOR EACH ROW EXECUTE PROCEDURE test_trig_conv();
+INSERT INTO trig_conv_tab VALUES (1, 5000000000, 0.1, true, NULL, 1.25, '{1,2,3}');
+
+--Test bytea serialization formats and compression
+CREATE OR REPLACE FUNCTION test_serialize_vec(int) RETURNS bytea AS 'rep(1.5, arg1)' language 'plr';
+CREATE OR REPLACE FUNCTION test_unserialize_vec(bytea) RETURNS text AS 'paste(length(arg1), sum(arg1))' language 'plr';
+SET plr.serialize_format = binary;
+SET plr.serialize_compression = pglz;
+SELECT substr(test_serialize_vec(10), 1, 2) AS tag, substr(test_serialize_vec(10000), 1, 3) AS ztag, length(test_serialize_vec(10000)) < 80000 AS smaller;
+SELECT test_unserialize_vec(test_serialize_vec(10)), test_unserialize_vec(test_serialize_vec(10000));
+RESET plr.serialize_format;
+RESET plr.serialize_compression;
+SELECT substr(test_serialize_vec(10), 1, 2) AS tag, test_unserialize_vec(test_serialize_vec(10000));
+
+--Test the cache of R objects unserialized from bytea arguments
+CREATE TABLE object_cache_tab (id int4, model bytea);
+INSERT INTO object_cache_tab SELECT g, CASE WHEN g < 4 THEN test_serialize_vec(1000) ELSE test_serialize_vec(10) END FROM generate_series(1, 5) g;
+SET plr.object_cache_size = '1MB';
+SELECT id, test_unserialize_vec(model) FROM object_cache_tab ORDER BY id;
+SELECT entries, hits, misses, evictions FROM plr_object_cache();
+SET plr.object_cache_size = 0;
+SELECT test_unserialize_vec(model) FROM object_cache_tab WHERE id = 1;
+SELECT entries, bytes, hits, misses, evictions FROM plr_object_cache();
+SELECT plr_object_cache_reset();
+SELECT entries, hits, misses FROM plr_object_cache();
+
+--Test the shared object store
+CREATE OR REPLACE FUNCTION test_shared_put(text, int) RETURNS bool AS 'pg.shared.put(arg1, rep(1.5, arg2)) > 0' language 'plr';
+CREATE OR REPLACE FUNCTION test_shared_get(text) RETURNS text AS 'x <- pg.shared.get(arg1); if (is.null(x)) "missing" else paste(length(x), sum(x))' language 'plr';
+CREATE OR REPLACE FUNCTION test_shared_remove(text) RETURNS bool AS 'pg.shared.remove(arg1)' language 'plr';
+SELECT test_shared_put('m1', 10), test_shared_put('m2', 10);
+SELECT test_shared_put('m1', 20);
+SELECT test_shared_get('m1'), test_shared_get('m1'), test_shared_get('m2'), test_shared_get('nope');
+SELECT name, reads FROM plr_shared_objects() WHERE name IN ('m1', 'm2') ORDER BY name;
+SELECT test_shared_remove('m1'), test_shared_remove('m1'), test_shared_remove('m2');
+SELECT test_shared_get('m1');
+
+--Test native conversion of date and time values
+CREATE OR REPLACE FUNCTION test_datetime_class(date, timestamp, timestamptz, interval) RETURNS text AS 'paste(sapply(list(arg1, arg2, arg3, arg4), function(x) class(x)[1]), collapse = ",")' language 'plr';
+CREATE OR REPLACE FUNCTION test_datetime_arg(date, timestamp, timestamptz, interval) RETURNS text AS 'paste(as.numeric(arg1), format(arg2, "%Y-%m-%d %H:%M:%OS3"), as.numeric(arg3), as.numeric(arg4))' language 'plr';
+CREATE OR REPLACE FUNCTION test_datetime_arr(date[]) RETURNS float8 AS 'as.numeric(diff(arg1))' language 'plr';
+CREATE OR REPLACE FUNCTION test_datetime_spi() RETURNS text AS 'x <- pg.spi.exec("select date ''2024-01-01'' as d, timestamp ''infinity'' as t, NULL::interval as i"); paste(class(x$d), is.infinite(x$t), is.na(x$i))' language 'plr';
+SELECT test_datetime_class('2024-01-01', '2024-01-01 12:30:45.25', '2024-01-01 12:30:45.25+00', '1 day 01:01:01.5');
+SET plr.native_datetime = on;
+SELECT test_datetime_class('2024-01-01', '2024-01-01 12:30:45.25', '2024-01-01 12:30:45.25+00', '1 day 01:01:01.5');
+SELECT test_datetime_arg('2024-01-01', '2024-01-01 12:30:45.25', '2024-01-01 12:30:45.25+00', '1 day 01:01:01.5');
+SELECT test_datetime_arr('{2024-01-01,2024-03-01}'), test_datetime_spi();
+CREATE OR REPLACE FUNCTION test_datetime_ret(date) RETURNS date AS 'arg1 + 1' language 'plr';
+CREATE OR REPLACE FUNCTION test_datetime_ret_ts() RETURNS timestamp AS 'as.POSIXct("2024-01-01 12:30:45.25", tz = "UTC")' language 'plr';
+CREATE OR REPLACE FUNCTION test_datetime_ret_iv() RETURNS interval AS 'as.difftime(90, units = "mins")' language 'plr';
+SELECT test_datetime_ret('2024-01-01') = '2024-01-02'::date AS d, test_datetime_ret_ts() = '2024-01-01 12:30:45.25'::timestamp AS ts, test_datetime_ret_iv() = '01:30:00'::interval AS iv;
+CREATE OR REPLACE FUNCTION test_datetime_srf(OUT d date, OUT ts timestamptz, OUT n int4) RETURNS SETOF record AS 'data.frame(d = as.Date("2024-01-01") + 0:1, ts = as.POSIXct(c(0, NA), origin = "1970-01-01", tz = "UTC"), n = 1:2)' language 'plr';
+SELECT d = '2024-01-01'::date + n - 1 AS d, ts = 'epoch'::timestamptz AS ts, n FROM test_datetime_srf();
+CREATE OR REPLACE FUNCTION test_datetime_ret_tz() RETURNS timestamp AS 'as.POSIXct("2024-01-01 12:30:00", tz = "America/New_York")' language 'plr';
+SELECT test_datetime_ret_tz() = '2024-01-01 12:30:00'::timestamp AS ny;
+RESET plr.native_datetime;
+SELECT test_datetime_ret_tz() = '2024-01-01 12:30:00'::timestamp AS ny;
+
+--Test numeric conversion
+CREATE OR REPLACE FUNCTION test_numeric_arg(numeric[]) RETURNS text AS 'paste(class(arg1), all(arg1[1:4] == c(0.1, -123.456, 1e30, 12345678901234567890.123)), is.na(arg1[5]), is.nan(arg1[6]))' language 'plr';
+SELECT test_numeric_arg('{0.1,-123.456,1e30,12345678901234567890.123,NULL,NaN}');
+CREATE OR REPLACE FUNCTION test_numeric_chr(numeric) RETURNS text AS 'paste(class(arg1), arg1)' language 'plr';
+SET plr.numeric_conversion = character;
+SELECT test_numeric_chr(12345678901234567890.123456789);
+RESET plr.numeric_conversion;
+CREATE OR REPLACE FUNCTION test_numeric_srf() RETURNS SETOF numeric AS 'c(0.1, 1/3, 2^52, NA)' language 'plr';
+SELECT * FROM test_numeric_srf();
+
+--Test int8 conversion to integer64
+CREATE OR REPLACE FUNCTION test_int8_class(int8) RETURNS text AS 'class(arg1)' language 'plr';
+CREATE OR REPLACE FUNCTION test_int8_echo(int8) RETURNS int8 AS 'arg1' language 'plr';
+CREATE OR REPLACE FUNCTION test_int8_text(int8) RETURNS text AS 'arg1' language 'plr';
+CREATE OR REPLACE FUNCTION test_int8_arr(int8[]) RETURNS int8[] AS 'arg1' language 'plr';
+CREATE OR REPLACE FUNCTION test_int8_spi() RETURNS SETOF record AS 'pg.spi.exec("select g::int8 + 9007199254740992 as id, nullif(g, 2)::int8 as n from generate_series(1, 3) g")' language 'plr';
+SELECT test_int8_class(1);
+SET plr.int8_conversion = integer64;
+SELECT test_int8_class(1), test_int8_echo(9007199254740993), test_int8_echo(NULL), test_int8_text(-9223372036854775807);
+SELECT test_int8_arr('{9007199254740993,-9223372036854775807}'), test_int8_arr('{9007199254740993,NULL}');
+SELECT * FROM test_int8_spi() AS t(id int8, n numeric);
+RESET plr.int8_conversion;